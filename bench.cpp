@@ -0,0 +1,544 @@
+#include <iostream>
+#include "tomo_tiff.h"
+#include "tomo_alloc.h"
+#include "tomo_gradient.h"
+#include "tomo_median.h"
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+
+using namespace std;
+
+// stage level benchmark of tomo_super_tiff on synthetic volumes
+//      every stage is timed in isolation and end to end for each thread count,
+//      then checked against the direct convolution / gsl reference below
+
+class tomo_bench{
+
+    public:
+
+    // differential & tensor are read through these so the reference does not depend on the layout
+    //      c : 0 xx, 1 xy, 2 xz, 3 yy, 4 yz, 5 zz
+    static float differential(tomo_super_tiff &sample, int x, int y, int z, int c){
+        static const int row[6] = {0,0,0,1,1,2};
+        static const int col[6] = {0,1,2,1,2,2};
+        return sample.differential_matrix_[z][sample.margin_+y][sample.margin_+x][ row[c] ][ col[c] ];
+    }
+    static float tensor(tomo_super_tiff &sample, int x, int y, int z, int c){
+        static const int row[6] = {0,0,0,1,1,2};
+        static const int col[6] = {0,1,2,1,2,2};
+        return sample.tensor_[z][y][x][ row[c] ][ col[c] ];
+    }
+    static float eigen_value(tomo_super_tiff &sample, int x, int y, int z, int m){
+        return sample.eigen_values_[z][y][x][m];
+    }
+    static float measure(tomo_super_tiff &sample, int x, int y, int z){
+        return sample.measure_[z][y][x] * sample.normalized_measure_;
+    }
+
+    static void make_gaussian_window(tomo_super_tiff &sample, int window_size, float standard_deviation){
+        sample.make_gaussian_window_(window_size, standard_deviation*(float)window_size/2.0);
+    }
+    static void make_gradient(tomo_super_tiff &sample, int window_size){
+        sample.plan().window_size = window_size; // the margin of the differential matrix
+        sample.make_differential_matrix_();
+    }
+    static void make_tensor(tomo_super_tiff &sample, int window_size){
+        sample.make_tensor_(window_size);
+    }
+    static void make_eigen_values(tomo_super_tiff &sample){
+        sample.make_eigen_values_();
+    }
+    static void make_measurement(tomo_super_tiff &sample){
+        sample.experimental_measurement(-1.0);
+    }
+};
+
+class bench_result{
+
+    public:
+
+    string stage;
+    int threads;
+    double seconds;
+    double voxels;
+    uint64_t allocations; // 0 unless built with ALLOC_TRACKING=1
+    uint64_t bytes_allocated;
+
+    bench_result(string stage, int threads, double seconds, double voxels, uint64_t allocations = 0, uint64_t bytes_allocated = 0){
+        this->stage = stage;
+        this->threads = threads;
+        this->seconds = seconds;
+        this->voxels = voxels;
+        this->allocations = allocations;
+        this->bytes_allocated = bytes_allocated;
+    }
+};
+
+// wall time & allocations between start and stop
+class bench_clock{
+
+    double start_;
+    uint64_t allocations_start_;
+    uint64_t bytes_allocated_start_;
+
+    public:
+
+    void start(void){
+        this->allocations_start_ = tomo_alloc::allocations();
+        this->bytes_allocated_start_ = tomo_alloc::bytes();
+        this->start_ = omp_get_wtime();
+    }
+    bench_result stop(string stage, int threads, double voxels){
+        double seconds = omp_get_wtime() - this->start_;
+        uint64_t allocations = tomo_alloc::allocations() - this->allocations_start_;
+        uint64_t bytes_allocated = tomo_alloc::bytes() - this->bytes_allocated_start_;
+        return bench_result(stage, threads, seconds, voxels, allocations, bytes_allocated);
+    }
+};
+
+// relative error : max |engine - reference| / max |reference|
+class bench_error{
+
+    double maximum_difference_;
+    double maximum_reference_;
+
+    public:
+
+    bench_error(){
+        this->maximum_difference_ = 0.0;
+        this->maximum_reference_ = 0.0;
+    }
+    void add(double engine, double reference){
+        double difference = engine > reference ? engine - reference : reference - engine;
+        double absolute = reference > 0.0 ? reference : -reference;
+        this->maximum_difference_ = difference > this->maximum_difference_ ? difference : this->maximum_difference_;
+        this->maximum_reference_ = absolute > this->maximum_reference_ ? absolute : this->maximum_reference_;
+    }
+    double relative(){
+        return this->maximum_reference_ > 0.0 ? this->maximum_difference_ / this->maximum_reference_ : this->maximum_difference_;
+    }
+};
+
+static float reference_gradient(vector< vector< vector<float> > >& volume, int x, int y, int z, int axis){
+    int size[3] = { (int)volume[z][y].size(), (int)volume[z].size(), (int)volume.size() };
+    int p[3] = {x,y,z};
+    int index = p[axis];
+    int previous[3] = {x,y,z};
+    int next[3] = {x,y,z};
+    float divisor = 2.0;
+    if(index+1 >= size[axis]){
+        previous[axis] = index-1;
+        divisor = 1.0;
+    }else if(index-1 < 0){
+        next[axis] = index+1;
+        divisor = 1.0;
+    }else{
+        previous[axis] = index-1;
+        next[axis] = index+1;
+    }
+    return ( volume[next[2]][next[1]][next[0]] - volume[previous[2]][previous[1]][previous[0]] ) / divisor;
+}
+
+static void reference_gaussian(vector<float>& weights, int size, float standard_deviation){
+    weights.assign(size*size*size, 0.0);
+    float summation = 0.0;
+    for(int i=0;i<size;++i){
+        for(int j=0;j<size;++j){
+            for(int k=0;k<size;++k){
+                float fi = (float)i - (float)(size-1) / 2.0;
+                float fj = (float)j - (float)(size-1) / 2.0;
+                float fk = (float)k - (float)(size-1) / 2.0;
+                weights[(i*size+j)*size+k] = exp( -( fi*fi + fj*fj + fk*fk ) / (standard_deviation*standard_deviation) );
+                summation += weights[(i*size+j)*size+k];
+            }
+        }
+    }
+    for(int i=0;i<weights.size();++i){
+        weights[i] /= summation;
+    }
+    return;
+}
+
+static bool check(const char* stage, bench_error &error, double tolerance){
+    bool passed = error.relative() <= tolerance;
+    cout << left << setw(14) << stage << " relative error " << scientific << setprecision(3) << error.relative()
+         << " tolerance " << tolerance << (passed ? "  PASS" : "  FAIL") << fixed <<endl;
+    return passed;
+}
+
+// both median kernels on a ramp of 16 bit gray levels scaled to [0, 1] as the loader does,
+//      the histogram rounds to the levels so they agree to the last bit
+static bool median_parity(int radius, double tolerance){
+
+    int size = 24;
+    vector< vector< vector<float> > > ramp(size, vector< vector<float> >(size, vector<float>(size)));
+    for(int z=0;z<size;++z){
+        for(int y=0;y<size;++y){
+            for(int x=0;x<size;++x){
+                ramp[z][y][x] = (float)(((x + 3*y + 7*z) * 577) % 65536) / 65535.0f;
+            }
+        }
+    }
+
+    tomo_median_filter network(radius, TOMO_MEDIAN_NETWORK);
+    tomo_median_filter histogram(radius, TOMO_MEDIAN_HISTOGRAM);
+    bench_error error_median;
+    for(int z=0;z<size;++z){
+        vector< vector< vector<float> >* > window;
+        for(int dz=-radius;dz<=radius;++dz){
+            int nz = z+dz < 0 ? 0 : (z+dz >= size ? size-1 : z+dz);
+            window.push_back(&ramp[nz]);
+        }
+        vector< vector<float> > by_network, by_histogram;
+        network.filter(z, window, by_network);
+        histogram.filter(z, window, by_histogram);
+        for(int y=0;y<size;++y){
+            for(int x=0;x<size;++x){
+                error_median.add( by_histogram[y][x], by_network[y][x] );
+            }
+        }
+    }
+
+    return check(radius == 1 ? "median r1" : "median r2", error_median, tolerance);
+}
+
+// every stage is compared with the reference computed from the engine's own input of that stage
+static bool parity_checks(vector< vector< vector<float> > >& volume, int window_size, float standard_deviation, double tolerance){
+
+    cout << "checking numerical parity..." <<endl;
+
+    tomo_super_tiff sample(volume);
+    tomo_bench::make_gaussian_window(sample, window_size, standard_deviation);
+    tomo_bench::make_gradient(sample, window_size);
+    tomo_bench::make_tensor(sample, window_size);
+    tomo_bench::make_eigen_values(sample);
+    tomo_bench::make_measurement(sample);
+
+    int size_z = volume.size();
+    int size_y = volume[0].size();
+    int size_x = volume[0][0].size();
+    bool passed = true;
+
+    //gradient
+    bench_error error_gradient;
+    for(int z=0;z<size_z;++z){
+        for(int y=0;y<size_y;++y){
+            for(int x=0;x<size_x;++x){
+                float Ix = reference_gradient(volume,x,y,z,0);
+                float Iy = reference_gradient(volume,x,y,z,1);
+                float Iz = reference_gradient(volume,x,y,z,2);
+                float reference[6] = { Ix*Ix, Ix*Iy, Ix*Iz, Iy*Iy, Iy*Iz, Iz*Iz };
+                for(int c=0;c<6;++c){
+                    error_gradient.add( tomo_bench::differential(sample,x,y,z,c), reference[c] );
+                }
+            }
+        }
+    }
+    passed &= check("gradient", error_gradient, tolerance);
+
+    //tensor, direct convolution skipping the taps outside the volume
+    vector<float> weights;
+    reference_gaussian(weights, window_size, standard_deviation*(float)window_size/2.0);
+    bench_error error_tensor;
+    for(int z=0;z<size_z;++z){
+        for(int y=0;y<size_y;++y){
+            for(int x=0;x<size_x;++x){
+                double reference[6] = {0.0};
+                for(int k=0;k<window_size;++k){
+                    for(int j=0;j<window_size;++j){
+                        for(int i=0;i<window_size;++i){
+                            int sz = z - window_size/2 + k;
+                            int sy = y - window_size/2 + j;
+                            int sx = x - window_size/2 + i;
+                            if( sz < 0 || sz >= size_z || sy < 0 || sy >= size_y || sx < 0 || sx >= size_x )
+                                continue;
+                            float weight = weights[(k*window_size+j)*window_size+i];
+                            for(int c=0;c<6;++c){
+                                reference[c] += weight * tomo_bench::differential(sample,sx,sy,sz,c);
+                            }
+                        }
+                    }
+                }
+                for(int c=0;c<6;++c){
+                    error_tensor.add( tomo_bench::tensor(sample,x,y,z,c), reference[c] );
+                }
+            }
+        }
+    }
+    passed &= check("tensor", error_tensor, tolerance);
+
+    //eigen values with gsl
+    bench_error error_eigen;
+    gsl_matrix *tensor_matrix = gsl_matrix_alloc(3,3);
+    gsl_vector *eigen_value = gsl_vector_alloc(3);
+    gsl_matrix *eigen_vector = gsl_matrix_alloc(3,3);
+    gsl_eigen_symmv_workspace *w = gsl_eigen_symmv_alloc(3);
+    static const int index_c[3][3] = { {0,1,2}, {1,3,4}, {2,4,5} };
+    for(int z=0;z<size_z;++z){
+        for(int y=0;y<size_y;++y){
+            for(int x=0;x<size_x;++x){
+                for(int a=0;a<3;++a){
+                    for(int b=0;b<3;++b){
+                        gsl_matrix_set(tensor_matrix,a,b,tomo_bench::tensor(sample,x,y,z,index_c[a][b]));
+                    }
+                }
+                gsl_eigen_symmv(tensor_matrix,eigen_value,eigen_vector,w);
+                gsl_eigen_symmv_sort(eigen_value,eigen_vector,GSL_EIGEN_SORT_ABS_ASC);
+                for(int m=0;m<3;++m){
+                    double ev = gsl_vector_get(eigen_value,m);
+                    error_eigen.add( tomo_bench::eigen_value(sample,x,y,z,m), ev > 0.0 ? ev : -ev );
+                }
+            }
+        }
+    }
+    gsl_matrix_free(tensor_matrix);
+    gsl_matrix_free(eigen_vector);
+    gsl_vector_free(eigen_value);
+    gsl_eigen_symmv_free(w);
+    passed &= check("eigen", error_eigen, tolerance);
+
+    //measurement
+    bench_error error_measure;
+    for(int z=0;z<size_z;++z){
+        for(int y=0;y<size_y;++y){
+            for(int x=0;x<size_x;++x){
+                double ev[3];
+                for(int m=0;m<3;++m){
+                    ev[m] = tomo_bench::eigen_value(sample,x,y,z,m);
+                }
+                double reference = 0.3 * (ev[0]+ev[1]+ev[2]) * (ev[0]+ev[1]+ev[2]) - ev[0]*ev[1]*ev[2];
+                error_measure.add( tomo_bench::measure(sample,x,y,z), reference );
+            }
+        }
+    }
+    passed &= check("measure", error_measure, tolerance);
+
+    //median kernels
+    passed &= median_parity(1, tolerance);
+    passed &= median_parity(2, tolerance);
+
+    return passed;
+}
+
+static void bench_stages(vector< vector< vector<float> > >& volume, int threads, int window_size, float standard_deviation, vector<bench_result>& results){
+
+    omp_set_dynamic(0);
+    omp_set_num_threads(threads);
+
+    double voxels = (double)volume.size() * (double)volume[0].size() * (double)volume[0][0].size();
+    bench_clock timer;
+
+    //each stage in isolation
+    {
+        tomo_super_tiff sample(volume);
+        tomo_bench::make_gaussian_window(sample, window_size, standard_deviation);
+
+        timer.start();
+        tomo_bench::make_gradient(sample, window_size);
+        results.push_back( timer.stop("gradient", threads, voxels) );
+
+        timer.start();
+        tomo_bench::make_tensor(sample, window_size);
+        results.push_back( timer.stop("tensor", threads, voxels) );
+
+        timer.start();
+        tomo_bench::make_eigen_values(sample);
+        results.push_back( timer.stop("eigen", threads, voxels) );
+
+        timer.start();
+        tomo_bench::make_measurement(sample);
+        results.push_back( timer.stop("measure", threads, voxels) );
+    }
+
+    //tiff i/o
+    {
+        mkdir("bench_tiff", 0755);
+        timer.start();
+        #pragma omp parallel for
+        for(int i=0;i<volume.size();++i){
+            char address[100] = {0};
+            sprintf(address, "bench_tiff/%d.tif", i);
+            tomo_tiff tmp(volume[i]);
+            tmp.save(address);
+        }
+        results.push_back( timer.stop("tiff_write", threads, voxels) );
+
+        timer.start();
+        #pragma omp parallel for
+        for(int i=0;i<volume.size();++i){
+            char address[100] = {0};
+            sprintf(address, "bench_tiff/%d.tif", i);
+            tomo_tiff tmp(address);
+        }
+        results.push_back( timer.stop("tiff_read", threads, voxels) );
+
+        //nothing left behind
+        for(int i=0;i<volume.size();++i){
+            char address[100] = {0};
+            sprintf(address, "bench_tiff/%d.tif", i);
+            unlink(address);
+        }
+        rmdir("bench_tiff");
+    }
+
+    //end to end
+    {
+        tomo_super_tiff sample(volume);
+        timer.start();
+        sample.neuron_detection(window_size, -1.0, standard_deviation);
+        results.push_back( timer.stop("end_to_end", threads, voxels) );
+    }
+
+    return;
+}
+
+static void print_results(vector<bench_result>& results){
+
+    cout << endl;
+    cout << left << setw(14) << "stage" << setw(10) << "threads" << setw(14) << "seconds"
+         << setw(14) << "Mvoxel/s" << setw(10) << "speedup";
+    if(tomo_alloc::enabled())
+        cout << setw(14) << "allocs" << setw(14) << "allocs/voxel" << setw(14) << "MB allocated";
+    cout <<endl;
+
+    for(int i=0;i<results.size();++i){
+        //speedup against the first thread count of the same stage
+        double base = results[i].seconds;
+        for(int j=0;j<results.size();++j){
+            if(results[j].stage == results[i].stage){
+                base = results[j].seconds;
+                break;
+            }
+        }
+        cout << left << setw(14) << results[i].stage << setw(10) << results[i].threads
+             << setw(14) << fixed << setprecision(4) << results[i].seconds
+             << setw(14) << setprecision(2) << results[i].voxels / results[i].seconds / 1e6
+             << setw(10) << setprecision(2) << base / results[i].seconds;
+        if(tomo_alloc::enabled()){
+            cout << setw(14) << results[i].allocations
+                 << setw(14) << setprecision(3) << (double)results[i].allocations / results[i].voxels
+                 << setw(14) << setprecision(2) << (double)results[i].bytes_allocated / 1e6;
+        }
+        cout <<endl;
+    }
+    return;
+}
+
+// the per-voxel stages, i/o and end to end are allowed to allocate
+static bool check_allocations(vector<bench_result>& results, double allocations_per_voxel){
+
+    bool passed = true;
+    for(int i=0;i<results.size();++i){
+        const string &stage = results[i].stage;
+        if(stage != "gradient" && stage != "tensor" && stage != "eigen" && stage != "measure")
+            continue;
+        double per_voxel = (double)results[i].allocations / results[i].voxels;
+        if(per_voxel > allocations_per_voxel){
+            cout << stage << " with " << results[i].threads << " threads allocates " << per_voxel
+                 << " times per voxel, budget " << allocations_per_voxel <<endl;
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+void print_usage(void){
+    cout << "Usage: " <<endl;
+    cout << "bench" <<endl;
+    cout << "[-s volume_size] default 64" <<endl;
+    cout << "[-w window_size] default 5" <<endl;
+    cout << "[-t thread_counts] e.g. 1,2,4 default powers of 2 up to the maximum" <<endl;
+    cout << "[-e tolerance] relative, default 1e-4" <<endl;
+    cout << "[-n] skip the parity checks" <<endl;
+    cout << "[-a allocations_per_voxel] fail when a compute stage allocates more, needs ALLOC_TRACKING=1" <<endl;
+    return;
+}
+
+int main(int argc, char **argv){
+
+    int opt = 0;
+    int size = 64;
+    int window_size = 5;
+    float standard_deviation = 0.8;
+    double tolerance = 1e-4;
+    bool parity = true;
+    double allocation_budget = -1.0;
+    vector<int> thread_counts;
+
+    while( (opt = getopt(argc, argv, "s:w:t:e:na:")) != -1 ){
+        switch(opt){
+        case 's':
+            size = atoi(optarg);
+            break;
+
+        case 'w':
+            window_size = atoi(optarg);
+            break;
+
+        case 't':{
+            stringstream list(optarg);
+            string item;
+            while(getline(list, item, ',')){
+                thread_counts.push_back(atoi(item.c_str()));
+            }
+            break;
+        }
+
+        case 'e':
+            tolerance = atof(optarg);
+            break;
+
+        case 'n':
+            parity = false;
+            break;
+
+        case 'a':
+            allocation_budget = atof(optarg);
+            break;
+
+        default:
+            print_usage();
+            exit(-1);
+        }
+    }
+    if(thread_counts.empty()){
+        for(int t=1;t<omp_get_max_threads();t*=2){
+            thread_counts.push_back(t);
+        }
+        thread_counts.push_back(omp_get_max_threads());
+    }
+
+    cout << "creating synthetic volume " << size << "^3..." <<endl;
+    cout << "gradient kernel : " << tomo_gradient::isa() <<endl;
+    vector< vector< vector<float> > > volume;
+    create_experimental_volume(volume, size);
+
+    vector<bench_result> results;
+    for(int i=0;i<thread_counts.size();++i){
+        cout << "benchmarking with " << thread_counts[i] << " threads..." <<endl;
+        bench_stages(volume, thread_counts[i], window_size, standard_deviation, results);
+    }
+    print_results(results);
+
+    if(allocation_budget >= 0.0){
+        if(tomo_alloc::enabled() == false){
+            cerr << "ERROR : -a needs a build with ALLOC_TRACKING=1" <<endl;
+            return -1;
+        }
+        if(check_allocations(results, allocation_budget) == false){
+            cerr << "ERROR : allocation budget exceeded" <<endl;
+            return -1;
+        }
+    }
+
+    if(parity){
+        cout << endl;
+        if(parity_checks(volume, window_size, standard_deviation, tolerance) == false){
+            cerr << "ERROR : parity checks failed" <<endl;
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -1,8 +1,21 @@
 #include <iostream>
 #include "tomo_tiff.h"
+#include "tomo_synthetic.h"
+#include "tomo_metrics.h"
+#include "tomo_components.h"
+#include "tomo_peaks.h"
+#include "tomo_skeleton.h"
+#include "tomo_distance.h"
+#include "tomo_orientation.h"
+#include "tomo_hessian.h"
+#include "tomo_somata.h"
+#include "tomo_median.h"
+#include "tomo_background.h"
+#include "tomo_streamlines.h"
 #include <cstring>
 #include <cstdlib>
 #include <unistd.h>
+#include <getopt.h>
 
 
 using namespace std;
@@ -13,21 +26,64 @@ void print_usage(void){
     cout << "[-w window_size]" << endl;
     cout << "[-t num_threads]" << endl;
     cout << "[-d] create experiment data" <<endl;
+    cout << "[-g x=,y=,z=,fibres=,radius=,orientation=random|fan|x|y|z,noise=,bits=8|16,seed=] generate synthetic data" <<endl;
     cout << "*[-f result_folder_name]" <<endl;
     cout << "*[-s save_eigen_value_address]" <<endl;
     cout << "*[-e address_ev]" <<endl;
     cout << "*[-h threshold > 0]" <<endl;
     cout << "*[-b] bundle magnification" <<endl;
     cout << "[-m result_directory] merge measurements" <<endl;
+    cout << "[--metrics report.json] per-stage metrics" <<endl;
+    cout << "[--heartbeat heartbeat.json[:seconds]] rewritten periodically while running" <<endl;
+    cout << "[--perf-counters] hardware counters per stage in the metrics" <<endl;
+    cout << "[--trace trace.json] per-thread timeline for chrome://tracing" <<endl;
+    cout << "[--memory-budget bytes[K|M|G]] default 3/4 of the physical memory" <<endl;
+    cout << "[--plan-only] print the estimated memory & time of the plans and exit" <<endl;
+    cout << "[--resume] out of core only, keep the slices finished by an interrupted run, not with --orientation" <<endl;
+    cout << "[--roi x0:x1,y0:y1,z0:z1] read, compute & save only that region, e.g. 100:300,:,20:60" <<endl;
+    cout << "[--scales 3,5,9] several window sizes from one gradient pass, instead of -w" <<endl;
+    cout << "[--combine max|normalized] how the scales are combined, default max, normalized in memory only" <<endl;
+    cout << "[--median radius[:network|histogram]] 3d median of the data before the gradient, network up to radius 1 by default" <<endl;
+    cout << "[--background radius[:z=0]] subtract the opening by a box of that radius before the gradient, after --median" <<endl;
+    cout << "[--engine tensor|hessian] eigen values of the structure tensor or of the hessian, default tensor, the eigen value images with tensor only" <<endl;
+    cout << "[--measure experimental|noble[:constant]|ratio|frangi[:constant]] measure from the eigen values, default experimental, frangi with the hessian" <<endl;
+    cout << "    frangi constant default half the largest norm of the hessian, 0 without the structure term" <<endl;
+    cout << "[--components prefix[:threshold]] label the connected voxels with measure >= threshold, default 0.5 with -h" <<endl;
+    cout << "[--skeleton address.swc[:threshold]] centrelines of the voxels with measure >= threshold, default 0.5 with -h" <<endl;
+    cout << "[--distance prefix[:threshold]] distance of the voxels with measure >= threshold to the others, default 0.5 with -h" <<endl;
+    cout << "[--orientation prefix] neurite direction of every voxel, 4 bytes each" <<endl;
+    cout << "[--streamlines address.swc[:seed=,stop=,step=0.5,length=1000,seeds=1000,angle=60]] traced from the peaks >= seed while the measure >= stop, default 0.5 with -h, in memory" <<endl;
+    cout << "[--somata prefix[:rmin=3,rmax=12,scales=5,min=0,top=0]] bright blobs of the data from the loaded slices, in memory" <<endl;
+    cout << "[--peaks prefix[:radius=1,min=0,top=0,format=csv|binary]] local maxima of the measure, the best top ones, 0 for all" <<endl;
     cout << "address_filelist" <<endl;
     return;
 }
 
+// address[:threshold] of the outputs made from the thresholded measure, threshold -1.0 when not given
+bool parse_mask_output(const char *spec, string &address, float &threshold){
+    const char *colon = strchr(spec, ':');
+    address = colon == NULL ? string(spec) : string(spec, colon - spec);
+    threshold = colon == NULL ? -1.0 : atof(colon + 1);
+    return !address.empty() && (colon == NULL || threshold > 0);
+}
+
+// the measure is 0 or 1 with -h, it has no fixed range without
+void default_mask_threshold(const char *option, float &threshold, float threshold_measurement){
+    if(threshold > 0)
+        return;
+    if(threshold_measurement <= 0){
+        cerr << "ERROR : " << option << " needs a threshold without -h" <<endl;
+        exit(-1);
+    }
+    threshold = 0.5;
+    return;
+}
+
 int main(int argc, char **argv){
 
     //argument
     int opt = 0;
-    enum{ ORIGINAL_DATA, EIGEN_VALUE, EXPERIMENTAL_DATA, BUNDLE, MERGE } mode = ORIGINAL_DATA;
+    enum{ ORIGINAL_DATA, EIGEN_VALUE, EXPERIMENTAL_DATA, SYNTHETIC_DATA, BUNDLE, MERGE } mode = ORIGINAL_DATA;
     int window_size = 5;
     int num_threads = -1;
     float threshold_measurement = -1.0;
@@ -35,9 +91,58 @@ int main(int argc, char **argv){
     string folder_name;
     string saving_ev_address;
     string address_ev;
+    tomo_synthetic synthetic;
+    tomo_plan plan;
+    bool plan_only = false;
+    bool resuming = false;
+    tomo_roi roi;
+    vector<int> scales;
+    int combine = TOMO_COMBINE_MAX;
+    int measure = TOMO_MEASURE_EXPERIMENTAL;
+    float measure_constant = 0.0;
+    bool measure_given = false;
+    int engine = TOMO_ENGINE_TENSOR;
+    string components_prefix;
+    float components_threshold = -1.0;
+    tomo_peak_options peaks;
+    string skeleton_address;
+    float skeleton_threshold = -1.0;
+    string distance_prefix;
+    float distance_threshold = -1.0;
+    string orientation_prefix;
+    tomo_streamline_options streamlines;
+    tomo_soma_options somata;
+    tomo_median_filter *median = NULL;
+    tomo_background_filter *background = NULL;
+
+    enum{ OPTION_METRICS = 256, OPTION_HEARTBEAT, OPTION_PERF_COUNTERS, OPTION_TRACE, OPTION_MEMORY_BUDGET, OPTION_PLAN_ONLY, OPTION_RESUME, OPTION_ROI, OPTION_SCALES, OPTION_COMBINE, OPTION_MEASURE, OPTION_COMPONENTS, OPTION_PEAKS, OPTION_SKELETON, OPTION_DISTANCE, OPTION_ORIENTATION, OPTION_STREAMLINES, OPTION_ENGINE, OPTION_SOMATA, OPTION_MEDIAN, OPTION_BACKGROUND };
+    static struct option long_options[] = {
+        {"metrics", required_argument, NULL, OPTION_METRICS},
+        {"heartbeat", required_argument, NULL, OPTION_HEARTBEAT},
+        {"perf-counters", no_argument, NULL, OPTION_PERF_COUNTERS},
+        {"trace", required_argument, NULL, OPTION_TRACE},
+        {"memory-budget", required_argument, NULL, OPTION_MEMORY_BUDGET},
+        {"plan-only", no_argument, NULL, OPTION_PLAN_ONLY},
+        {"resume", no_argument, NULL, OPTION_RESUME},
+        {"roi", required_argument, NULL, OPTION_ROI},
+        {"scales", required_argument, NULL, OPTION_SCALES},
+        {"combine", required_argument, NULL, OPTION_COMBINE},
+        {"measure", required_argument, NULL, OPTION_MEASURE},
+        {"components", required_argument, NULL, OPTION_COMPONENTS},
+        {"peaks", required_argument, NULL, OPTION_PEAKS},
+        {"skeleton", required_argument, NULL, OPTION_SKELETON},
+        {"distance", required_argument, NULL, OPTION_DISTANCE},
+        {"orientation", required_argument, NULL, OPTION_ORIENTATION},
+        {"streamlines", required_argument, NULL, OPTION_STREAMLINES},
+        {"engine", required_argument, NULL, OPTION_ENGINE},
+        {"somata", required_argument, NULL, OPTION_SOMATA},
+        {"median", required_argument, NULL, OPTION_MEDIAN},
+        {"background", required_argument, NULL, OPTION_BACKGROUND},
+        {NULL, 0, NULL, 0}
+    };
 
     //parsing arguments
-    while( (opt = getopt(argc, argv, "e:w:t:f:s:dh:bm:")) != -1 ){
+    while( (opt = getopt_long(argc, argv, "e:w:t:f:s:dg:h:bm:", long_options, NULL)) != -1 ){
         switch(opt){
         case 'e':
             mode = EIGEN_VALUE;
@@ -64,6 +169,14 @@ int main(int argc, char **argv){
             mode = EXPERIMENTAL_DATA;
             break;
 
+        case 'g':
+            mode = SYNTHETIC_DATA;
+            if(synthetic.parse(optarg) == false){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
         case 'h':
             sscanf(optarg,"%f",&threshold_measurement);
             if(threshold_measurement <= 0){
@@ -81,6 +194,172 @@ int main(int argc, char **argv){
             folder_name = string(optarg);
             break;
 
+        case OPTION_METRICS:
+            tomo_metrics::set_report(optarg);
+            break;
+
+        case OPTION_HEARTBEAT:{
+            string address_heartbeat(optarg);
+            int interval = 10;
+            size_t position = address_heartbeat.rfind(':');
+            if(position != string::npos){
+                interval = atoi(address_heartbeat.substr(position+1).c_str());
+                address_heartbeat = address_heartbeat.substr(0, position);
+            }
+            tomo_metrics::start_heartbeat(address_heartbeat.c_str(), interval);
+            break;
+        }
+
+        case OPTION_PERF_COUNTERS:
+            tomo_perf::enable();
+            break;
+
+        case OPTION_TRACE:
+            tomo_trace::enable(optarg);
+            break;
+
+        case OPTION_MEMORY_BUDGET:
+            plan.memory_budget = tomo_plan::parse_bytes(optarg);
+            if(plan.memory_budget == 0){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_PLAN_ONLY:
+            plan_only = true;
+            break;
+
+        case OPTION_RESUME:
+            resuming = true;
+            break;
+
+        case OPTION_ROI:
+            if(roi.parse(optarg) == false){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_SCALES:{
+            stringstream list(optarg);
+            string item;
+            while(getline(list, item, ',')){
+                scales.push_back(atoi(item.c_str()));
+                if(scales.back() <= 0){
+                    print_usage();
+                    exit(-1);
+                }
+            }
+            break;
+        }
+
+        case OPTION_COMBINE:
+            if(strcmp(optarg, "max") == 0)
+                combine = TOMO_COMBINE_MAX;
+            else if(strcmp(optarg, "normalized") == 0)
+                combine = TOMO_COMBINE_NORMALIZED;
+            else{
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_MEASURE:
+            if(strcmp(optarg, "experimental") == 0)
+                measure = TOMO_MEASURE_EXPERIMENTAL;
+            else if(strncmp(optarg, "noble", 5) == 0 && (optarg[5] == '\0' || optarg[5] == ':')){
+                measure = TOMO_MEASURE_NOBLE;
+                measure_constant = optarg[5] == ':' ? atof(optarg + 6) : 0.0;
+            }
+            else if(strcmp(optarg, "ratio") == 0)
+                measure = TOMO_MEASURE_EIGEN_RATIO;
+            else if(strncmp(optarg, "frangi", 6) == 0 && (optarg[6] == '\0' || optarg[6] == ':')){
+                measure = TOMO_MEASURE_FRANGI;
+                measure_constant = optarg[6] == ':' ? atof(optarg + 7) : -1.0; // half the largest norm of the hessian
+            }
+            else{
+                print_usage();
+                exit(-1);
+            }
+            measure_given = true;
+            break;
+
+        case OPTION_ENGINE:
+            if(strcmp(optarg, "tensor") == 0)
+                engine = TOMO_ENGINE_TENSOR;
+            else if(strcmp(optarg, "hessian") == 0)
+                engine = TOMO_ENGINE_HESSIAN;
+            else{
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_COMPONENTS:
+            if(parse_mask_output(optarg, components_prefix, components_threshold) == false){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_SKELETON:
+            if(parse_mask_output(optarg, skeleton_address, skeleton_threshold) == false){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_DISTANCE:
+            if(parse_mask_output(optarg, distance_prefix, distance_threshold) == false){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_ORIENTATION:
+            orientation_prefix = string(optarg);
+            break;
+
+        case OPTION_STREAMLINES:
+            if(streamlines.parse(optarg) == false){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_PEAKS:
+            if(peaks.parse(optarg) == false){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_SOMATA:
+            if(somata.parse(optarg) == false){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_MEDIAN:
+            delete median;
+            median = tomo_median_filter::parse(optarg);
+            if(median == NULL){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
+        case OPTION_BACKGROUND:
+            delete background;
+            background = tomo_background_filter::parse(optarg);
+            if(background == NULL){
+                print_usage();
+                exit(-1);
+            }
+            break;
+
         default:
             print_usage();
             exit(-1);
@@ -91,6 +370,28 @@ int main(int argc, char **argv){
         exit(-1);
     }
     address = (char*)argv[optind];
+    if(engine == TOMO_ENGINE_TENSOR && measure == TOMO_MEASURE_FRANGI){
+        cerr << "ERROR : frangi needs the signed eigen values of --engine hessian" <<endl;
+        exit(-1);
+    }
+    if(engine == TOMO_ENGINE_HESSIAN && !saving_ev_address.empty()){
+        cerr << "ERROR : -s saves the absolute eigen values of the tensor, not with --engine hessian" <<endl;
+        exit(-1);
+    }
+    if(engine == TOMO_ENGINE_HESSIAN && measure_given == false){
+        measure = TOMO_MEASURE_FRANGI; // the others expect the absolute eigen values of the tensor
+        measure_constant = -1.0;
+    }
+    if(!components_prefix.empty())
+        default_mask_threshold("--components", components_threshold, threshold_measurement);
+    if(!skeleton_address.empty())
+        default_mask_threshold("--skeleton", skeleton_threshold, threshold_measurement);
+    if(!distance_prefix.empty())
+        default_mask_threshold("--distance", distance_threshold, threshold_measurement);
+    if(!streamlines.address.empty()){
+        default_mask_threshold("--streamlines", streamlines.seed, threshold_measurement);
+        streamlines.stop = streamlines.stop > 0 ? streamlines.stop : streamlines.seed;
+    }
 
     //set number of threads
     if(num_threads > 0){
@@ -114,23 +415,121 @@ int main(int argc, char **argv){
         cout << address <<endl;
     }
 
+    plan.window_size = window_size;
+    for(int s=0;s<scales.size();++s){
+        plan.window_size = s == 0 || scales[s] > plan.window_size ? scales[s] : plan.window_size;
+    }
+    plan.number_scales = scales.size() > 0 ? scales.size() : 1;
+    plan.threads = omp_get_max_threads();
+    if(!orientation_prefix.empty() || !streamlines.address.empty())
+        plan.add_output(4, 4, 0); // out of core, the orientation streams to the disk
+    if(!distance_prefix.empty())
+        plan.add_output(4, 4, 4); // every distance as float until the pass along z
+    if(!skeleton_address.empty())
+        plan.add_output(5, 5, 5); // a byte per voxel to thin & a float radius
+    if(!somata.prefix.empty())
+        plan.add_output(16, 16, 0); // the responses of 3 scales & the smoothed volume, rejected out of core
+    if(median != NULL)
+        plan.add_filter(median->radius_xy(), median->radius_z(), median->buffer_slices());
+    if(background != NULL)
+        plan.add_filter(background->radius_xy(), background->radius_z(), background->buffer_slices());
+    if(plan_only){
+        if(plan.read_filelist(address) == false)
+            exit(-1);
+        if(roi.whole() == false){
+            tomo_roi box = plan.read_box(roi);
+            plan.set_dimensions(box.size_x(), box.size_y(), box.size_z(), plan.bits_per_sample);
+        }
+        plan.choose();
+        plan.print(cout);
+        return 0;
+    }
+
     //loading & calculating
     tomo_super_tiff sample;
     if(mode == ORIGINAL_DATA){
-        sample = tomo_super_tiff(address);
-        sample.neuron_detection(window_size, threshold_measurement);
-        if(sample.size_original_data() >= TIFF_IMAGE_LARGE_SIZE) // the data is too large to care the -f & -s arguments, save anyway
+        sample = tomo_super_tiff(address, plan, roi);
+        sample.set_resuming(resuming);
+        sample.set_measure(measure, measure_constant);
+        sample.set_engine(engine);
+        if(median != NULL)
+            sample.add_slice_filter(median);
+        if(background != NULL)
+            sample.add_slice_filter(background);
+        sample.set_orientation(!orientation_prefix.empty() || !streamlines.address.empty());
+        if(!streamlines.address.empty() && sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){
+            cerr << "ERROR : streamlines need every slice in memory, try --roi or a larger --memory-budget" <<endl;
+            exit(-1);
+        }
+        if(resuming && !orientation_prefix.empty() && sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){
+            cerr << "ERROR : --resume cannot rebuild the orientation of the slices already done, run without it" <<endl;
+            exit(-1);
+        }
+        if(!somata.prefix.empty() && sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){
+            cerr << "ERROR : somata need every slice in memory, try --roi or a larger --memory-budget" <<endl;
+            exit(-1);
+        }
+        //what the sinks keep of the whole volume does not shrink out of core
+        const tomo_plan &chosen = sample.plan();
+        if((!distance_prefix.empty() || !skeleton_address.empty()) && chosen.mode == TOMO_PLAN_OUT_OF_CORE &&
+                chosen.bytes[TOMO_PLAN_OUT_OF_CORE] > chosen.memory_budget){
+            cerr << "ERROR : --distance & --skeleton keep every voxel, over the memory budget even out of core, try --roi" <<endl;
+            exit(-1);
+        }
+        tomo_component_sink *components = NULL;
+        if(!components_prefix.empty() && sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){
+            components = new tomo_component_sink(components_prefix.c_str(), components_threshold);
+            sample.add_slice_sink(components);
+        }
+        tomo_peak_sink *peak_sink = NULL;
+        if(!peaks.prefix.empty() && sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){
+            peak_sink = new tomo_peak_sink(peaks);
+            sample.add_slice_sink(peak_sink);
+        }
+        tomo_skeleton_sink *skeleton = NULL;
+        if(!skeleton_address.empty() && sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){
+            skeleton = new tomo_skeleton_sink(skeleton_address.c_str(), skeleton_threshold);
+            sample.add_slice_sink(skeleton);
+        }
+        tomo_distance_sink *distance = NULL;
+        if(!distance_prefix.empty() && sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){
+            distance = new tomo_distance_sink(distance_prefix.c_str(), distance_threshold);
+            sample.add_slice_sink(distance);
+        }
+        tomo_orientation_sink *orientation = NULL;
+        if(!orientation_prefix.empty() && sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){
+            orientation = new tomo_orientation_sink(orientation_prefix.c_str());
+            sample.add_slice_sink(orientation);
+        }
+        if(scales.size() > 0)
+            sample.neuron_detection_multiscale(scales, combine, threshold_measurement);
+        else
+            sample.neuron_detection(window_size, threshold_measurement);
+        if(sample.plan().mode == TOMO_PLAN_OUT_OF_CORE){ // the data is too large to care the -f & -s arguments, save anyway
+            delete components;
+            delete peak_sink;
+            delete skeleton;
+            delete distance;
+            delete orientation;
+            delete median;
+            delete background;
             return 0;
+        }
     }
     else if(mode == EIGEN_VALUE || mode == BUNDLE){
-        sample = tomo_super_tiff(address);
+        sample = tomo_super_tiff(address, plan);
         sample.load_eigen_values_separated(address_ev.c_str());
+        sample.set_measure(measure, measure_constant);
         sample.experimental_measurement(threshold_measurement);
     }
     else if(mode == EXPERIMENTAL_DATA){
         create_experimental_data(address);
         return 0;
     }
+    else if(mode == SYNTHETIC_DATA){
+        synthetic.generate(address);
+        return 0;
+    }
     else if(mode == MERGE){
         merge_measurements( address, folder_name.c_str() );
         return 0;
@@ -148,18 +547,59 @@ int main(int argc, char **argv){
         sample.save_eigen_values_ev(saving_ev_address.c_str());
     }
 
-    cout << "saving eigen value with rgb..." <<endl;
-    sample.save_eigen_values_rgb("eigen_value");
+    if(engine == TOMO_ENGINE_TENSOR){
+        cout << "saving eigen value with rgb..." <<endl;
+        sample.save_eigen_values_rgb("eigen_value");
 
-    cout << "saving eigen value merged with rgb..." <<endl;
-    sample.save_eigen_values_rgb_merge("eigen_value_merge");
+        cout << "saving eigen value merged with rgb..." <<endl;
+        sample.save_eigen_values_rgb_merge("eigen_value_merge");
 
-    cout << "saving eigen value separated..."<<endl;
-    sample.save_eigen_values_separated("eigen_value_separated");
+        cout << "saving eigen value separated..."<<endl;
+        sample.save_eigen_values_separated("eigen_value_separated");
+    }else{
+        cout << "the eigen values of the hessian are signed, not saved as images" <<endl;
+    }
 
     cout << "saving measurement..." <<endl;
     sample.save_measure("measurement");
     sample.save_measure_merge("measurement_merge");
 
+    if(!components_prefix.empty()){
+        cout << "saving components..." <<endl;
+        sample.save_components(components_prefix.c_str(), components_threshold);
+    }
+
+    if(!peaks.prefix.empty()){
+        cout << "saving peaks..." <<endl;
+        sample.save_peaks(peaks);
+    }
+
+    if(!skeleton_address.empty()){
+        cout << "saving skeleton..." <<endl;
+        sample.save_skeleton(skeleton_address.c_str(), skeleton_threshold);
+    }
+
+    if(!distance_prefix.empty()){
+        cout << "saving distance..." <<endl;
+        sample.save_distance(distance_prefix.c_str(), distance_threshold);
+    }
+
+    if(!orientation_prefix.empty() && mode == ORIGINAL_DATA){
+        cout << "saving orientation..." <<endl;
+        sample.save_orientation(orientation_prefix.c_str());
+    }
+
+    if(!streamlines.address.empty() && mode == ORIGINAL_DATA){
+        cout << "tracing streamlines..." <<endl;
+        sample.save_streamlines(streamlines);
+    }
+
+    if(!somata.prefix.empty() && mode == ORIGINAL_DATA){
+        cout << "detecting somata..." <<endl;
+        sample.save_somata(somata);
+    }
+
+    delete median;
+    delete background;
     return 0;
 }
@@ -4,7 +4,25 @@ CONFIG -= app_bundle
 CONFIG -= qt
 
 SOURCES += main.cpp \
-    tomo_tiff.cpp
+    tomo_tiff.cpp \
+    tomo_synthetic.cpp \
+    tomo_metrics.cpp \
+    tomo_perf.cpp \
+    tomo_trace.cpp \
+    tomo_alloc.cpp \
+    tomo_plan.cpp \
+    tomo_checkpoint.cpp \
+    tomo_gradient.cpp \
+    tomo_components.cpp \
+    tomo_peaks.cpp \
+    tomo_skeleton.cpp \
+    tomo_distance.cpp \
+    tomo_orientation.cpp \
+    tomo_streamlines.cpp \
+    tomo_hessian.cpp \
+    tomo_somata.cpp \
+    tomo_median.cpp \
+    tomo_background.cpp
 
 INCLUDEPATH += /usr/local/include/
 LIBS += -L/usr/local/lib/ -ltiff
@@ -12,8 +30,31 @@ INCLUDEPATH += progressbar/include/
 LIBS += -Lprogressbar/ -lprogressbar
 
 HEADERS += \
-    tomo_tiff.h
+    tomo_tiff.h \
+    tomo_synthetic.h \
+    tomo_metrics.h \
+    tomo_perf.h \
+    tomo_trace.h \
+    tomo_alloc.h \
+    tomo_plan.h \
+    tomo_checkpoint.h \
+    tomo_measure.h \
+    tomo_gradient.h \
+    tomo_halo.h \
+    tomo_components.h \
+    tomo_peaks.h \
+    tomo_skeleton.h \
+    tomo_distance.h \
+    tomo_orientation.h \
+    tomo_streamlines.h \
+    tomo_hessian.h \
+    tomo_somata.h \
+    tomo_median.h \
+    tomo_background.h
 
 LIBS += -fopenmp
 
+# counts allocations per stage
+#DEFINES += NDIT_ALLOC_TRACKING
+
 QMAKE_CXX = g++-5
@@ -0,0 +1,80 @@
+#include "tomo_alloc.h"
+#include <atomic>
+#include <cstddef>
+#include <cerrno>
+
+using namespace std;
+
+static atomic<uint64_t> alloc_allocations(0);
+static atomic<uint64_t> alloc_bytes(0);
+
+#ifdef NDIT_ALLOC_TRACKING
+
+static inline void alloc_count(size_t size){
+    alloc_allocations.fetch_add(1, memory_order_relaxed);
+    alloc_bytes.fetch_add(size, memory_order_relaxed);
+    return;
+}
+
+//glibc entry points, nothing here may allocate
+extern "C"{
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t number, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size){
+    alloc_count(size);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t number, size_t size){
+    alloc_count(number * size);
+    return __libc_calloc(number, size);
+}
+
+void* realloc(void* pointer, size_t size){
+    alloc_count(size);
+    return __libc_realloc(pointer, size);
+}
+
+void* memalign(size_t alignment, size_t size){
+    alloc_count(size);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size){
+    alloc_count(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size){
+    if(alignment % sizeof(void*) != 0 || (alignment & (alignment-1)) != 0)
+        return EINVAL;
+    alloc_count(size);
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer == NULL ? ENOMEM : 0;
+}
+
+}
+
+bool tomo_alloc::enabled(void){
+    return true;
+}
+
+#else
+
+bool tomo_alloc::enabled(void){
+    return false;
+}
+
+#endif // NDIT_ALLOC_TRACKING
+
+uint64_t tomo_alloc::allocations(void){
+    return alloc_allocations.load(memory_order_relaxed);
+}
+
+uint64_t tomo_alloc::bytes(void){
+    return alloc_bytes.load(memory_order_relaxed);
+}
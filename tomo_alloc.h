@@ -0,0 +1,21 @@
+#ifndef TOMO_ALLOC
+#define TOMO_ALLOC
+
+#include <stdint.h>
+
+// allocation counting, opt-in at build time (make ALLOC_TRACKING=1 defines NDIT_ALLOC_TRACKING)
+//      malloc, calloc, realloc and the aligned variants are interposed over glibc, operator new goes through malloc,
+//      so gsl and the standard library are counted too. without the define every count stays 0
+
+class tomo_alloc{
+
+    public:
+
+    static bool enabled(void);
+
+    // since the start of the process, over every thread
+    static uint64_t allocations(void);
+    static uint64_t bytes(void);
+};
+
+#endif // TOMO_ALLOC
@@ -0,0 +1,244 @@
+#include "tomo_background.h"
+#include <cstring>
+
+// columns of a slice run through the y pass at once
+#define TOMO_BACKGROUND_CHUNK 256
+
+static inline int clamp_index(int i, int size){
+    return i < 0 ? 0 : (i >= size ? size-1 : i);
+}
+
+template<bool minimum>
+static inline float extreme(float a, float b){
+    return minimum ? (a < b ? a : b) : (a > b ? a : b);
+}
+
+// van herk / gil-werman on a line, the window [i - radius, i + radius] of every i
+//      blocks of 2 radius + 1, g from the start of the block, h to its end, then one comparison of both
+//      g & h : size + 2 radius
+template<bool minimum>
+static void van_herk_line(const float *line, int size, int radius, float *out, float *g, float *h){
+
+    int block = 2*radius + 1;
+    int padded = size + 2*radius;
+    for(int i=0;i<padded;++i){
+        float value = line[clamp_index(i-radius, size)];
+        g[i] = i % block == 0 ? value : extreme<minimum>(g[i-1], value);
+    }
+    for(int i=padded-1;i>=0;--i){
+        float value = line[clamp_index(i-radius, size)];
+        h[i] = i % block == block-1 || i == padded-1 ? value : extreme<minimum>(h[i+1], value);
+    }
+    for(int i=0;i<size;++i){
+        out[i] = extreme<minimum>(h[i], g[i+block-1]);
+    }
+
+    return;
+}
+
+// the same on a sequence of rows, width values of every row at once
+//      g & h : (size + 2 radius) * width
+template<bool minimum>
+static void van_herk_rows(const float **rows, int size, int radius, int width, float **out, float *g, float *h){
+
+    int block = 2*radius + 1;
+    int padded = size + 2*radius;
+    for(int i=0;i<padded;++i){
+        const float *value = rows[clamp_index(i-radius, size)];
+        float *gi = g + (size_t)i * width;
+        if(i % block == 0){
+            memcpy(gi, value, width * sizeof(float));
+            continue;
+        }
+        const float *previous = gi - width;
+        for(int x=0;x<width;++x){
+            gi[x] = extreme<minimum>(previous[x], value[x]);
+        }
+    }
+    for(int i=padded-1;i>=0;--i){
+        const float *value = rows[clamp_index(i-radius, size)];
+        float *hi = h + (size_t)i * width;
+        if(i % block == block-1 || i == padded-1){
+            memcpy(hi, value, width * sizeof(float));
+            continue;
+        }
+        const float *next = hi + width;
+        for(int x=0;x<width;++x){
+            hi[x] = extreme<minimum>(next[x], value[x]);
+        }
+    }
+    for(int i=0;i<size;++i){
+        const float *hi = h + (size_t)i * width;
+        const float *gi = g + (size_t)(i+block-1) * width;
+        for(int x=0;x<width;++x){
+            out[i][x] = extreme<minimum>(hi[x], gi[x]);
+        }
+    }
+
+    return;
+}
+
+template<bool minimum>
+static void morph_xy_(vector< vector<float> > &slice, int radius, vector< vector<float> > &morphed){
+
+    int size_y = slice.size();
+    int size_x = size_y > 0 ? slice[0].size() : 0;
+    vector< vector<float> > along_x(size_y);
+    morphed.resize(size_y);
+    if(size_x == 0)
+        return;
+
+    #pragma omp parallel
+    {
+        vector<float> g(size_x + 2*radius), h(size_x + 2*radius);
+        #pragma omp for
+        for(int y=0;y<size_y;++y){
+            along_x[y].resize(size_x);
+            morphed[y].resize(size_x);
+            van_herk_line<minimum>(&slice[y][0], size_x, radius, &along_x[y][0], &g[0], &h[0]);
+        }
+
+        vector<float> g_rows((size_t)(size_y + 2*radius) * TOMO_BACKGROUND_CHUNK);
+        vector<float> h_rows((size_t)(size_y + 2*radius) * TOMO_BACKGROUND_CHUNK);
+        vector<const float*> rows(size_y);
+        vector<float*> out(size_y);
+        #pragma omp for schedule(dynamic)
+        for(int x0=0;x0<size_x;x0+=TOMO_BACKGROUND_CHUNK){
+            int width = size_x - x0 < TOMO_BACKGROUND_CHUNK ? size_x - x0 : TOMO_BACKGROUND_CHUNK;
+            for(int y=0;y<size_y;++y){
+                rows[y] = &along_x[y][x0];
+                out[y] = &morphed[y][x0];
+            }
+            van_herk_rows<minimum>(&rows[0], size_y, radius, width, &out[0], &g_rows[0], &h_rows[0]);
+        }
+    }
+
+    return;
+}
+
+void tomo_background_filter::morph_xy(vector< vector<float> > &slice, int radius, bool minimum,
+                                      vector< vector<float> > &morphed){
+    if(minimum)
+        morph_xy_<true>(slice, radius, morphed);
+    else
+        morph_xy_<false>(slice, radius, morphed);
+    return;
+}
+
+tomo_background_filter::tomo_background_filter(int radius, int radius_z){
+    this->radius_ = radius;
+    this->radius_z_ = radius_z;
+}
+
+tomo_background_filter* tomo_background_filter::parse(const char *spec){
+
+    string text(spec);
+    size_t colon = text.find(':');
+    int radius = atoi(text.substr(0, colon).c_str());
+    int radius_z = 0;
+    if(colon != string::npos){
+        string item = text.substr(colon+1);
+        if(item.compare(0, 2, "z=") != 0){
+            cerr << "ERROR : " << item << " is not z=radius" <<endl;
+            return NULL;
+        }
+        radius_z = atoi(item.c_str() + 2);
+    }
+    if(radius < 1 || radius_z < 0){
+        cerr << "ERROR : background radius " << radius << " & z radius " << radius_z << " not handled!" <<endl;
+        return NULL;
+    }
+
+    return new tomo_background_filter(radius, radius_z);
+}
+
+string tomo_background_filter::spec() const{
+    stringstream text;
+    text << "background " << this->radius_ << ":z=" << this->radius_z_;
+    return text.str();
+}
+
+void tomo_background_filter::release(){
+    vector< vector< vector<float> > >().swap(this->ring_);
+    vector<int>().swap(this->ring_z_);
+    return;
+}
+
+void tomo_background_filter::filter(int index_z, vector< vector< vector<float> >* > &window, vector< vector<float> > &filtered){
+
+    int radius_z = this->radius_z_;
+    vector< vector<float> > &slice = *window[2*radius_z];
+    int size_y = slice.size();
+    int size_x = size_y > 0 ? slice[0].size() : 0;
+
+    //erosion
+    vector< vector<float> > eroded;
+    if(radius_z == 0){
+        morph_xy(slice, this->radius_, true, eroded);
+    }else{
+        //the slices already eroded for the slices before are in the ring, a pass starts it over
+        int size = window.size();
+        if(index_z == 0 || this->ring_z_.size() != size){
+            this->ring_.assign(size, vector< vector<float> >());
+            this->ring_z_.assign(size, -1);
+        }
+        vector< vector< vector<float> >* > eroded_xy(size);
+        for(int t=0;t<size;++t){
+            //the borders repeat a slice, past the last one it's the same as the one before
+            if(t > 0 && window[t] == window[t-1]){
+                eroded_xy[t] = eroded_xy[t-1];
+                continue;
+            }
+            int k = index_z - 2*radius_z + t;
+            k = k < 0 ? 0 : k;
+            int slot = k % size;
+            if(this->ring_z_[slot] != k){
+                morph_xy(*window[t], this->radius_, true, this->ring_[slot]);
+                this->ring_z_[slot] = k;
+            }
+            eroded_xy[t] = &this->ring_[slot];
+        }
+
+        //along z at the 2 radius_z + 1 slices around, then their maximum : the dilation along z of the slice
+        eroded.assign(size_y, vector<float>(size_x, 0.0));
+        #pragma omp parallel
+        {
+            int size = window.size();
+            vector<float> g((size_t)(size + 2*radius_z) * size_x), h((size_t)(size + 2*radius_z) * size_x);
+            vector< vector<float> > along_z(size, vector<float>(size_x));
+            vector<const float*> rows(size);
+            vector<float*> out(size);
+            for(int t=0;t<size;++t){
+                out[t] = &along_z[t][0];
+            }
+            #pragma omp for
+            for(int y=0;y<size_y;++y){
+                for(int t=0;t<size;++t){
+                    rows[t] = &(*eroded_xy[t])[y][0];
+                }
+                van_herk_rows<true>(&rows[0], size, radius_z, size_x, &out[0], &g[0], &h[0]);
+                float *dilated = &eroded[y][0];
+                memcpy(dilated, out[radius_z], size_x * sizeof(float));
+                for(int t=radius_z+1;t<=3*radius_z;++t){
+                    for(int x=0;x<size_x;++x){
+                        dilated[x] = extreme<false>(dilated[x], out[t][x]);
+                    }
+                }
+            }
+        }
+    }
+
+    //dilation, the opening is the background
+    vector< vector<float> > opened;
+    morph_xy(eroded, this->radius_, false, opened);
+    filtered.resize(size_y);
+    #pragma omp parallel for
+    for(int y=0;y<size_y;++y){
+        filtered[y].resize(size_x);
+        for(int x=0;x<size_x;++x){
+            filtered[y][x] = slice[y][x] - opened[y][x];
+        }
+    }
+
+    return;
+}
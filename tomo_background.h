@@ -0,0 +1,45 @@
+#ifndef TOMO_BACKGROUND
+#define TOMO_BACKGROUND
+
+#include <vector>
+#include "tomo_tiff.h"
+
+using namespace std;
+
+// background subtraction : the gray scale minus its opening, the erosion then the dilation by a flat box
+//      (2 radius + 1) wide in x & y and (2 radius_z + 1) deep in z, the borders repeated
+//      every erosion & dilation is van Herk / Gil-Werman along one axis, 3 comparisons per voxel whatever
+//      the radius, the y & z passes on whole rows so they vectorize
+//      radius_z 0, the default, takes every slice alone, the illumination of each slice is removed on its own
+//      radius_z > 0 reads 4 radius_z + 1 slices, their erosions in x & y are kept in a ring between the calls
+//      so every slice is eroded once
+
+class tomo_background_filter : public tomo_slice_filter{
+
+    int radius_;
+    int radius_z_;
+
+    vector< vector< vector<float> > > ring_;    // x & y erosions of the slices of the window, slice z in slot z % size
+    vector<int> ring_z_;                        // the slice in every slot, -1 when empty
+
+    public:
+
+    tomo_background_filter(int radius, int radius_z = 0);
+
+    // spec : radius[:z=radius_z], e.g. 30 or 30:z=2
+    static tomo_background_filter* parse(const char* spec);
+
+    // the erosion & the dilation both reach radius_z slices away
+    int radius_z() const{return 2*this->radius_z_;}
+    int radius_xy() const{return 2*this->radius_;}
+    // the ring, then the erosion along x, the eroded & the opened slice
+    int buffer_slices() const{return (this->radius_z_ > 0 ? 4*this->radius_z_ + 1 : 0) + 3;}
+    string spec() const;
+    void filter(int index_z, vector< vector< vector<float> >* >& window, vector< vector<float> >& filtered);
+    void release();
+
+    // erosion (minimum) or dilation of a slice in x & y, the rows in parallel
+    static void morph_xy(vector< vector<float> >& slice, int radius, bool minimum, vector< vector<float> >& morphed);
+};
+
+#endif // TOMO_BACKGROUND
@@ -0,0 +1,247 @@
+#include "tomo_checkpoint.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+static bool sync_file(const char *address){
+    int fd = ::open(address, O_RDONLY);
+    if(fd < 0)
+        return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+// fnv-1a, enough to tell two inputs apart
+static unsigned long long hash_input(const string &input){
+    unsigned long long hash = 14695981039346656037ULL;
+    for(int i=0;i<input.size();++i){
+        hash ^= (unsigned char)input[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+tomo_checkpoint::tomo_checkpoint(){
+    this->manifest_ = NULL;
+    this->pending_ = 0;
+    this->normalized_ = false;
+    this->final_maximum_ = 0.0;
+}
+
+tomo_checkpoint::~tomo_checkpoint(){
+    this->close();
+}
+
+bool tomo_checkpoint::open(const char *directory, int size_x, int size_y, int size_z,
+                           const tomo_roi &box, const tomo_roi &roi, const string &input,
+                           int window_size, float standard_deviation, float threshold,
+                           int measure, float measure_constant, int engine, const string &filters, bool resuming){
+
+    this->close();
+    this->directory_ = directory;
+    this->maximums_.assign(size_z, 0.0);
+    this->done_.assign(size_z, 0);
+    this->renormalized_.assign(size_z, 0);
+    this->normalized_ = false;
+    this->final_maximum_ = 0.0;
+
+    char header[512] = {0};
+    sprintf(header, "xyz-size %d %d %d\nbox %d %d %d\nroi %d %d %d\ninput %016llx\n"
+                    "window_size %d\nstandard_deviation %.8f\nthreshold %.8g\nmeasure %d %.8g\nengine %d\n",
+            size_x, size_y, size_z, box.x0, box.y0, box.z0, box.x0 + roi.x0, box.y0 + roi.y0, box.z0 + roi.z0,
+            hash_input(input), window_size, standard_deviation, threshold, measure, measure_constant, engine);
+    this->header_ = string(header) + "filters " + (filters.empty() ? "none" : filters) + "\n";
+
+    mkdir(directory, 0755);
+    string address = this->directory_ + "/manifest.txt";
+
+    if(resuming && this->read_(address)){
+        cout << "resuming : " << this->size_done() << " of " << size_z << " slices done" <<endl;
+        this->manifest_ = fopen(address.c_str(), "a");
+    }else{
+        if(resuming)
+            cout << "nothing to resume in " << address << ", starting over" <<endl;
+        this->maximums_.assign(size_z, 0.0);
+        this->done_.assign(size_z, 0);
+        this->renormalized_.assign(size_z, 0);
+        this->normalized_ = false;
+        this->manifest_ = fopen(address.c_str(), "w");
+        if(this->manifest_ != NULL)
+            fputs(this->header_.c_str(), this->manifest_);
+    }
+    if(this->manifest_ == NULL){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+    this->sync();
+
+    return true;
+}
+
+bool tomo_checkpoint::read_(const string &address){
+
+    FILE *in_manifest = fopen(address.c_str(), "r");
+    if(in_manifest == NULL)
+        return false;
+
+    //the parameters have to be the same, the slices are useless otherwise
+    string header;
+    char line[256] = {0};
+    int size_header = count(this->header_.begin(), this->header_.end(), '\n');
+    for(int i=0;i<size_header && fgets(line, sizeof(line), in_manifest) != NULL;++i){
+        header += line;
+    }
+    if(header != this->header_){
+        cout << "the parameters of " << address << " differ" <<endl;
+        fclose(in_manifest);
+        return false;
+    }
+
+    //a torn last line is ignored, the slice is simply done again
+    while(fgets(line, sizeof(line), in_manifest) != NULL){
+        if(strchr(line, '\n') == NULL)
+            break;
+        int index_z = -1;
+        float value = 0.0;
+        if(sscanf(line, "slice %d %f", &index_z, &value) == 2 && index_z >= 0 && index_z < this->done_.size()){
+            this->done_[index_z] = 1;
+            this->maximums_[index_z] = value;
+        }else if(sscanf(line, "normalized %f", &value) == 1){
+            this->normalized_ = true;
+            this->final_maximum_ = value;
+        }else if(sscanf(line, "renormalized %d", &index_z) == 1 && index_z >= 0 && index_z < this->renormalized_.size()){
+            this->renormalized_[index_z] = 1;
+        }
+    }
+    fclose(in_manifest);
+
+    return true;
+}
+
+void tomo_checkpoint::append_(const char *line){
+
+    if(this->manifest_ == NULL)
+        return;
+    fputs(line, this->manifest_);
+    if(++this->pending_ >= TOMO_CHECKPOINT_INTERVAL)
+        this->sync();
+
+    return;
+}
+
+void tomo_checkpoint::sync(void){
+
+    if(this->manifest_ == NULL)
+        return;
+    fflush(this->manifest_);
+    fsync(fileno(this->manifest_));
+    //the renamed slices live in the directory entries
+    sync_file(this->directory_.c_str());
+    this->pending_ = 0;
+
+    return;
+}
+
+void tomo_checkpoint::close(void){
+
+    if(this->manifest_ == NULL)
+        return;
+    this->sync();
+    fclose(this->manifest_);
+    this->manifest_ = NULL;
+
+    return;
+}
+
+int tomo_checkpoint::size_done(void){
+    int size = 0;
+    for(int i=0;i<this->done_.size();++i){
+        size += this->done_[i];
+    }
+    return size;
+}
+
+void tomo_checkpoint::complete(int index_z, float maximum){
+
+    this->done_[index_z] = 1;
+    this->maximums_[index_z] = maximum;
+
+    char line[64] = {0};
+    sprintf(line, "slice %d %.9g\n", index_z, maximum);
+    this->append_(line);
+
+    return;
+}
+
+void tomo_checkpoint::normalize(float final_maximum){
+
+    this->normalized_ = true;
+    this->final_maximum_ = final_maximum;
+
+    char line[64] = {0};
+    sprintf(line, "normalized %.9g\n", final_maximum);
+    this->append_(line);
+    this->sync();
+
+    return;
+}
+
+void tomo_checkpoint::complete_renormalized(int index_z){
+
+    this->renormalized_[index_z] = 1;
+
+    char line[64] = {0};
+    sprintf(line, "renormalized %d\n", index_z);
+    this->append_(line);
+
+    return;
+}
+
+bool tomo_checkpoint::save_renormalized(tomo_tiff &tiff, const char *address, int index_z){
+
+    string address_renormalized = string(address) + ".renormalized";
+    if(tomo_checkpoint::save_tiff(tiff, address_renormalized.c_str()) == false)
+        return false;
+    this->complete_renormalized(index_z);
+    this->sync();
+    if(rename(address_renormalized.c_str(), address) != 0){
+        cerr << "ERROR : cannot rename " << address_renormalized <<endl;
+        return false;
+    }
+    return true;
+}
+
+bool tomo_checkpoint::recover_renormalized(const char *address, int index_z){
+
+    string address_renormalized = string(address) + ".renormalized";
+    if(access(address_renormalized.c_str(), F_OK) != 0)
+        return true;
+    //recorded, only the rename is missing, otherwise address is still the slice to renormalize
+    if(this->renormalized(index_z) == false){
+        remove(address_renormalized.c_str());
+        return true;
+    }
+    if(rename(address_renormalized.c_str(), address) != 0){
+        cerr << "ERROR : cannot rename " << address_renormalized <<endl;
+        return false;
+    }
+    sync_file(this->directory_.c_str());
+    return true;
+}
+
+bool tomo_checkpoint::save_tiff(tomo_tiff &tiff, const char *address){
+
+    string address_tmp = string(address) + ".tmp";
+    tiff.save(address_tmp.c_str());
+    if(sync_file(address_tmp.c_str()) == false){
+        cerr << "ERROR : cannot sync " << address_tmp <<endl;
+        return false;
+    }
+    if(rename(address_tmp.c_str(), address) != 0){
+        cerr << "ERROR : cannot rename " << address_tmp <<endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef TOMO_CHECKPOINT
+#define TOMO_CHECKPOINT
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "tomo_tiff.h"
+
+#define TOMO_CHECKPOINT_INTERVAL 16 // slices between two fsyncs of the manifest
+
+using namespace std;
+
+// checkpoint manifest of the out of core path, <directory>/manifest.txt
+//      xyz-size, the corners of the box read & of the roi in the volume, a hash of the slices read,
+//      window_size, standard_deviation, threshold, measure, engine & filters, then one line per event :
+//          slice z maximum     measurement/z.tif is on the disk, normalized by its own maximum
+//          normalized maximum  every slice is done, the renormalization started
+//          renormalized z      measurement/z.tif is normalized by the final maximum
+//      slices are written aside and renamed, a line is only added once its slice is synced
+//      a renormalized slice is written to z.tif.renormalized, its line synced, then renamed over z.tif, so
+//      a crash never leaves a slice scaled twice : the rename is finished or the slice done again on resume
+
+class tomo_checkpoint{
+
+    string directory_;
+    string header_;
+    FILE *manifest_;
+    int pending_;
+
+    vector<float> maximums_;
+    vector<char> done_;
+    vector<char> renormalized_;
+    bool normalized_;
+    float final_maximum_;
+
+    bool read_(const string& address);
+    void append_(const char* line);
+
+    public:
+
+    tomo_checkpoint();
+    ~tomo_checkpoint();
+
+    // a new manifest, or the one already in directory when resuming and the parameters are the same
+    //      box : the part of the volume read, roi relative to it, input : what identifies the slices read
+    bool open(const char* directory, int size_x, int size_y, int size_z,
+              const tomo_roi& box, const tomo_roi& roi, const string& input,
+              int window_size, float standard_deviation, float threshold,
+              int measure, float measure_constant, int engine, const string& filters, bool resuming);
+    void sync(void);
+    void close(void);
+
+    bool done(int index_z){ return this->done_[index_z] != 0; }
+    float maximum(int index_z){ return this->maximums_[index_z]; }
+    bool normalized(void){ return this->normalized_; }
+    float final_maximum(void){ return this->final_maximum_; }
+    bool renormalized(int index_z){ return this->renormalized_[index_z] != 0; }
+    int size_done(void);
+
+    void complete(int index_z, float maximum);
+    void normalize(float final_maximum);
+    void complete_renormalized(int index_z);
+
+    // the renormalized slice index_z saved to address, the step above
+    bool save_renormalized(tomo_tiff& tiff, const char* address, int index_z);
+    // after open, finishes or drops what a crash left of the renormalization of the slice index_z
+    bool recover_renormalized(const char* address, int index_z);
+
+    // written to address.tmp, synced, then renamed over address
+    static bool save_tiff(tomo_tiff& tiff, const char* address);
+};
+
+#endif // TOMO_CHECKPOINT
@@ -0,0 +1,389 @@
+#include "tomo_components.h"
+#include "tomo_metrics.h"
+#include "tomo_trace.h"
+#include <climits>
+#include <unordered_map>
+
+#define TOMO_COMPONENTS_BACKGROUND 0xffffffff
+
+tomo_component::tomo_component(){
+    this->voxels = 0;
+    this->x_min = this->y_min = this->z_min = INT_MAX;
+    this->x_max = this->y_max = this->z_max = -1;
+    this->sum_x = this->sum_y = this->sum_z = 0.0;
+    this->sum_measure = 0.0;
+}
+
+void tomo_component::add(int x, int y, int z, float measure){
+    ++this->voxels;
+    this->x_min = x < this->x_min ? x : this->x_min;
+    this->y_min = y < this->y_min ? y : this->y_min;
+    this->z_min = z < this->z_min ? z : this->z_min;
+    this->x_max = x > this->x_max ? x : this->x_max;
+    this->y_max = y > this->y_max ? y : this->y_max;
+    this->z_max = z > this->z_max ? z : this->z_max;
+    this->sum_x += x;
+    this->sum_y += y;
+    this->sum_z += z;
+    this->sum_measure += measure;
+}
+
+void tomo_component::merge(const tomo_component &b){
+    this->voxels += b.voxels;
+    this->x_min = b.x_min < this->x_min ? b.x_min : this->x_min;
+    this->y_min = b.y_min < this->y_min ? b.y_min : this->y_min;
+    this->z_min = b.z_min < this->z_min ? b.z_min : this->z_min;
+    this->x_max = b.x_max > this->x_max ? b.x_max : this->x_max;
+    this->y_max = b.y_max > this->y_max ? b.y_max : this->y_max;
+    this->z_max = b.z_max > this->z_max ? b.z_max : this->z_max;
+    this->sum_x += b.sum_x;
+    this->sum_y += b.sum_y;
+    this->sum_z += b.sum_z;
+    this->sum_measure += b.sum_measure;
+}
+
+// union-find over voxel indexes, the root is the first voxel of the component
+static uint32_t find_root(vector<uint32_t> &parent, uint32_t i){
+    while(parent[i] != i){
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// without path compression, safe while other threads read
+static uint32_t find_root_read_only(const vector<uint32_t> &parent, uint32_t i){
+    while(parent[i] != i){
+        i = parent[i];
+    }
+    return i;
+}
+
+static void unite_roots(vector<uint32_t> &parent, uint32_t a, uint32_t b){
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if(a < b)
+        parent[b] = a;
+    else if(b < a)
+        parent[a] = b;
+}
+
+void tomo_components::label(vector< vector< vector<float> > > &measure, float scale, float threshold,
+                            vector<uint32_t> &labels, vector<tomo_component> &components){
+
+    int size_z = measure.size();
+    int size_y = size_z > 0 ? measure[0].size() : 0;
+    int size_x = size_y > 0 ? measure[0][0].size() : 0;
+    uint64_t size_slice = (uint64_t)size_x * size_y;
+    uint64_t size_volume = size_slice * size_z;
+    if(size_volume >= TOMO_COMPONENTS_BACKGROUND){
+        cerr << "ERROR : " << size_volume << " voxels are too many to be labelled in memory" <<endl;
+        exit(-1);
+    }
+
+    vector<uint32_t> parent(size_volume);
+    int number_blocks = (size_z + TOMO_COMPONENTS_BLOCK - 1) / TOMO_COMPONENTS_BLOCK;
+
+    //every block on its own, the neighbours met before a voxel : 4 in its slice & 9 in the previous one
+    #pragma omp parallel for schedule(dynamic)
+    for(int b=0;b<number_blocks;++b){
+        int z_begin = b * TOMO_COMPONENTS_BLOCK;
+        int z_end = z_begin + TOMO_COMPONENTS_BLOCK < size_z ? z_begin + TOMO_COMPONENTS_BLOCK : size_z;
+        for(int z=z_begin;z<z_end;++z){
+            for(int y=0;y<size_y;++y){
+                for(int x=0;x<size_x;++x){
+                    uint32_t i = (z * size_slice) + (uint64_t)y * size_x + x;
+                    if(measure[z][y][x] * scale < threshold){
+                        parent[i] = TOMO_COMPONENTS_BACKGROUND;
+                        continue;
+                    }
+                    parent[i] = i;
+                    for(int dz=-1;dz<=0;++dz){
+                        if(z+dz < z_begin)
+                            continue;
+                        for(int dy=-1;dy<=(dz < 0 ? 1 : 0);++dy){
+                            for(int dx=-1;dx<=1;++dx){
+                                if(dz == 0 && dy == 0 && dx >= 0)
+                                    break;
+                                int nx = x+dx, ny = y+dy;
+                                if(nx < 0 || nx >= size_x || ny < 0 || ny >= size_y)
+                                    continue;
+                                uint32_t n = ((z+dz) * size_slice) + (uint64_t)ny * size_x + nx;
+                                if(parent[n] != TOMO_COMPONENTS_BACKGROUND)
+                                    unite_roots(parent, i, n);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    //merge across the borders of the blocks
+    for(int b=1;b<number_blocks;++b){
+        int z = b * TOMO_COMPONENTS_BLOCK;
+        for(int y=0;y<size_y;++y){
+            for(int x=0;x<size_x;++x){
+                uint32_t i = (z * size_slice) + (uint64_t)y * size_x + x;
+                if(parent[i] == TOMO_COMPONENTS_BACKGROUND)
+                    continue;
+                for(int dy=-1;dy<=1;++dy){
+                    for(int dx=-1;dx<=1;++dx){
+                        int nx = x+dx, ny = y+dy;
+                        if(nx < 0 || nx >= size_x || ny < 0 || ny >= size_y)
+                            continue;
+                        uint32_t n = ((z-1) * size_slice) + (uint64_t)ny * size_x + nx;
+                        if(parent[n] != TOMO_COMPONENTS_BACKGROUND)
+                            unite_roots(parent, i, n);
+                    }
+                }
+            }
+        }
+    }
+
+    //roots, then numbered in the order they are met, the parent of a root becomes its label
+    labels.resize(size_volume);
+    #pragma omp parallel for
+    for(int z=0;z<size_z;++z){
+        for(uint64_t i=z*size_slice;i<(z+1)*size_slice;++i){
+            labels[i] = parent[i] == TOMO_COMPONENTS_BACKGROUND ? TOMO_COMPONENTS_BACKGROUND : find_root_read_only(parent, i);
+        }
+    }
+    uint32_t number_components = 0;
+    for(uint64_t i=0;i<size_volume;++i){
+        if(labels[i] == i)
+            parent[i] = ++number_components;
+    }
+    #pragma omp parallel for
+    for(int z=0;z<size_z;++z){
+        for(uint64_t i=z*size_slice;i<(z+1)*size_slice;++i){
+            labels[i] = labels[i] == TOMO_COMPONENTS_BACKGROUND ? 0 : parent[labels[i]];
+        }
+    }
+
+    //statistics per block, merged in order so the sums don't depend on the threads
+    vector< unordered_map<uint32_t, tomo_component> > blocks(number_blocks);
+    #pragma omp parallel for schedule(dynamic)
+    for(int b=0;b<number_blocks;++b){
+        int z_begin = b * TOMO_COMPONENTS_BLOCK;
+        int z_end = z_begin + TOMO_COMPONENTS_BLOCK < size_z ? z_begin + TOMO_COMPONENTS_BLOCK : size_z;
+        for(int z=z_begin;z<z_end;++z){
+            for(int y=0;y<size_y;++y){
+                for(int x=0;x<size_x;++x){
+                    uint32_t label = labels[(z * size_slice) + (uint64_t)y * size_x + x];
+                    if(label > 0)
+                        blocks[b][label].add(x, y, z, measure[z][y][x] * scale);
+                }
+            }
+        }
+    }
+    components.assign(number_components, tomo_component());
+    for(int b=0;b<number_blocks;++b){
+        for(unordered_map<uint32_t, tomo_component>::iterator it=blocks[b].begin();it!=blocks[b].end();++it){
+            components[it->first - 1].merge(it->second);
+        }
+    }
+
+    return;
+}
+
+bool tomo_components::save_raw(const char *address, vector<uint32_t> &labels){
+
+    FILE *out_raw = fopen(address, "wb");
+    if(out_raw == NULL){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+    size_t written = labels.size() > 0 ? fwrite(&labels[0], sizeof(uint32_t), labels.size(), out_raw) : 0;
+    fclose(out_raw);
+    tomo_metrics::add_bytes_written( written * sizeof(uint32_t) );
+    if(written != labels.size()){
+        cerr << "ERROR : cannot write " << address <<endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool tomo_components::save_table(const char *address, vector<tomo_component> &components,
+                                 int size_x, int size_y, int size_z){
+
+    fstream out_table(address, fstream::out);
+    if(out_table.is_open() == false){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+
+    out_table << "# xyz-size " << size_x << " " << size_y << " " << size_z <<endl;
+    out_table << "label,voxels,x_min,y_min,z_min,x_max,y_max,z_max,centroid_x,centroid_y,centroid_z,mean_measure" <<endl;
+    for(int c=0;c<components.size();++c){
+        tomo_component &component = components[c];
+        double voxels = (double)component.voxels;
+        out_table << c+1 << "," << component.voxels << ","
+                  << component.x_min << "," << component.y_min << "," << component.z_min << ","
+                  << component.x_max << "," << component.y_max << "," << component.z_max << ","
+                  << fixed << setprecision(3)
+                  << component.sum_x / voxels << "," << component.sum_y / voxels << "," << component.sum_z / voxels << ","
+                  << scientific << setprecision(8) << component.sum_measure / voxels <<endl;
+        out_table.unsetf(ios::floatfield);
+    }
+    tomo_metrics::add_bytes_written( out_table.tellp() );
+    out_table.close();
+
+    return true;
+}
+
+tomo_component_sink::tomo_component_sink(const char *prefix, float threshold){
+
+    // keep the absolute address, the working directory keeps changing
+    this->prefix_ = absolute_address(prefix);
+    this->threshold_ = threshold;
+    this->size_x_ = 0;
+    this->size_y_ = 0;
+    this->size_z_ = 0;
+    this->parent_.assign(1, 0);     // labels start from 1
+    this->components_.assign(1, tomo_component());
+
+    string address = this->prefix_ + ".raw.tmp";
+    this->raw_ = fopen(address.c_str(), "w+b");
+    if(this->raw_ == NULL){
+        cerr << "ERROR : cannot open " << address <<endl;
+        exit(-1);
+    }
+}
+
+tomo_component_sink::~tomo_component_sink(){
+    if(this->raw_ != NULL)
+        fclose(this->raw_);
+}
+
+uint32_t tomo_component_sink::find_(uint32_t label){
+    while(this->parent_[label] != label){
+        this->parent_[label] = this->parent_[ this->parent_[label] ];
+        label = this->parent_[label];
+    }
+    return label;
+}
+
+void tomo_component_sink::unite_(uint32_t a, uint32_t b){
+    a = this->find_(a);
+    b = this->find_(b);
+    if(a < b)
+        this->parent_[b] = a;
+    else if(b < a)
+        this->parent_[a] = b;
+}
+
+void tomo_component_sink::measure_slice(int index_z, vector< vector<float> > &slice){
+
+    tomo_trace_scope trace("components_slice", index_z);
+
+    if(index_z != this->size_z_){
+        cerr << "ERROR : components expect slice " << this->size_z_ << ", got " << index_z <<endl;
+        exit(-1);
+    }
+    if(index_z == 0){
+        this->size_y_ = slice.size();
+        this->size_x_ = slice.size() > 0 ? slice[0].size() : 0;
+    }
+
+    //provisional labels, the neighbours met before a voxel : 4 in its slice & 9 in the previous one
+    vector<uint32_t> current((size_t)this->size_x_ * this->size_y_, 0);
+    for(int y=0;y<this->size_y_;++y){
+        for(int x=0;x<this->size_x_;++x){
+            if(slice[y][x] < this->threshold_)
+                continue;
+            uint32_t label = 0;
+            for(int dz=-1;dz<=0;++dz){
+                vector<uint32_t> &labels = dz < 0 ? this->previous_ : current;
+                if(labels.size() == 0)
+                    continue;
+                for(int dy=-1;dy<=(dz < 0 ? 1 : 0);++dy){
+                    for(int dx=-1;dx<=1;++dx){
+                        if(dz == 0 && dy == 0 && dx >= 0)
+                            break;
+                        int nx = x+dx, ny = y+dy;
+                        if(nx < 0 || nx >= this->size_x_ || ny < 0 || ny >= this->size_y_)
+                            continue;
+                        uint32_t neighbour = labels[ (size_t)ny * this->size_x_ + nx ];
+                        if(neighbour == 0)
+                            continue;
+                        if(label == 0)
+                            label = neighbour;
+                        else
+                            this->unite_(label, neighbour);
+                    }
+                }
+            }
+            if(label == 0){
+                label = this->parent_.size();
+                this->parent_.push_back(label);
+                this->components_.push_back(tomo_component());
+            }
+            current[ (size_t)y * this->size_x_ + x ] = label;
+            this->components_[label].add(x, y, index_z, slice[y][x]);
+        }
+    }
+
+    if(current.size() > 0 && fwrite(&current[0], sizeof(uint32_t), current.size(), this->raw_) != current.size()){
+        cerr << "ERROR : cannot write " << this->prefix_ << ".raw.tmp" <<endl;
+        exit(-1);
+    }
+    this->previous_.swap(current);
+    ++this->size_z_;
+
+    return;
+}
+
+void tomo_component_sink::finish(float /*normalized*/){
+
+    tomo_stage stage("components", (double)this->size_x_ * this->size_y_ * this->size_z_);
+
+    //final labels in the order of the roots, the statistics gathered in the roots
+    vector<uint32_t> labels(this->parent_.size(), 0);
+    vector<tomo_component> components;
+    uint32_t number_components = 0;
+    for(uint32_t label=1;label<this->parent_.size();++label){
+        uint32_t root = this->find_(label);
+        if(root == label){
+            labels[label] = ++number_components;
+        }else{
+            labels[label] = labels[root];
+            this->components_[root].merge(this->components_[label]);
+        }
+    }
+    for(uint32_t label=1;label<this->parent_.size();++label){
+        if(this->parent_[label] == label)
+            components.push_back(this->components_[label]);
+    }
+    cout << number_components << " components" <<endl;
+
+    //renumber prefix.raw.tmp into prefix.raw
+    string address = this->prefix_ + ".raw";
+    FILE *out_raw = fopen(address.c_str(), "wb");
+    if(out_raw == NULL){
+        cerr << "ERROR : cannot open " << address <<endl;
+        exit(-1);
+    }
+    rewind(this->raw_);
+    vector<uint32_t> slice((size_t)this->size_x_ * this->size_y_);
+    for(int z=0;z<this->size_z_ && slice.size() > 0;++z){
+        if(fread(&slice[0], sizeof(uint32_t), slice.size(), this->raw_) != slice.size()){
+            cerr << "ERROR : cannot read " << this->prefix_ << ".raw.tmp" <<endl;
+            exit(-1);
+        }
+        for(size_t i=0;i<slice.size();++i){
+            slice[i] = labels[ slice[i] ];
+        }
+        fwrite(&slice[0], sizeof(uint32_t), slice.size(), out_raw);
+    }
+    tomo_metrics::add_bytes_written( (uint64_t)slice.size() * this->size_z_ * sizeof(uint32_t) );
+    fclose(out_raw);
+    fclose(this->raw_);
+    this->raw_ = NULL;
+    remove( (this->prefix_ + ".raw.tmp").c_str() );
+
+    tomo_components::save_table( (this->prefix_ + ".csv").c_str(), components, this->size_x_, this->size_y_, this->size_z_ );
+
+    return;
+}
@@ -0,0 +1,78 @@
+#ifndef TOMO_COMPONENTS
+#define TOMO_COMPONENTS
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "tomo_tiff.h"
+
+#define TOMO_COMPONENTS_BLOCK 8 // slices per block of the in memory labelling
+
+using namespace std;
+
+// connected components (26-neighbourhood) of the voxels with measure >= threshold
+//      labels start from 1 in the order their first voxel is met (x, then y, then z), 0 is the background,
+//      the same in memory and streaming
+//      prefix.raw : uint32 labels, x fastest
+//      prefix.csv : one line per component, voxels, bounding box, centroid & mean measure
+
+class tomo_component{
+
+    public:
+
+    uint64_t voxels;
+    int x_min, y_min, z_min;
+    int x_max, y_max, z_max;
+    double sum_x, sum_y, sum_z;
+    double sum_measure;
+
+    tomo_component();
+
+    void add(int x, int y, int z, float measure);
+    void merge(const tomo_component& b);
+};
+
+class tomo_components{
+
+    public:
+
+    // in memory : blocks of slices are labelled in parallel, then merged across their borders
+    //      scale : the measure is multiplied by it first, the normalization for tomo_super_tiff
+    static void label(vector< vector< vector<float> > >& measure, float scale, float threshold,
+                      vector<uint32_t>& labels, vector<tomo_component>& components);
+
+    static bool save_raw(const char* address, vector<uint32_t>& labels);
+    static bool save_table(const char* address, vector<tomo_component>& components,
+                           int size_x, int size_y, int size_z);
+};
+
+// streaming : labels the slices in the order neuron_detection emits them,
+//      provisional labels go to prefix.raw.tmp and are renumbered once every slice is there
+class tomo_component_sink : public tomo_slice_sink{
+
+    string prefix_;
+    float threshold_;
+    int size_x_;
+    int size_y_;
+    int size_z_;
+    FILE *raw_;
+
+    vector<uint32_t> previous_; // provisional labels of the last slice
+    vector<uint32_t> parent_;   // union-find of the provisional labels
+    vector<tomo_component> components_;
+
+    uint32_t find_(uint32_t label);
+    void unite_(uint32_t a, uint32_t b);
+
+    public:
+
+    // prefix : relative to the working directory at construction
+    tomo_component_sink(const char* prefix, float threshold);
+    ~tomo_component_sink();
+
+    void measure_slice(int index_z, vector< vector<float> >& slice);
+    void finish(float normalized);
+};
+
+#endif // TOMO_COMPONENTS
@@ -0,0 +1,161 @@
+#include "tomo_distance.h"
+#include "tomo_metrics.h"
+#include "tomo_trace.h"
+
+// the lower envelope of the parabolas (q - p)^2 + f[p] over the finite samples of a line,
+//      line[i * stride] for i in [0, size), scratch : f, v & the boundaries z, size + 1 each
+//      the intersections in double, q^2 is no longer exact in float past 4096
+static void transform_line(float *line, int size, long stride, float *f, int *v, double *z){
+
+    for(int i=0;i<size;++i){
+        f[i] = line[i * stride];
+    }
+
+    int k = -1;
+    for(int q=0;q<size;++q){
+        if(f[q] >= TOMO_DISTANCE_INF)
+            continue;
+        double s = 0.0;
+        while(k >= 0){
+            s = (((double)f[q] + (double)q*q) - ((double)f[v[k]] + (double)v[k]*v[k])) / (2.0 * (q - v[k]));
+            if(s > z[k])
+                break;
+            --k;
+        }
+        ++k;
+        v[k] = q;
+        z[k] = k == 0 ? -TOMO_DISTANCE_INF : s;
+        z[k+1] = TOMO_DISTANCE_INF;
+    }
+    if(k < 0)   // no background on the line, nothing changes
+        return;
+
+    k = 0;
+    for(int q=0;q<size;++q){
+        while(z[k+1] < q)
+            ++k;
+        float d = (float)(q - v[k]);
+        line[q * stride] = d*d + f[v[k]];
+    }
+
+    return;
+}
+
+void tomo_distance::transform_slice(float *slice, int size_x, int size_y){
+
+    int size = size_x > size_y ? size_x : size_y;
+    vector<float> f(size);
+    vector<double> z(size+1);
+    vector<int> v(size);
+
+    for(int y=0;y<size_y;++y){
+        transform_line(slice + (long)y * size_x, size_x, 1, &f[0], &v[0], &z[0]);
+    }
+    for(int x=0;x<size_x;++x){
+        transform_line(slice + x, size_y, size_x, &f[0], &v[0], &z[0]);
+    }
+
+    return;
+}
+
+void tomo_distance::transform_z(float *volume, int size_x, int size_y, int size_z){
+
+    long stride = (long)size_x * size_y;
+
+    #pragma omp parallel
+    {
+        vector<float> f(size_z);
+        vector<double> z(size_z+1);
+        vector<int> v(size_z);
+
+        #pragma omp for schedule(dynamic)
+        for(int y=0;y<size_y;++y){
+            for(int x=0;x<size_x;++x){
+                transform_line(volume + (long)y * size_x + x, size_z, stride, &f[0], &v[0], &z[0]);
+            }
+        }
+    }
+
+    return;
+}
+
+void tomo_distance::threshold_slice(vector< vector<float> > &slice, float scale, float threshold, float *output){
+    for(int y=0;y<slice.size();++y){
+        float *row = output + (long)y * slice[y].size();
+        for(int x=0;x<slice[y].size();++x){
+            row[x] = slice[y][x] * scale >= threshold ? TOMO_DISTANCE_INF : 0.0f;
+        }
+    }
+    return;
+}
+
+void tomo_distance::root(vector<float> &volume){
+    #pragma omp parallel for
+    for(long i=0;i<(long)volume.size();++i){
+        volume[i] = sqrt(volume[i]);
+    }
+    return;
+}
+
+bool tomo_distance::save_raw(const char *address, vector<float> &volume){
+
+    FILE *out_raw = fopen(address, "wb");
+    if(out_raw == NULL){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+    size_t written = volume.size() > 0 ? fwrite(&volume[0], sizeof(float), volume.size(), out_raw) : 0;
+    fclose(out_raw);
+    tomo_metrics::add_bytes_written( written * sizeof(float) );
+    if(written != volume.size()){
+        cerr << "ERROR : cannot write " << address <<endl;
+        return false;
+    }
+
+    return true;
+}
+
+tomo_distance_sink::tomo_distance_sink(const char *prefix, float threshold){
+
+    // keep the absolute address, the working directory keeps changing
+    this->prefix_ = absolute_address(prefix);
+    this->threshold_ = threshold;
+    this->size_x_ = 0;
+    this->size_y_ = 0;
+    this->size_z_ = 0;
+}
+
+void tomo_distance_sink::measure_slice(int index_z, vector< vector<float> > &slice){
+
+    tomo_trace_scope trace("distance_slice", index_z);
+
+    if(index_z != this->size_z_){
+        cerr << "ERROR : distance expects slice " << this->size_z_ << ", got " << index_z <<endl;
+        exit(-1);
+    }
+    if(index_z == 0){
+        this->size_y_ = slice.size();
+        this->size_x_ = slice.size() > 0 ? slice[0].size() : 0;
+    }
+
+    size_t size_slice = (size_t)this->size_x_ * this->size_y_;
+    this->volume_.resize( this->volume_.size() + size_slice );
+    float *output = &this->volume_[0] + size_slice * index_z;
+    tomo_distance::threshold_slice(slice, 1.0, this->threshold_, output);
+    tomo_distance::transform_slice(output, this->size_x_, this->size_y_);
+    ++this->size_z_;
+
+    return;
+}
+
+void tomo_distance_sink::finish(float /*normalized*/){
+
+    tomo_stage stage("distance", (double)this->volume_.size());
+
+    if(this->volume_.size() > 0)
+        tomo_distance::transform_z(&this->volume_[0], this->size_x_, this->size_y_, this->size_z_);
+    tomo_distance::root(this->volume_);
+    tomo_distance::save_raw( (this->prefix_ + ".raw").c_str(), this->volume_ );
+
+    return;
+}
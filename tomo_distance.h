@@ -0,0 +1,54 @@
+#ifndef TOMO_DISTANCE
+#define TOMO_DISTANCE
+
+#include <string>
+#include <vector>
+#include "tomo_tiff.h"
+
+using namespace std;
+
+#define TOMO_DISTANCE_INF 1e20f // squared distance of a voxel without background in sight yet
+
+// euclidean distance of every voxel with measure >= threshold to the nearest voxel below it,
+//      in voxels, 0 on the background, the outside of the volume is not background
+//      exact & linear : the lower envelope of parabolas (Felzenszwalb & Huttenlocher) along x,
+//      then y, then z, every pass parallel over its lines
+//      prefix.raw : float32 distances, x fastest
+
+class tomo_distance{
+
+    public:
+
+    // squared distances in place, a flat volume x fastest, TOMO_DISTANCE_INF on the foreground
+    // & 0 on the background before
+    static void transform_slice(float* slice, int size_x, int size_y);  // along x & y
+    static void transform_z(float* volume, int size_x, int size_y, int size_z);
+
+    // TOMO_DISTANCE_INF or 0 from the measure
+    static void threshold_slice(vector< vector<float> >& slice, float scale, float threshold, float* output);
+    // squared distances to distances
+    static void root(vector<float>& volume);
+
+    static bool save_raw(const char* address, vector<float>& volume);
+};
+
+// streaming : x & y as the slices come, z once every slice is there
+class tomo_distance_sink : public tomo_slice_sink{
+
+    string prefix_;
+    float threshold_;
+    int size_x_;
+    int size_y_;
+    int size_z_;
+    vector<float> volume_;
+
+    public:
+
+    // prefix : relative to the working directory at construction
+    tomo_distance_sink(const char* prefix, float threshold);
+
+    void measure_slice(int index_z, vector< vector<float> >& slice);
+    void finish(float normalized);
+};
+
+#endif // TOMO_DISTANCE
@@ -0,0 +1,125 @@
+#include "tomo_gradient.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TOMO_GRADIENT_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*gradient_kernel)(const tomo_gradient_rows& rows, int x_begin, int x_end, float** products);
+
+static inline void store_products(float Ix, float Iy, float Iz, int x, float** products){
+    products[TOMO_GRADIENT_IXIX][x] = Ix*Ix;
+    products[TOMO_GRADIENT_IYIY][x] = Iy*Iy;
+    products[TOMO_GRADIENT_IZIZ][x] = Iz*Iz;
+    products[TOMO_GRADIENT_IXIY][x] = Ix*Iy;
+    products[TOMO_GRADIENT_IXIZ][x] = Ix*Iz;
+    products[TOMO_GRADIENT_IYIZ][x] = Iy*Iz;
+}
+
+// x in [x_begin, x_end) with both x-1 & x+1 inside the row
+static void gradient_scalar(const tomo_gradient_rows& rows, int x_begin, int x_end, float** products){
+    for(int x=x_begin;x<x_end;++x){
+        float Ix = (rows.center[x+1] - rows.center[x-1]) * 0.5f;
+        float Iy = (rows.next_y[x] - rows.previous_y[x]) * rows.scale_y;
+        float Iz = (rows.next_z[x] - rows.previous_z[x]) * rows.scale_z;
+        store_products(Ix, Iy, Iz, x, products);
+    }
+}
+
+#ifdef TOMO_GRADIENT_X86
+
+__attribute__((target("avx2")))
+static void gradient_avx2(const tomo_gradient_rows& rows, int x_begin, int x_end, float** products){
+
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 scale_y = _mm256_set1_ps(rows.scale_y);
+    const __m256 scale_z = _mm256_set1_ps(rows.scale_z);
+
+    int x = x_begin;
+    for(;x+8<=x_end;x+=8){
+        __m256 Ix = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(rows.center+x+1), _mm256_loadu_ps(rows.center+x-1)), half);
+        __m256 Iy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(rows.next_y+x), _mm256_loadu_ps(rows.previous_y+x)), scale_y);
+        __m256 Iz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(rows.next_z+x), _mm256_loadu_ps(rows.previous_z+x)), scale_z);
+        _mm256_storeu_ps(products[TOMO_GRADIENT_IXIX]+x, _mm256_mul_ps(Ix, Ix));
+        _mm256_storeu_ps(products[TOMO_GRADIENT_IYIY]+x, _mm256_mul_ps(Iy, Iy));
+        _mm256_storeu_ps(products[TOMO_GRADIENT_IZIZ]+x, _mm256_mul_ps(Iz, Iz));
+        _mm256_storeu_ps(products[TOMO_GRADIENT_IXIY]+x, _mm256_mul_ps(Ix, Iy));
+        _mm256_storeu_ps(products[TOMO_GRADIENT_IXIZ]+x, _mm256_mul_ps(Ix, Iz));
+        _mm256_storeu_ps(products[TOMO_GRADIENT_IYIZ]+x, _mm256_mul_ps(Iy, Iz));
+    }
+    gradient_scalar(rows, x, x_end, products);
+}
+
+__attribute__((target("avx512f")))
+static void gradient_avx512(const tomo_gradient_rows& rows, int x_begin, int x_end, float** products){
+
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 scale_y = _mm512_set1_ps(rows.scale_y);
+    const __m512 scale_z = _mm512_set1_ps(rows.scale_z);
+
+    int x = x_begin;
+    for(;x+16<=x_end;x+=16){
+        __m512 Ix = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(rows.center+x+1), _mm512_loadu_ps(rows.center+x-1)), half);
+        __m512 Iy = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(rows.next_y+x), _mm512_loadu_ps(rows.previous_y+x)), scale_y);
+        __m512 Iz = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(rows.next_z+x), _mm512_loadu_ps(rows.previous_z+x)), scale_z);
+        _mm512_storeu_ps(products[TOMO_GRADIENT_IXIX]+x, _mm512_mul_ps(Ix, Ix));
+        _mm512_storeu_ps(products[TOMO_GRADIENT_IYIY]+x, _mm512_mul_ps(Iy, Iy));
+        _mm512_storeu_ps(products[TOMO_GRADIENT_IZIZ]+x, _mm512_mul_ps(Iz, Iz));
+        _mm512_storeu_ps(products[TOMO_GRADIENT_IXIY]+x, _mm512_mul_ps(Ix, Iy));
+        _mm512_storeu_ps(products[TOMO_GRADIENT_IXIZ]+x, _mm512_mul_ps(Ix, Iz));
+        _mm512_storeu_ps(products[TOMO_GRADIENT_IYIZ]+x, _mm512_mul_ps(Iy, Iz));
+    }
+    gradient_scalar(rows, x, x_end, products);
+}
+
+#endif // TOMO_GRADIENT_X86
+
+static gradient_kernel choose_kernel(void){
+#ifdef TOMO_GRADIENT_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return gradient_avx512;
+    if(__builtin_cpu_supports("avx2"))
+        return gradient_avx2;
+#endif
+    return gradient_scalar;
+}
+
+static gradient_kernel kernel(void){
+    static gradient_kernel chosen = choose_kernel();
+    return chosen;
+}
+
+void tomo_gradient::row(const tomo_gradient_rows &rows, float **products){
+
+    int size_x = rows.size_x;
+    if(size_x <= 0)
+        return;
+
+    //peel the borders, one-sided differences
+    for(int x=0;x<size_x;x+=size_x-1){
+        float Ix = 0.0;
+        if(size_x > 1)
+            Ix = x == 0 ? rows.center[1] - rows.center[0] : rows.center[x] - rows.center[x-1];
+        float Iy = (rows.next_y[x] - rows.previous_y[x]) * rows.scale_y;
+        float Iz = (rows.next_z[x] - rows.previous_z[x]) * rows.scale_z;
+        store_products(Ix, Iy, Iz, x, products);
+        if(size_x == 1)
+            break;
+    }
+
+    //inside
+    kernel()(rows, 1, size_x-1, products);
+
+    return;
+}
+
+const char* tomo_gradient::isa(void){
+#ifdef TOMO_GRADIENT_X86
+    if(kernel() == gradient_avx512)
+        return "avx512";
+    if(kernel() == gradient_avx2)
+        return "avx2";
+#endif
+    return "scalar";
+}
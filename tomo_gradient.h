@@ -0,0 +1,37 @@
+#ifndef TOMO_GRADIENT
+#define TOMO_GRADIENT
+
+// gradient engine : the central differences of a whole row and the 6 products of the differential matrix
+//      one-sided differences on the borders, the inside of the row runs on avx-512 or avx2
+//      when the cpu has it, picked once at runtime
+
+enum{ TOMO_GRADIENT_IXIX, TOMO_GRADIENT_IYIY, TOMO_GRADIENT_IZIZ,
+      TOMO_GRADIENT_IXIY, TOMO_GRADIENT_IXIZ, TOMO_GRADIENT_IYIZ, TOMO_GRADIENT_PRODUCTS };
+
+// row y of slice z and its neighbours
+//      on a border the missing neighbour is center itself and the scale 1.0 instead of 0.5
+class tomo_gradient_rows{
+
+    public:
+
+    const float *center;
+    const float *previous_y;    // row y-1 of slice z
+    const float *next_y;        // row y+1 of slice z
+    const float *previous_z;    // row y of slice z-1
+    const float *next_z;        // row y of slice z+1
+    float scale_y;
+    float scale_z;
+    int size_x;
+};
+
+class tomo_gradient{
+
+    public:
+
+    // products : TOMO_GRADIENT_PRODUCTS rows of size_x
+    static void row(const tomo_gradient_rows& rows, float** products);
+    // "avx512", "avx2" or "scalar"
+    static const char* isa(void);
+};
+
+#endif // TOMO_GRADIENT
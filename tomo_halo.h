@@ -0,0 +1,71 @@
+#ifndef TOMO_HALO
+#define TOMO_HALO
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+// ghost margins : a slice kept with margin extra rows & columns on each side
+//      so a stencil reads past the border without checking every sample
+//          zero      : the ghosts add nothing, what the tensor did by skipping the taps outside
+//          replicate : the nearest sample inside, what down_size did by clamping
+//      slice[margin+y][margin+x] is (x, y)
+
+enum{ TOMO_HALO_ZERO, TOMO_HALO_REPLICATE };
+
+// size_x x size_y inside, everything set to zero
+template<class T>
+void tomo_halo_resize(vector< vector<T> >& slice, int size_x, int size_y, int margin, const T& zero){
+    slice.assign(size_y + 2*margin, vector<T>(size_x + 2*margin, zero));
+    return;
+}
+
+// the ghosts from the inside of the slice
+template<class T>
+void tomo_halo_fill(vector< vector<T> >& slice, int margin, int policy, const T& zero){
+
+    int size_y = (int)slice.size() - 2*margin;
+    if(size_y <= 0)
+        return;
+    int size_x = (int)slice[margin].size() - 2*margin;
+
+    //columns
+    for(int y=margin;y<margin+size_y;++y){
+        vector<T> &row = slice[y];
+        for(int g=0;g<margin;++g){
+            row[g] = policy == TOMO_HALO_REPLICATE ? row[margin] : zero;
+            row[margin+size_x+g] = policy == TOMO_HALO_REPLICATE ? row[margin+size_x-1] : zero;
+        }
+    }
+
+    //rows, corners included
+    for(int g=0;g<margin;++g){
+        if(policy == TOMO_HALO_REPLICATE){
+            slice[g] = slice[margin];
+            slice[margin+size_y+g] = slice[margin+size_y-1];
+        }else{
+            slice[g].assign(size_x + 2*margin, zero);
+            slice[margin+size_y+g].assign(size_x + 2*margin, zero);
+        }
+    }
+
+    return;
+}
+
+// source with its ghosts
+template<class T>
+void tomo_halo_copy(vector< vector<T> >& source, vector< vector<T> >& slice, int margin, int policy, const T& zero){
+
+    int size_y = source.size();
+    int size_x = size_y > 0 ? source[0].size() : 0;
+    tomo_halo_resize(slice, size_x, size_y, margin, zero);
+    for(int y=0;y<size_y;++y){
+        copy(source[y].begin(), source[y].end(), slice[margin+y].begin() + margin);
+    }
+    tomo_halo_fill(slice, margin, policy, zero);
+
+    return;
+}
+
+#endif // TOMO_HALO
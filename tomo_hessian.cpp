@@ -0,0 +1,173 @@
+#include "tomo_hessian.h"
+#include "tomo_halo.h"
+#include "tomo_trace.h"
+#include <cmath>
+
+void tomo_hessian::kernel(vector< vector< vector<float> > > &window, vector<float> &kernel, float &variance, int &before){
+
+    //g(i,j,k) = g(i) g(j) g(k), the first row along i is g(i) up to a constant
+    int size = window.size();
+    kernel.resize(size);
+    float summation = 0.0;
+    for(int i=0;i<size;++i){
+        kernel[i] = window[i][0][0];
+        summation += kernel[i];
+    }
+    variance = 0.0;
+    for(int i=0;i<size;++i){
+        kernel[i] /= summation;
+        float offset = (float)i - (float)(size-1) / 2.0;
+        variance += kernel[i] * offset * offset;
+    }
+    before = size/2;
+
+    return;
+}
+
+void tomo_hessian::gaussian(float sigma, vector<float> &kernel, float &variance, int &before){
+
+    before = (int)ceil(3.0 * sigma);
+    before = before > 1 ? before : 1;
+    kernel.resize(2*before + 1);
+    float summation = 0.0;
+    for(int i=0;i<kernel.size();++i){
+        float offset = (float)(i - before);
+        kernel[i] = exp(-offset * offset / (2.0 * sigma * sigma));
+        summation += kernel[i];
+    }
+    variance = 0.0;
+    for(int i=0;i<kernel.size();++i){
+        kernel[i] /= summation;
+        float offset = (float)(i - before);
+        variance += kernel[i] * offset * offset;
+    }
+
+    return;
+}
+
+void tomo_hessian::smooth_xy(vector< vector<float> > &slice, const vector<float> &kernel, int before,
+                             vector< vector<float> > &smoothed){
+
+    int size = kernel.size();
+    int size_y = slice.size();
+    int size_x = size_y > 0 ? slice[0].size() : 0;
+
+    //replicated ghosts, then x on every row & y on the result
+    vector< vector<float> > padded;
+    tomo_halo_copy(slice, padded, before, TOMO_HALO_REPLICATE, 0.0f);
+
+    vector< vector<float> > along_x(padded.size(), vector<float>(size_x, 0.0));
+    for(int y=0;y<padded.size();++y){
+        const float *row = &padded[y][0];
+        float *output = &along_x[y][0];
+        for(int x=0;x<size_x;++x){
+            float sum = 0.0;
+            for(int t=0;t<size;++t){
+                sum += kernel[t] * row[x+t];
+            }
+            output[x] = sum;
+        }
+    }
+
+    smoothed.assign(size_y, vector<float>(size_x, 0.0));
+    for(int y=0;y<size_y;++y){
+        float *output = &smoothed[y][0];
+        for(int t=0;t<size;++t){
+            const float *row = &along_x[y+t][0];
+            float weight = kernel[t];
+            for(int x=0;x<size_x;++x){
+                output[x] += weight * row[x];
+            }
+        }
+    }
+
+    return;
+}
+
+void tomo_hessian::smooth_z(vector< vector< vector<float> >* > &slices, const vector<float> &kernel,
+                            vector< vector<float> > &smoothed){
+
+    vector< vector<float> > &first = *slices[0];
+    smoothed.assign(first.size(), vector<float>(first.size() > 0 ? first[0].size() : 0, 0.0));
+    for(int t=0;t<kernel.size();++t){
+        vector< vector<float> > &slice = *slices[t];
+        float weight = kernel[t];
+        for(int y=0;y<smoothed.size();++y){
+            float *output = &smoothed[y][0];
+            const float *row = &slice[y][0];
+            for(int x=0;x<smoothed[y].size();++x){
+                output[x] += weight * row[x];
+            }
+        }
+    }
+
+    return;
+}
+
+void tomo_hessian::smooth(vector< vector< vector<float> >* > &volume, const vector<float> &kernel, int before,
+                          vector< vector< vector<float> > > &smoothed){
+
+    int size_z = volume.size();
+
+    //x & y, then z
+    vector< vector< vector<float> > > smoothed_xy(size_z);
+    #pragma omp parallel for schedule(dynamic)
+    for(int z=0;z<size_z;++z){
+        tomo_trace_scope trace("smooth_xy", z);
+        tomo_hessian::smooth_xy(*volume[z], kernel, before, smoothed_xy[z]);
+    }
+    smoothed.resize(size_z);
+    #pragma omp parallel for schedule(dynamic)
+    for(int z=0;z<size_z;++z){
+        tomo_trace_scope trace("smooth_z", z);
+        vector< vector< vector<float> >* > slices(kernel.size());
+        for(int t=0;t<kernel.size();++t){
+            int k = z - before + t;
+            slices[t] = &smoothed_xy[ k < 0 ? 0 : (k >= size_z ? size_z-1 : k) ];
+        }
+        tomo_hessian::smooth_z(slices, kernel, smoothed[z]);
+    }
+
+    return;
+}
+
+void tomo_hessian::row(const float *rows[3][3], int size_x, float scale, matrix *hessian){
+
+    const float *center = rows[1][1];
+    for(int x=0;x<size_x;++x){
+        int previous = x > 0 ? x-1 : 0;
+        int next = x < size_x-1 ? x+1 : size_x-1;
+
+        float xx = center[next] - 2.0f*center[x] + center[previous];
+        float yy = rows[1][2][x] - 2.0f*center[x] + rows[1][0][x];
+        float zz = rows[2][1][x] - 2.0f*center[x] + rows[0][1][x];
+        float xy = 0.25f * (rows[1][2][next] - rows[1][2][previous] - rows[1][0][next] + rows[1][0][previous]);
+        float xz = 0.25f * (rows[2][1][next] - rows[2][1][previous] - rows[0][1][next] + rows[0][1][previous]);
+        float yz = 0.25f * (rows[2][2][x] - rows[2][0][x] - rows[0][2][x] + rows[0][0][x]);
+
+        matrix &h = hessian[x];
+        h.resize(3);
+        h[0][0] = scale * xx;
+        h[1][1] = scale * yy;
+        h[2][2] = scale * zz;
+        h[0][1] = h[1][0] = scale * xy;
+        h[0][2] = h[2][0] = scale * xz;
+        h[1][2] = h[2][1] = scale * yz;
+    }
+
+    return;
+}
+
+void tomo_hessian::laplacian_row(const float *rows[3][3], int size_x, float scale, float *laplacian){
+
+    const float *center = rows[1][1];
+    for(int x=0;x<size_x;++x){
+        int previous = x > 0 ? x-1 : 0;
+        int next = x < size_x-1 ? x+1 : size_x-1;
+
+        laplacian[x] = scale * (center[next] + center[previous] + rows[1][2][x] + rows[1][0][x]
+                                + rows[2][1][x] + rows[0][1][x] - 6.0f*center[x]);
+    }
+
+    return;
+}
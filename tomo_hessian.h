@@ -0,0 +1,39 @@
+#ifndef TOMO_HESSIAN
+#define TOMO_HESSIAN
+
+#include <vector>
+#include "tomo_tiff.h"
+
+using namespace std;
+
+// hessian engine : the second derivatives of the gaussian smoothed data, in place of the structure tensor
+//      the gaussian is the one of the tensor window, applied along x, y, then z, replicated past the borders
+//      central differences on the smoothed data, times the variance of the gaussian so scales compare
+//      the eigen values keep their sign, bright tubes have the two large ones negative (tomo_measure_frangi)
+//      picked with TOMO_ENGINE_HESSIAN, see tomo_tiff.h
+
+class tomo_hessian{
+
+    public:
+
+    // the 1d factor of the separable window, summing to 1, its variance & the taps before the center
+    static void kernel(vector< vector< vector<float> > >& window, vector<float>& kernel, float& variance, int& before);
+    // the same for a gaussian of standard deviation sigma, cut at 3 sigma
+    static void gaussian(float sigma, vector<float>& kernel, float& variance, int& before);
+
+    static void smooth_xy(vector< vector<float> >& slice, const vector<float>& kernel, int before,
+                          vector< vector<float> >& smoothed);
+    // slices : the kernel.size() xy-smoothed slices under the kernel, the first ones repeated past the borders
+    static void smooth_z(vector< vector< vector<float> >* >& slices, const vector<float>& kernel,
+                         vector< vector<float> >& smoothed);
+    // every slice, in parallel, the xy-smoothed copies freed before returning
+    static void smooth(vector< vector< vector<float> >* >& volume, const vector<float>& kernel, int before,
+                       vector< vector< vector<float> > >& smoothed);
+
+    // rows[dz][dy] : row y+dy-1 of the smoothed slice z+dz-1, the borders repeated
+    static void row(const float* rows[3][3], int size_x, float scale, matrix* hessian);
+    // the trace only, xx + yy + zz
+    static void laplacian_row(const float* rows[3][3], int size_x, float scale, float* laplacian);
+};
+
+#endif // TOMO_HESSIAN
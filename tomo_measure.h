@@ -0,0 +1,80 @@
+#ifndef TOMO_MEASURE
+#define TOMO_MEASURE
+
+#include <cmath>
+
+// measures from the eigen values, sorted by absolute value |e0| <= |e1| <= |e2|
+//      signed with the hessian engine (tomo_hessian.h), the tensor measures use the absolute values
+//      each one is a policy, the measure loop is instantiated for every policy and with / without threshold
+//      so nothing is decided per voxel
+
+enum{ TOMO_MEASURE_EXPERIMENTAL, TOMO_MEASURE_NOBLE, TOMO_MEASURE_EIGEN_RATIO, TOMO_MEASURE_FRANGI };
+
+// 0.3 * (e0 + e1 + e2)^2 - e0 * e1 * e2
+class tomo_measure_experimental{
+
+    public:
+
+    inline float operator ()(float e0, float e1, float e2) const{
+        e0 = fabs(e0); e1 = fabs(e1); e2 = fabs(e2);
+        float sum = e0 + e1 + e2;
+        return 0.3 * sum * sum - e0 * e1 * e2;
+    }
+};
+
+// Noble's corner measure : 2 * det(tensor) / ( trace(tensor)^2 + c )
+class tomo_measure_noble{
+
+    float constant_;
+
+    public:
+
+    tomo_measure_noble(float constant = 0.0){ this->constant_ = constant; }
+
+    inline float operator ()(float e0, float e1, float e2) const{
+        e0 = fabs(e0); e1 = fabs(e1); e2 = fabs(e2);
+        float trace = e0 + e1 + e2;
+        float denominator = trace * trace + this->constant_;
+        return denominator > 0.0 ? 2.0 * e0 * e1 * e2 / denominator : 0.0;
+    }
+};
+
+// tubes : two large eigen values of the same size and a small one along the axis
+//      (e1 - e0) * e1 / e2
+class tomo_measure_eigen_ratio{
+
+    public:
+
+    inline float operator ()(float e0, float e1, float e2) const{
+        e0 = fabs(e0); e1 = fabs(e1); e2 = fabs(e2);
+        return e2 > 0.0 ? (e1 - e0) * e1 / e2 : 0.0;
+    }
+};
+
+// Frangi's vesselness for bright tubes, on the hessian : e1 & e2 negative
+//      (1 - exp(-Ra^2 / 2a^2)) * exp(-Rb^2 / 2b^2) * (1 - exp(-S^2 / 2c^2)), a = b = 0.5
+//      Ra = |e1| / |e2|, Rb = |e0| / sqrt(|e1 e2|), S^2 = e0^2 + e1^2 + e2^2, no S term when c <= 0
+//      c is usually half the largest S over the volume, see tomo_super_tiff::set_measure
+class tomo_measure_frangi{
+
+    float constant_;
+
+    public:
+
+    tomo_measure_frangi(float constant = 0.0){ this->constant_ = constant; }
+
+    inline float operator ()(float e0, float e1, float e2) const{
+        if(e1 >= 0.0 || e2 >= 0.0)
+            return 0.0;
+        float ra2 = (e1 * e1) / (e2 * e2);
+        float rb2 = (e0 * e0) / (e1 * e2);
+        float value = (1.0f - exp(-2.0f * ra2)) * exp(-2.0f * rb2);
+        if(this->constant_ > 0.0){
+            float s2 = e0*e0 + e1*e1 + e2*e2;
+            value *= 1.0f - exp(-s2 / (2.0f * this->constant_ * this->constant_));
+        }
+        return value;
+    }
+};
+
+#endif // TOMO_MEASURE
@@ -0,0 +1,314 @@
+#include "tomo_median.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TOMO_MEDIAN_X86
+#include <immintrin.h>
+#endif
+
+// voxels of a row sorted at once by the network, a multiple of 16
+#define TOMO_MEDIAN_CHUNK 256
+
+typedef void (*exchange_kernel)(const vector< pair<int,int> >& exchanges, float* buffer, int width);
+
+// every exchange on the lanes [0, width) of the chunk
+static void exchange_scalar(const vector< pair<int,int> >& exchanges, float* buffer, int width){
+    for(int e=0;e<exchanges.size();++e){
+        float *a = buffer + exchanges[e].first * TOMO_MEDIAN_CHUNK;
+        float *b = buffer + exchanges[e].second * TOMO_MEDIAN_CHUNK;
+        for(int x=0;x<width;++x){
+            float low = a[x] < b[x] ? a[x] : b[x];
+            float high = a[x] < b[x] ? b[x] : a[x];
+            a[x] = low;
+            b[x] = high;
+        }
+    }
+}
+
+#ifdef TOMO_MEDIAN_X86
+
+// width : a multiple of 8
+__attribute__((target("avx2")))
+static void exchange_avx2(const vector< pair<int,int> >& exchanges, float* buffer, int width){
+    for(int e=0;e<exchanges.size();++e){
+        float *a = buffer + exchanges[e].first * TOMO_MEDIAN_CHUNK;
+        float *b = buffer + exchanges[e].second * TOMO_MEDIAN_CHUNK;
+        for(int x=0;x<width;x+=8){
+            __m256 va = _mm256_loadu_ps(a+x);
+            __m256 vb = _mm256_loadu_ps(b+x);
+            _mm256_storeu_ps(a+x, _mm256_min_ps(va, vb));
+            _mm256_storeu_ps(b+x, _mm256_max_ps(va, vb));
+        }
+    }
+}
+
+// width : a multiple of 16
+__attribute__((target("avx512f")))
+static void exchange_avx512(const vector< pair<int,int> >& exchanges, float* buffer, int width){
+    for(int e=0;e<exchanges.size();++e){
+        float *a = buffer + exchanges[e].first * TOMO_MEDIAN_CHUNK;
+        float *b = buffer + exchanges[e].second * TOMO_MEDIAN_CHUNK;
+        for(int x=0;x<width;x+=16){
+            __m512 va = _mm512_loadu_ps(a+x);
+            __m512 vb = _mm512_loadu_ps(b+x);
+            _mm512_storeu_ps(a+x, _mm512_mask_min_ps(va, 0xFFFF, va, vb));
+            _mm512_storeu_ps(b+x, _mm512_mask_max_ps(va, 0xFFFF, va, vb));
+        }
+    }
+}
+
+#endif // TOMO_MEDIAN_X86
+
+static exchange_kernel choose_kernel(void){
+#ifdef TOMO_MEDIAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return exchange_avx512;
+    if(__builtin_cpu_supports("avx2"))
+        return exchange_avx2;
+#endif
+    return exchange_scalar;
+}
+
+static exchange_kernel kernel(void){
+    static exchange_kernel chosen = choose_kernel();
+    return chosen;
+}
+
+static inline int clamp_index(int i, int size){
+    return i < 0 ? 0 : (i >= size ? size-1 : i);
+}
+
+// the loader scales the gray scale to [0, 1], back to the 16 bit levels
+static inline int gray_level(float value){
+    int level = lrintf(value * 65535.0f);
+    return level < 0 ? 0 : (level > 65535 ? 65535 : level);
+}
+
+tomo_median_filter::tomo_median_filter(int radius, int kernel){
+
+    this->radius_ = radius;
+    this->kernel_ = kernel;
+    if(this->kernel_ == TOMO_MEDIAN_AUTO)
+        this->kernel_ = radius <= 1 ? TOMO_MEDIAN_NETWORK : TOMO_MEDIAN_HISTOGRAM;
+
+    int side = 2*radius + 1;
+    this->count_ = side * side * side;
+    this->lanes_ = 1;
+    while(this->lanes_ < this->count_){
+        this->lanes_ <<= 1;
+    }
+    if(this->kernel_ != TOMO_MEDIAN_NETWORK)
+        return;
+
+    //batcher's odd-even merge sort
+    vector< pair<int,int> > network;
+    int n = this->lanes_;
+    for(int p=1;p<n;p<<=1){
+        for(int k=p;k>=1;k>>=1){
+            for(int j=k%p;j+k<n;j+=2*k){
+                for(int i=0;i<k && i+j+k<n;++i){
+                    if((i+j)/(2*p) == (i+j+k)/(2*p))
+                        network.push_back(make_pair(i+j, i+j+k));
+                }
+            }
+        }
+    }
+
+    //backward from the median, only the exchanges it depends on
+    vector<bool> needed(n, false);
+    needed[(this->count_-1)/2] = true;
+    for(int e=network.size()-1;e>=0;--e){
+        if(needed[network[e].first] || needed[network[e].second]){
+            needed[network[e].first] = needed[network[e].second] = true;
+            this->exchanges_.push_back(network[e]);
+        }
+    }
+    reverse(this->exchanges_.begin(), this->exchanges_.end());
+
+    return;
+}
+
+tomo_median_filter* tomo_median_filter::parse(const char *spec){
+
+    string text(spec);
+    size_t colon = text.find(':');
+    int radius = atoi(text.substr(0, colon).c_str());
+    int kernel = TOMO_MEDIAN_AUTO;
+    if(colon != string::npos){
+        string name = text.substr(colon+1);
+        if(name == "network")
+            kernel = TOMO_MEDIAN_NETWORK;
+        else if(name == "histogram")
+            kernel = TOMO_MEDIAN_HISTOGRAM;
+        else{
+            cerr << "ERROR : unknown median kernel " << name <<endl;
+            return NULL;
+        }
+    }
+    if(radius < 1 || (kernel == TOMO_MEDIAN_NETWORK && radius > 2)){
+        cerr << "ERROR : median radius " << radius << " not handled!" <<endl;
+        return NULL;
+    }
+
+    return new tomo_median_filter(radius, kernel);
+}
+
+string tomo_median_filter::spec() const{
+    stringstream text;
+    text << "median " << this->radius_ << ":" << (this->kernel_ == TOMO_MEDIAN_NETWORK ? "network" : "histogram");
+    return text.str();
+}
+
+void tomo_median_filter::network_row_(vector< vector< vector<float> >* > &window, int y, vector<float> &buffer,
+                                      float *filtered){
+
+    int radius = this->radius_;
+    int size_y = window[0]->size();
+    int size_x = (*window[0])[0].size();
+    int median = (this->count_-1)/2;
+
+    for(int x0=0;x0<size_x;x0+=TOMO_MEDIAN_CHUNK){
+        int chunk = size_x - x0 < TOMO_MEDIAN_CHUNK ? size_x - x0 : TOMO_MEDIAN_CHUNK;
+        int width = (chunk + 15) & ~15; // the lanes past the row are borders repeated, then dropped
+
+        //lane t of every voxel, one after the other
+        int t = 0;
+        for(int dz=0;dz<window.size();++dz){
+            for(int dy=-radius;dy<=radius;++dy){
+                const float *row = &(*window[dz])[clamp_index(y+dy, size_y)][0];
+                for(int dx=-radius;dx<=radius;++dx,++t){
+                    float *lane = &buffer[t * TOMO_MEDIAN_CHUNK];
+                    if(x0+dx >= 0 && x0+width+dx <= size_x){
+                        memcpy(lane, row + x0+dx, width * sizeof(float));
+                        continue;
+                    }
+                    for(int x=0;x<width;++x){
+                        lane[x] = row[clamp_index(x0+x+dx, size_x)];
+                    }
+                }
+            }
+        }
+        for(;t<this->lanes_;++t){
+            float *lane = &buffer[t * TOMO_MEDIAN_CHUNK];
+            for(int x=0;x<width;++x){
+                lane[x] = FLT_MAX;
+            }
+        }
+
+        kernel()(this->exchanges_, &buffer[0], width);
+
+        const float *lane = &buffer[median * TOMO_MEDIAN_CHUNK];
+        for(int x=0;x<chunk;++x){
+            filtered[x0+x] = lane[x];
+        }
+    }
+
+    return;
+}
+
+void tomo_median_filter::histogram_row_(vector< vector< vector<float> >* > &window, int y, vector<int> &fine,
+                                        vector<int> &coarse, float *filtered){
+
+    int radius = this->radius_;
+    int side = 2*radius + 1;
+    int size_y = window[0]->size();
+    int size_x = (*window[0])[0].size();
+    int median = (this->count_-1)/2;
+
+    //the side^2 rows of the cube
+    vector<const float*> rows(side * side);
+    for(int dz=0;dz<side;++dz){
+        for(int dy=-radius;dy<=radius;++dy){
+            rows[dz*side + dy+radius] = &(*window[dz])[clamp_index(y+dy, size_y)][0];
+        }
+    }
+
+    for(int dx=-radius;dx<=radius;++dx){
+        int column = clamp_index(dx, size_x);
+        for(int r=0;r<rows.size();++r){
+            int level = gray_level(rows[r][column]);
+            ++fine[level];
+            ++coarse[level >> 8];
+        }
+    }
+
+    for(int x=0;x<size_x;++x){
+
+        //the coarse bin of the median, then the fine one in it
+        int below = 0;
+        int bin = 0;
+        while(below + coarse[bin] <= median){
+            below += coarse[bin];
+            ++bin;
+        }
+        int level = bin << 8;
+        while(below + fine[level] <= median){
+            below += fine[level];
+            ++level;
+        }
+        filtered[x] = (float)level / 65535.0f;
+
+        //slide, or empty the histograms at the end of the row
+        int leaving = clamp_index(x-radius, size_x);
+        for(int r=0;r<rows.size();++r){
+            int out = gray_level(rows[r][leaving]);
+            --fine[out];
+            --coarse[out >> 8];
+        }
+        if(x+1 < size_x){
+            int entering = clamp_index(x+1+radius, size_x);
+            for(int r=0;r<rows.size();++r){
+                int in = gray_level(rows[r][entering]);
+                ++fine[in];
+                ++coarse[in >> 8];
+            }
+        }else{
+            for(int dx=-radius+1;dx<=radius;++dx){
+                int column = clamp_index(x+dx, size_x);
+                for(int r=0;r<rows.size();++r){
+                    int out = gray_level(rows[r][column]);
+                    --fine[out];
+                    --coarse[out >> 8];
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+void tomo_median_filter::filter(int /*index_z*/, vector< vector< vector<float> >* > &window, vector< vector<float> > &filtered){
+
+    int size_y = window[0]->size();
+    int size_x = size_y > 0 ? (*window[0])[0].size() : 0;
+    filtered.resize(size_y);
+
+    #pragma omp parallel
+    {
+        vector<float> buffer;
+        vector<int> fine, coarse;
+        if(this->kernel_ == TOMO_MEDIAN_NETWORK)
+            buffer.resize(this->lanes_ * TOMO_MEDIAN_CHUNK);
+        else{
+            fine.assign(65536, 0);
+            coarse.assign(256, 0);
+        }
+
+        #pragma omp for schedule(dynamic)
+        for(int y=0;y<size_y;++y){
+            filtered[y].resize(size_x);
+            if(size_x == 0)
+                continue;
+            if(this->kernel_ == TOMO_MEDIAN_NETWORK)
+                this->network_row_(window, y, buffer, &filtered[y][0]);
+            else
+                this->histogram_row_(window, y, fine, coarse, &filtered[y][0]);
+        }
+    }
+
+    return;
+}
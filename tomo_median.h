@@ -0,0 +1,45 @@
+#ifndef TOMO_MEDIAN
+#define TOMO_MEDIAN
+
+#include <vector>
+#include "tomo_tiff.h"
+
+using namespace std;
+
+// 3d median pre-filter of the gray scale, the (2 radius + 1)^3 cube around every voxel, the borders repeated
+//      network : a sorting network pruned to the median, run on many voxels of a row at once so the
+//                compare & exchange loops vectorize, for the small cubes
+//      histogram : a sliding histogram along x of the 16 bit gray levels, coarse & fine bins,
+//                  O(radius^2) per voxel, the values in [0, 1] rounded to the nearest of 65536 levels
+//      auto : network for radius 1, histogram above
+
+enum{ TOMO_MEDIAN_AUTO, TOMO_MEDIAN_NETWORK, TOMO_MEDIAN_HISTOGRAM };
+
+class tomo_median_filter : public tomo_slice_filter{
+
+    int radius_;
+    int kernel_;
+
+    int count_;                         // voxels of the cube
+    int lanes_;                         // count_ up to a power of 2, the others +inf
+    vector< pair<int,int> > exchanges_; // the network, only what the median depends on
+
+    void network_row_(vector< vector< vector<float> >* >& window, int y, vector<float>& buffer, float* filtered);
+    void histogram_row_(vector< vector< vector<float> >* >& window, int y, vector<int>& fine, vector<int>& coarse,
+                        float* filtered);
+
+    public:
+
+    tomo_median_filter(int radius = 1, int kernel = TOMO_MEDIAN_AUTO);
+
+    // spec : radius[:network|histogram], e.g. 2:histogram
+    static tomo_median_filter* parse(const char* spec);
+
+    int radius_z() const{return this->radius_;}
+    int radius_xy() const{return this->radius_;}
+    string spec() const;
+    // the rows in parallel
+    void filter(int index_z, vector< vector< vector<float> >* >& window, vector< vector<float> >& filtered);
+};
+
+#endif // TOMO_MEDIAN
@@ -0,0 +1,347 @@
+#include "tomo_metrics.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+#include <omp.h>
+
+vector<tomo_stage_record> tomo_metrics::records_;
+mutex tomo_metrics::mutex_;
+atomic<uint64_t> tomo_metrics::bytes_read_(0);
+atomic<uint64_t> tomo_metrics::bytes_written_(0);
+string tomo_metrics::current_stage_;
+vector<long*> tomo_metrics::running_peaks_;
+double tomo_metrics::start_seconds_ = tomo_metrics::wall_seconds();
+string tomo_metrics::address_report_;
+string tomo_metrics::address_heartbeat_;
+int tomo_metrics::interval_heartbeat_ = 10;
+
+double tomo_metrics::wall_seconds(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+double tomo_metrics::cpu_seconds(void){
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+long tomo_metrics::rss_current(void){
+    long pages_total = 0;
+    long pages_resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if(statm == NULL)
+        return 0;
+    if(fscanf(statm, "%ld %ld", &pages_total, &pages_resident) != 2)
+        pages_resident = 0;
+    fclose(statm);
+    return pages_resident * sysconf(_SC_PAGESIZE);
+}
+
+long tomo_metrics::rss_peak(void){
+    long peak = 0;
+    char line[256];
+    FILE *status = fopen("/proc/self/status", "r");
+    if(status == NULL)
+        return 0;
+    while(fgets(line, sizeof(line), status) != NULL){
+        if(strncmp(line, "VmHWM:", 6) == 0){
+            peak = atol(line + 6) * 1024;
+            break;
+        }
+    }
+    fclose(status);
+    return peak;
+}
+
+void tomo_metrics::reset_rss_peak(void){
+    // linux >= 4.0, the peak keeps counting from the start of the process otherwise
+    FILE *clear_refs = fopen("/proc/self/clear_refs", "w");
+    if(clear_refs == NULL)
+        return;
+    fputs("5", clear_refs);
+    fclose(clear_refs);
+    return;
+}
+
+void tomo_metrics::begin_rss_peak(long *peak){
+
+    lock_guard<mutex> lock(mutex_);
+    long so_far = rss_peak();
+    for(int i=0;i<running_peaks_.size();++i){
+        *running_peaks_[i] = *running_peaks_[i] > so_far ? *running_peaks_[i] : so_far;
+    }
+    *peak = 0;
+    running_peaks_.push_back(peak);
+    reset_rss_peak();
+
+    return;
+}
+
+void tomo_metrics::end_rss_peak(long *peak){
+
+    lock_guard<mutex> lock(mutex_);
+    long so_far = rss_peak();
+    *peak = *peak > so_far ? *peak : so_far;
+    for(int i=0;i<running_peaks_.size();++i){
+        if(running_peaks_[i] == peak){
+            running_peaks_.erase(running_peaks_.begin() + i);
+            break;
+        }
+    }
+
+    return;
+}
+
+void tomo_metrics::begin(const char *stage){
+    lock_guard<mutex> lock(mutex_);
+    current_stage_ = stage;
+    return;
+}
+
+void tomo_metrics::record(tomo_stage_record &record){
+
+    lock_guard<mutex> lock(mutex_);
+    current_stage_.clear();
+
+    for(int i=0;i<records_.size();++i){
+        if(records_[i].name == record.name){
+            tomo_stage_record &target = records_[i];
+            target.calls += record.calls;
+            target.wall_seconds += record.wall_seconds;
+            target.cpu_seconds += record.cpu_seconds;
+            target.voxels += record.voxels;
+            target.bytes_read += record.bytes_read;
+            target.bytes_written += record.bytes_written;
+            target.allocations += record.allocations;
+            target.bytes_allocated += record.bytes_allocated;
+            target.rss_current = record.rss_current;
+            target.rss_peak = target.rss_peak > record.rss_peak ? target.rss_peak : record.rss_peak;
+            if(target.counters.size() < record.counters.size())
+                target.counters.resize(record.counters.size());
+            for(int t=0;t<record.counters.size();++t){
+                target.counters[t] += record.counters[t];
+            }
+            return;
+        }
+    }
+    records_.push_back(record);
+
+    return;
+}
+
+vector<tomo_stage_record> tomo_metrics::records(void){
+    lock_guard<mutex> lock(mutex_);
+    return records_;
+}
+
+bool tomo_metrics::save_json(const char *address){
+
+    vector<tomo_stage_record> records = tomo_metrics::records();
+
+    fstream out_json(address, fstream::out);
+    if(out_json.is_open() == false){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+
+    long peak = rss_peak();
+    for(int i=0;i<records.size();++i){
+        peak = peak > records[i].rss_peak ? peak : records[i].rss_peak;
+    }
+
+    out_json.setf(ios::fixed);
+    out_json.precision(6);
+    out_json << "{" <<endl;
+    out_json << "  \"threads\": " << omp_get_max_threads() << "," <<endl;
+    out_json << "  \"wall_seconds\": " << wall_seconds() - start_seconds_ << "," <<endl;
+    out_json << "  \"cpu_seconds\": " << cpu_seconds() << "," <<endl;
+    out_json << "  \"bytes_read\": " << bytes_read() << "," <<endl;
+    out_json << "  \"bytes_written\": " << bytes_written() << "," <<endl;
+    out_json << "  \"rss_current_bytes\": " << rss_current() << "," <<endl;
+    out_json << "  \"rss_peak_bytes\": " << peak << "," <<endl;
+    if(tomo_alloc::enabled()){
+        out_json << "  \"allocations\": " << tomo_alloc::allocations() << "," <<endl;
+        out_json << "  \"bytes_allocated\": " << tomo_alloc::bytes() << "," <<endl;
+    }
+    out_json << "  \"stages\": [" <<endl;
+    for(int i=0;i<records.size();++i){
+        tomo_stage_record &record = records[i];
+        out_json << "    {" <<endl;
+        out_json << "      \"name\": \"" << record.name << "\"," <<endl;
+        out_json << "      \"calls\": " << record.calls << "," <<endl;
+        out_json << "      \"wall_seconds\": " << record.wall_seconds << "," <<endl;
+        out_json << "      \"cpu_seconds\": " << record.cpu_seconds << "," <<endl;
+        out_json << "      \"voxels\": " << (uint64_t)record.voxels << "," <<endl;
+        out_json << "      \"voxels_per_second\": " << ( record.wall_seconds > 0.0 ? record.voxels / record.wall_seconds : 0.0 ) << "," <<endl;
+        out_json << "      \"bytes_read\": " << record.bytes_read << "," <<endl;
+        out_json << "      \"bytes_written\": " << record.bytes_written << "," <<endl;
+        out_json << "      \"rss_current_bytes\": " << record.rss_current << "," <<endl;
+        out_json << "      \"rss_peak_bytes\": " << record.rss_peak;
+        if(tomo_alloc::enabled()){
+            out_json << "," <<endl;
+            out_json << "      \"allocations\": " << record.allocations << "," <<endl;
+            out_json << "      \"allocations_per_voxel\": " << ( record.voxels > 0.0 ? (double)record.allocations / record.voxels : 0.0 ) << "," <<endl;
+            out_json << "      \"bytes_allocated\": " << record.bytes_allocated;
+        }
+        if(record.counters.size() > 0){
+            out_json << "," <<endl;
+            save_counters_(out_json, record.counters);
+        }
+        out_json <<endl;
+        out_json << "    }" << (i+1 < records.size() ? "," : "") <<endl;
+    }
+    out_json << "  ]" <<endl;
+    out_json << "}" <<endl;
+    out_json.close();
+
+    return true;
+}
+
+static void save_counter_values(fstream &out_json, tomo_counters &counters){
+    for(int c=0;c<TOMO_PERF_SIZE;++c){
+        out_json << (c > 0 ? ", " : "") << "\"" << tomo_perf::name(c) << "\": ";
+        if(counters.available[c])
+            out_json << counters.value[c];
+        else
+            out_json << "null";
+    }
+    return;
+}
+
+void tomo_metrics::save_counters_(fstream &out_json, vector<tomo_counters> &counters){
+
+    tomo_counters total;
+    for(int t=0;t<counters.size();++t){
+        total += counters[t];
+    }
+
+    out_json << "      \"counters\": {\"available\": " << (total.any_available() ? "true" : "false") << ", ";
+    save_counter_values(out_json, total);
+    if(total.available[TOMO_PERF_CYCLES] && total.available[TOMO_PERF_INSTRUCTIONS] && total.value[TOMO_PERF_CYCLES] > 0)
+        out_json << ", \"instructions_per_cycle\": " << (double)total.value[TOMO_PERF_INSTRUCTIONS] / (double)total.value[TOMO_PERF_CYCLES];
+    out_json << ", \"per_thread\": [";
+    for(int t=0;t<counters.size();++t){
+        out_json << "{\"thread\": " << t << ", ";
+        save_counter_values(out_json, counters[t]);
+        out_json << "}" << (t+1 < counters.size() ? ", " : "");
+    }
+    out_json << "]}";
+
+    return;
+}
+
+void tomo_metrics::save_report_at_exit_(){
+    if(address_report_.empty() == false)
+        save_json(address_report_.c_str());
+    return;
+}
+
+void tomo_metrics::set_report(const char *address){
+
+    // keep the absolute address, the working directory keeps changing
+    if(address[0] != '/'){
+        char current_directory[1024] = {0};
+        getcwd(current_directory, 1024);
+        address_report_ = string(current_directory) + "/" + address;
+    }else{
+        address_report_ = address;
+    }
+
+    static bool registered = false;
+    if(registered == false){
+        atexit(save_report_at_exit_);
+        registered = true;
+    }
+    return;
+}
+
+void tomo_metrics::heartbeat_loop_(){
+
+    string address_tmp = address_heartbeat_ + ".tmp";
+    while(true){
+        string stage;
+        {
+            lock_guard<mutex> lock(mutex_);
+            stage = current_stage_;
+        }
+
+        //written aside and renamed, readers never see half a file
+        fstream out_heartbeat(address_tmp.c_str(), fstream::out);
+        if(out_heartbeat.is_open()){
+            out_heartbeat.setf(ios::fixed);
+            out_heartbeat.precision(3);
+            out_heartbeat << "{\"time\": " << (long)time(NULL)
+                          << ", \"elapsed_seconds\": " << wall_seconds() - start_seconds_
+                          << ", \"cpu_seconds\": " << cpu_seconds()
+                          << ", \"stage\": \"" << stage << "\""
+                          << ", \"bytes_read\": " << bytes_read()
+                          << ", \"bytes_written\": " << bytes_written()
+                          << ", \"rss_current_bytes\": " << rss_current()
+                          << "}" <<endl;
+            out_heartbeat.close();
+            rename(address_tmp.c_str(), address_heartbeat_.c_str());
+        }
+
+        this_thread::sleep_for(chrono::seconds(interval_heartbeat_));
+    }
+    return;
+}
+
+void tomo_metrics::start_heartbeat(const char *address, int interval_seconds){
+
+    if(address[0] != '/'){
+        char current_directory[1024] = {0};
+        getcwd(current_directory, 1024);
+        address_heartbeat_ = string(current_directory) + "/" + address;
+    }else{
+        address_heartbeat_ = address;
+    }
+    interval_heartbeat_ = interval_seconds > 0 ? interval_seconds : 1;
+
+    thread heartbeat(heartbeat_loop_);
+    heartbeat.detach();
+    return;
+}
+
+tomo_stage::tomo_stage(const char *name, double voxels):trace_(name){
+
+    this->record_.name = name;
+    this->record_.calls = 1;
+    this->record_.voxels = voxels;
+
+    tomo_metrics::begin(name);
+    tomo_metrics::begin_rss_peak(&this->record_.rss_peak);
+    if(tomo_perf::enabled())
+        tomo_perf::snapshot(this->counters_start_);
+
+    this->bytes_read_start_ = tomo_metrics::bytes_read();
+    this->bytes_written_start_ = tomo_metrics::bytes_written();
+    this->allocations_start_ = tomo_alloc::allocations();
+    this->bytes_allocated_start_ = tomo_alloc::bytes();
+    this->cpu_start_ = tomo_metrics::cpu_seconds();
+    this->wall_start_ = tomo_metrics::wall_seconds();
+}
+
+tomo_stage::~tomo_stage(){
+
+    //first, the bookkeeping below allocates itself
+    this->record_.allocations = tomo_alloc::allocations() - this->allocations_start_;
+    this->record_.bytes_allocated = tomo_alloc::bytes() - this->bytes_allocated_start_;
+    this->record_.wall_seconds = tomo_metrics::wall_seconds() - this->wall_start_;
+    this->record_.cpu_seconds = tomo_metrics::cpu_seconds() - this->cpu_start_;
+    this->record_.bytes_read = tomo_metrics::bytes_read() - this->bytes_read_start_;
+    this->record_.bytes_written = tomo_metrics::bytes_written() - this->bytes_written_start_;
+    this->record_.rss_current = tomo_metrics::rss_current();
+    tomo_metrics::end_rss_peak(&this->record_.rss_peak);
+    if(tomo_perf::enabled()){
+        vector<tomo_counters> counters_end;
+        tomo_perf::snapshot(counters_end);
+        tomo_perf::difference(this->counters_start_, counters_end, this->record_.counters);
+    }
+
+    tomo_metrics::record(this->record_);
+}
@@ -0,0 +1,119 @@
+#ifndef TOMO_METRICS
+#define TOMO_METRICS
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+#include "tomo_perf.h"
+#include "tomo_alloc.h"
+#include "tomo_trace.h"
+
+using namespace std;
+
+// per-stage metrics
+//      every tomo_stage adds its wall & cpu time, voxels, bytes read/written and rss
+//      to the record with the same name, the records are written as a json report
+
+class tomo_stage_record{
+
+    public:
+
+    string name;
+    long calls;
+    double wall_seconds;
+    double cpu_seconds;
+    double voxels;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    long rss_current;   // bytes, at the end of the last call
+    long rss_peak;      // bytes, highest while the stage was running
+    uint64_t allocations;     // only with tomo_alloc enabled
+    uint64_t bytes_allocated;
+    vector<tomo_counters> counters; // per thread, only with tomo_perf enabled
+
+    tomo_stage_record(){
+        this->calls = 0;
+        this->wall_seconds = 0.0;
+        this->cpu_seconds = 0.0;
+        this->voxels = 0.0;
+        this->bytes_read = 0;
+        this->bytes_written = 0;
+        this->rss_current = 0;
+        this->rss_peak = 0;
+        this->allocations = 0;
+        this->bytes_allocated = 0;
+    }
+};
+
+class tomo_metrics{
+
+    static vector<tomo_stage_record> records_;
+    static mutex mutex_;
+    static atomic<uint64_t> bytes_read_;
+    static atomic<uint64_t> bytes_written_;
+    static string current_stage_;
+    static vector<long*> running_peaks_;
+    static double start_seconds_;
+    static string address_report_;
+    static string address_heartbeat_;
+    static int interval_heartbeat_;
+
+    static void heartbeat_loop_();
+    static void save_report_at_exit_();
+    static void save_counters_(fstream& out_json, vector<tomo_counters>& counters);
+
+    public:
+
+    static void add_bytes_read(uint64_t bytes){ bytes_read_ += bytes; }
+    static void add_bytes_written(uint64_t bytes){ bytes_written_ += bytes; }
+    static uint64_t bytes_read(void){ return bytes_read_; }
+    static uint64_t bytes_written(void){ return bytes_written_; }
+
+    static double wall_seconds(void);
+    static double cpu_seconds(void);
+    static long rss_current(void);
+    static long rss_peak(void);
+    static void reset_rss_peak(void);
+    // the rss peak of a stage from begin to end, with one watermark for the process : the peak so far
+    //      goes to the stages still running before every reset, so the enclosing ones keep it
+    static void begin_rss_peak(long* peak);
+    static void end_rss_peak(long* peak);
+
+    static void begin(const char* stage);
+    static void record(tomo_stage_record& record);
+    static vector<tomo_stage_record> records(void);
+
+    static bool save_json(const char* address);
+    // the report is written when the program exits, however it exits
+    static void set_report(const char* address);
+    static void start_heartbeat(const char* address, int interval_seconds = 10);
+};
+
+// measures from construction to destruction, and shows up in the trace when it's enabled
+class tomo_stage{
+
+    tomo_trace_scope trace_;
+    tomo_stage_record record_;
+    double wall_start_;
+    double cpu_start_;
+    uint64_t bytes_read_start_;
+    uint64_t bytes_written_start_;
+    uint64_t allocations_start_;
+    uint64_t bytes_allocated_start_;
+    vector<tomo_counters> counters_start_;
+
+    public:
+
+    // name : string literal
+    tomo_stage(const char* name, double voxels = 0.0);
+    ~tomo_stage();
+
+    void add_voxels(double voxels){ this->record_.voxels += voxels; }
+};
+
+#endif // TOMO_METRICS
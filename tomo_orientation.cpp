@@ -0,0 +1,73 @@
+#include "tomo_orientation.h"
+#include "tomo_metrics.h"
+#include "tomo_trace.h"
+
+static bool write_slice(FILE *out_raw, vector< vector<uint32_t> > &slice){
+    for(int y=0;y<slice.size();++y){
+        if(slice[y].size() > 0 && fwrite(&slice[y][0], sizeof(uint32_t), slice[y].size(), out_raw) != slice[y].size())
+            return false;
+        tomo_metrics::add_bytes_written( slice[y].size() * sizeof(uint32_t) );
+    }
+    return true;
+}
+
+bool tomo_orientation::save_raw(const char *address, vector< vector< vector<uint32_t> > > &orientation){
+
+    FILE *out_raw = fopen(address, "wb");
+    if(out_raw == NULL){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+    for(int i=0;i<orientation.size();++i){
+        if(write_slice(out_raw, orientation[i]) == false){
+            cerr << "ERROR : cannot write " << address <<endl;
+            fclose(out_raw);
+            return false;
+        }
+    }
+    fclose(out_raw);
+
+    return true;
+}
+
+tomo_orientation_sink::tomo_orientation_sink(const char *prefix){
+
+    // keep the absolute address, the working directory keeps changing
+    this->prefix_ = absolute_address(prefix);
+    this->size_z_ = 0;
+
+    string address = this->prefix_ + ".raw";
+    this->raw_ = fopen(address.c_str(), "wb");
+    if(this->raw_ == NULL){
+        cerr << "ERROR : cannot open " << address <<endl;
+        exit(-1);
+    }
+}
+
+tomo_orientation_sink::~tomo_orientation_sink(){
+    if(this->raw_ != NULL)
+        fclose(this->raw_);
+}
+
+void tomo_orientation_sink::orientation_slice(int index_z, vector< vector<uint32_t> > &slice){
+
+    tomo_trace_scope trace("orientation_slice", index_z);
+
+    if(index_z != this->size_z_){
+        cerr << "ERROR : orientation expects slice " << this->size_z_ << ", got " << index_z <<endl;
+        exit(-1);
+    }
+    if(write_slice(this->raw_, slice) == false){
+        cerr << "ERROR : cannot write " << this->prefix_ << ".raw" <<endl;
+        exit(-1);
+    }
+    ++this->size_z_;
+
+    return;
+}
+
+void tomo_orientation_sink::finish(float /*normalized*/){
+    fclose(this->raw_);
+    this->raw_ = NULL;
+    return;
+}
@@ -0,0 +1,71 @@
+#ifndef TOMO_ORIENTATION
+#define TOMO_ORIENTATION
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include "tomo_tiff.h"
+
+using namespace std;
+
+// orientation of the neurite : the eigen vector of the smallest eigen value of the tensor, 4 bytes per voxel
+//      the sign of an eigen vector means nothing, the one kept has z >= 0, it is projected on the
+//      octahedron |x|+|y|+|z| = 1 & its x & y stored as int16, u in the low bits, z = 1 - |u| - |v|
+//      prefix.raw : the uint32 of every voxel, x fastest, the eigen values go with -s or the sinks
+
+inline uint32_t tomo_orientation_encode(float x, float y, float z){
+
+    if(z < 0.0f || (z == 0.0f && (y < 0.0f || (y == 0.0f && x < 0.0f)))){
+        x = -x; y = -y; z = -z;
+    }
+    float norm = fabs(x) + fabs(y) + fabs(z);
+    if(norm == 0.0f)
+        return 0;
+    float u = x / norm, v = y / norm;
+    int16_t u16 = (int16_t)lrintf( fmaxf(-1.0f, fminf(1.0f, u)) * 32767.0f );
+    int16_t v16 = (int16_t)lrintf( fmaxf(-1.0f, fminf(1.0f, v)) * 32767.0f );
+
+    return (uint32_t)(uint16_t)u16 | ((uint32_t)(uint16_t)v16 << 16);
+}
+
+inline void tomo_orientation_decode(uint32_t code, float* xyz){
+
+    float u = (int16_t)(code & 0xffff) / 32767.0f;
+    float v = (int16_t)(code >> 16) / 32767.0f;
+    float z = fmaxf(0.0f, 1.0f - fabs(u) - fabs(v));
+    float norm = sqrtf(u*u + v*v + z*z);
+    if(norm == 0.0f)
+        norm = 1.0f;
+    xyz[0] = u / norm;
+    xyz[1] = v / norm;
+    xyz[2] = z / norm;
+
+    return;
+}
+
+class tomo_orientation{
+
+    public:
+
+    static bool save_raw(const char* address, vector< vector< vector<uint32_t> > >& orientation);
+};
+
+// streaming : appends every slice to prefix.raw as it comes
+class tomo_orientation_sink : public tomo_slice_sink{
+
+    string prefix_;
+    int size_z_;
+    FILE *raw_;
+
+    public:
+
+    // prefix : relative to the working directory at construction
+    tomo_orientation_sink(const char* prefix);
+    ~tomo_orientation_sink();
+
+    void orientation_slice(int index_z, vector< vector<uint32_t> >& slice);
+    void finish(float normalized);
+};
+
+#endif // TOMO_ORIENTATION
@@ -0,0 +1,224 @@
+#include "tomo_peaks.h"
+#include "tomo_metrics.h"
+#include "tomo_trace.h"
+#include <algorithm>
+
+tomo_peak_options::tomo_peak_options(){
+    this->radius = 1;
+    this->minimum = 0.0;
+    this->top = 0;
+    this->binary = false;
+}
+
+bool tomo_peak_options::parse(const char *spec){
+
+    vector< pair<string,string> > items;
+    if(parse_spec(spec, this->prefix, items) == false)
+        return false;
+    if(this->prefix.empty()){
+        cerr << "ERROR : peaks need a prefix" <<endl;
+        return false;
+    }
+
+    for(int i=0;i<items.size();++i){
+        string &key = items[i].first;
+        string &value = items[i].second;
+
+        if(key == "radius")
+            this->radius = atoi(value.c_str());
+        else if(key == "min")
+            this->minimum = atof(value.c_str());
+        else if(key == "top")
+            this->top = atoi(value.c_str());
+        else if(key == "format" && (value == "csv" || value == "binary"))
+            this->binary = value == "binary";
+        else{
+            cerr << "ERROR : unknown key " << key << "=" << value <<endl;
+            return false;
+        }
+    }
+
+    if(this->radius < 1 || this->top < 0){
+        cerr << "ERROR : radius " << this->radius << " & top " << this->top << " not handled!" <<endl;
+        return false;
+    }
+
+    return true;
+}
+
+void tomo_peaks::find_in_slice(vector< vector< vector<float> >* > &window, int index_z,
+                               const tomo_peak_options &options, float scale, tomo_peak_heap &heap){
+
+    int radius = options.radius;
+    vector< vector<float> > &slice = *window[radius];
+    int size_y = slice.size();
+    int size_x = size_y > 0 ? slice[0].size() : 0;
+
+    for(int y=0;y<size_y;++y){
+        for(int x=0;x<size_x;++x){
+            float value = slice[y][x] * scale;
+            if(value < options.minimum)
+                continue;
+
+            bool peak = true;
+            for(int dz=-radius;dz<=radius && peak;++dz){
+                if(window[radius+dz] == NULL)
+                    continue;
+                vector< vector<float> > &neighbours = *window[radius+dz];
+                for(int dy=-radius;dy<=radius && peak;++dy){
+                    int ny = y+dy;
+                    if(ny < 0 || ny >= size_y)
+                        continue;
+                    for(int dx=-radius;dx<=radius;++dx){
+                        int nx = x+dx;
+                        if(nx < 0 || nx >= size_x)
+                            continue;
+                        float neighbour = neighbours[ny][nx] * scale;
+                        bool before = dz < 0 || (dz == 0 && (dy < 0 || (dy == 0 && dx < 0)));
+                        if(neighbour > value || (neighbour == value && before)){
+                            peak = false;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if(peak){
+                tomo_peak found = {x, y, index_z, value};
+                heap.push(found);
+            }
+        }
+    }
+
+    return;
+}
+
+void tomo_peaks::find(vector< vector< vector<float> > > &measure, float scale,
+                      const tomo_peak_options &options, vector<tomo_peak> &peaks){
+
+    int size_z = measure.size();
+    tomo_peak_heap heap(options.top);
+
+    #pragma omp parallel
+    {
+        tomo_peak_heap heap_thread(options.top);
+        vector< vector< vector<float> >* > window(2*options.radius + 1);
+
+        #pragma omp for schedule(dynamic)
+        for(int z=0;z<size_z;++z){
+            for(int dz=-options.radius;dz<=options.radius;++dz){
+                window[options.radius+dz] = z+dz >= 0 && z+dz < size_z ? &measure[z+dz] : NULL;
+            }
+            find_in_slice(window, z, options, scale, heap_thread);
+        }
+
+        #pragma omp critical
+        heap.merge(heap_thread);
+    }
+
+    heap.sorted(peaks);
+
+    return;
+}
+
+bool tomo_peaks::save(const tomo_peak_options &options, vector<tomo_peak> &peaks, int size_x, int size_y, int size_z){
+
+    if(options.binary){
+        string address = options.prefix + ".bin";
+        FILE *out_peaks = fopen(address.c_str(), "wb");
+        if(out_peaks == NULL){
+            cerr << "ERROR : cannot open " << address <<endl;
+            return false;
+        }
+        for(int i=0;i<peaks.size();++i){
+            int32_t xyz[3] = {peaks[i].x, peaks[i].y, peaks[i].z};
+            fwrite(xyz, sizeof(int32_t), 3, out_peaks);
+            fwrite(&peaks[i].score, sizeof(float), 1, out_peaks);
+        }
+        fclose(out_peaks);
+        tomo_metrics::add_bytes_written( (uint64_t)peaks.size() * (3*sizeof(int32_t) + sizeof(float)) );
+        return true;
+    }
+
+    string address = options.prefix + ".csv";
+    fstream out_peaks(address.c_str(), fstream::out);
+    if(out_peaks.is_open() == false){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+    out_peaks << "# xyz-size " << size_x << " " << size_y << " " << size_z <<endl;
+    out_peaks << "x,y,z,score" <<endl;
+    out_peaks << scientific << setprecision(8);
+    for(int i=0;i<peaks.size();++i){
+        out_peaks << peaks[i].x << "," << peaks[i].y << "," << peaks[i].z << "," << peaks[i].score <<endl;
+    }
+    tomo_metrics::add_bytes_written( out_peaks.tellp() );
+    out_peaks.close();
+
+    return true;
+}
+
+tomo_peak_sink::tomo_peak_sink(const tomo_peak_options &options) : heap_(options.top){
+
+    this->options_ = options;
+    // keep the absolute address, the working directory keeps changing
+    this->options_.prefix = absolute_address(options.prefix.c_str());
+    this->size_x_ = 0;
+    this->size_y_ = 0;
+    this->size_z_ = 0;
+    this->ring_.resize(2*options.radius + 1);
+}
+
+void tomo_peak_sink::find_(int index_z){
+
+    tomo_trace_scope trace("peaks_slice", index_z);
+
+    int radius = this->options_.radius;
+    vector< vector< vector<float> >* > window(2*radius + 1);
+    for(int dz=-radius;dz<=radius;++dz){
+        int z = index_z + dz;
+        window[radius+dz] = z >= 0 && z < this->size_z_ ? &this->ring_[z % this->ring_.size()] : NULL;
+    }
+    tomo_peaks::find_in_slice(window, index_z, this->options_, 1.0, this->heap_);
+
+    return;
+}
+
+void tomo_peak_sink::measure_slice(int index_z, vector< vector<float> > &slice){
+
+    if(index_z != this->size_z_){
+        cerr << "ERROR : peaks expect slice " << this->size_z_ << ", got " << index_z <<endl;
+        exit(-1);
+    }
+    if(index_z == 0){
+        this->size_y_ = slice.size();
+        this->size_x_ = slice.size() > 0 ? slice[0].size() : 0;
+    }
+
+    this->ring_[index_z % this->ring_.size()] = slice;
+    ++this->size_z_;
+
+    //the slice radius before has all its neighbours now
+    if(index_z - this->options_.radius >= 0)
+        this->find_(index_z - this->options_.radius);
+
+    return;
+}
+
+void tomo_peak_sink::finish(float /*normalized*/){
+
+    tomo_stage stage("peaks", (double)this->size_x_ * this->size_y_ * this->size_z_);
+
+    //the last slices, nothing after them
+    for(int z=this->size_z_ - this->options_.radius;z<this->size_z_;++z){
+        if(z >= 0)
+            this->find_(z);
+    }
+
+    vector<tomo_peak> peaks;
+    this->heap_.sorted(peaks);
+    cout << peaks.size() << " peaks" <<endl;
+    tomo_peaks::save(this->options_, peaks, this->size_x_, this->size_y_, this->size_z_);
+
+    return;
+}
@@ -0,0 +1,147 @@
+#ifndef TOMO_PEAKS
+#define TOMO_PEAKS
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "tomo_tiff.h"
+
+using namespace std;
+
+// local maxima of the measure : the candidate neurons
+//      a peak is >= minimum and >= every voxel of the (2 radius + 1)^3 cube around it,
+//      strictly > those met before it (x, then y, then z) so a plateau gives a single peak
+//      prefix.csv : x,y,z,score sorted by score, the best first
+//      prefix.bin : the same as int32 x, y, z & float score records, 16 bytes each
+
+// the candidates of a local maxima search, here & in tomo_somata.h : int x, y, z & float score
+//      -1 when a is better, higher score first, then the scan order, 0 when they tie
+template<class T>
+inline int tomo_compare_candidates(const T& a, const T& b){
+    if(a.score != b.score)
+        return a.score > b.score ? -1 : 1;
+    if(a.z != b.z)
+        return a.z < b.z ? -1 : 1;
+    if(a.y != b.y)
+        return a.y < b.y ? -1 : 1;
+    if(a.x != b.x)
+        return a.x < b.x ? -1 : 1;
+    return 0;
+}
+
+class tomo_peak{
+
+    public:
+
+    int x;
+    int y;
+    int z;
+    float score;
+
+    bool better(const tomo_peak& b) const{
+        return tomo_compare_candidates(*this, b) < 0;
+    }
+};
+
+class tomo_peak_options{
+
+    public:
+
+    string prefix;
+    int radius;
+    float minimum;  // in the units before normalization
+    int top;        // the best top peaks only, 0 keeps them all
+    bool binary;
+
+    tomo_peak_options();
+
+    // spec : prefix[:key=value,...] with the keys radius, min, top & format=csv|binary,
+    //        e.g. peaks:radius=2,min=0.5,top=10000
+    bool parse(const char* spec);
+};
+
+// the best top candidates seen so far, a min-heap on T::better, every one of them when top is 0
+template<class T>
+class tomo_best_heap{
+
+    int top_;
+    vector<T> candidates_;
+
+    static bool better_(const T& a, const T& b){ return a.better(b); }
+
+    public:
+
+    tomo_best_heap(int top = 0){this->top_ = top;}
+
+    void push(const T& candidate){
+        if(this->top_ <= 0){
+            this->candidates_.push_back(candidate);
+            return;
+        }
+        //better as the order of the heap keeps the worst one at the front
+        if(this->candidates_.size() < this->top_){
+            this->candidates_.push_back(candidate);
+            push_heap(this->candidates_.begin(), this->candidates_.end(), better_);
+        }else if(candidate.better(this->candidates_.front())){
+            pop_heap(this->candidates_.begin(), this->candidates_.end(), better_);
+            this->candidates_.back() = candidate;
+            push_heap(this->candidates_.begin(), this->candidates_.end(), better_);
+        }
+    }
+    void merge(tomo_best_heap& heap){
+        for(int i=0;i<heap.candidates_.size();++i){
+            this->push(heap.candidates_[i]);
+        }
+        heap.candidates_.clear();
+    }
+    // sorted, the best first, the heap is left empty
+    void sorted(vector<T>& candidates){
+        candidates.swap(this->candidates_);
+        this->candidates_.clear();
+        sort(candidates.begin(), candidates.end(), better_);
+    }
+};
+
+typedef tomo_best_heap<tomo_peak> tomo_peak_heap;
+
+class tomo_peaks{
+
+    public:
+
+    // the peaks of one slice
+    //      window : the 2 radius + 1 slices around it, window[radius] is the slice, NULL outside the volume
+    //      scale : the measure is multiplied by it first, the normalization for tomo_super_tiff
+    static void find_in_slice(vector< vector< vector<float> >* >& window, int index_z,
+                              const tomo_peak_options& options, float scale, tomo_peak_heap& heap);
+
+    // in memory, the slices in parallel, each thread with its own heap
+    static void find(vector< vector< vector<float> > >& measure, float scale,
+                     const tomo_peak_options& options, vector<tomo_peak>& peaks);
+
+    static bool save(const tomo_peak_options& options, vector<tomo_peak>& peaks, int size_x, int size_y, int size_z);
+};
+
+// streaming : keeps the last 2 radius + 1 slices, a slice is searched once the radius after it is there
+class tomo_peak_sink : public tomo_slice_sink{
+
+    tomo_peak_options options_;
+    int size_x_;
+    int size_y_;
+    int size_z_;
+
+    vector< vector< vector<float> > > ring_;    // slice z at z % ring_.size()
+    tomo_peak_heap heap_;
+
+    void find_(int index_z);
+
+    public:
+
+    // options.prefix : relative to the working directory at construction
+    tomo_peak_sink(const tomo_peak_options& options);
+
+    void measure_slice(int index_z, vector< vector<float> >& slice);
+    void finish(float normalized);
+};
+
+#endif // TOMO_PEAKS
@@ -0,0 +1,96 @@
+#include "tomo_perf.h"
+#include <cstring>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#include <omp.h>
+
+bool tomo_perf::enabled_ = false;
+
+// file descriptors of the calling thread, -2 until opened, -1 when not available
+static thread_local int perf_fds[TOMO_PERF_SIZE] = { -2, -2, -2, -2 };
+
+static int perf_event_open(uint32_t type, uint64_t config){
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    //this thread, any cpu
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void perf_open_thread(void){
+
+    if(perf_fds[0] != -2)
+        return;
+
+    perf_fds[TOMO_PERF_CYCLES] = perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    perf_fds[TOMO_PERF_INSTRUCTIONS] = perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    perf_fds[TOMO_PERF_LLC_MISSES] = perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    perf_fds[TOMO_PERF_BRANCH_MISSES] = perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+    return;
+}
+
+static void perf_read_thread(tomo_counters &counters){
+
+    perf_open_thread();
+
+    for(int i=0;i<TOMO_PERF_SIZE;++i){
+        uint64_t data[3] = {0, 0, 0}; // value, time enabled, time running
+        if( perf_fds[i] < 0 || read(perf_fds[i], data, sizeof(data)) != sizeof(data) ){
+            counters.available[i] = false;
+            counters.value[i] = 0;
+            continue;
+        }
+        //scale it up when the pmu was multiplexed
+        if(data[2] > 0 && data[2] < data[1])
+            data[0] = (uint64_t)( (double)data[0] * (double)data[1] / (double)data[2] );
+        counters.available[i] = true;
+        counters.value[i] = data[0];
+    }
+
+    return;
+}
+
+const char* tomo_perf::name(int counter){
+    static const char* names[TOMO_PERF_SIZE] = { "cycles", "instructions", "llc_misses", "branch_misses" };
+    return names[counter];
+}
+
+void tomo_perf::snapshot(vector<tomo_counters> &counters){
+
+    counters.assign(omp_get_max_threads(), tomo_counters());
+
+    #pragma omp parallel
+    {
+        int index_thread = omp_get_thread_num();
+        if(index_thread < counters.size())
+            perf_read_thread(counters[index_thread]);
+    }
+
+    return;
+}
+
+void tomo_perf::difference(vector<tomo_counters> &start, vector<tomo_counters> &end, vector<tomo_counters> &result){
+
+    result.assign(end.size(), tomo_counters());
+
+    for(int t=0;t<end.size();++t){
+        for(int i=0;i<TOMO_PERF_SIZE;++i){
+            bool available = t < start.size() && start[t].available[i] && end[t].available[i];
+            result[t].available[i] = available;
+            result[t].value[i] = available && end[t].value[i] > start[t].value[i] ? end[t].value[i] - start[t].value[i] : 0;
+        }
+    }
+
+    return;
+}
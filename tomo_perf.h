@@ -0,0 +1,62 @@
+#ifndef TOMO_PERF
+#define TOMO_PERF
+
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+// hardware performance counters through linux perf_event_open
+//      every OpenMP thread counts for itself, a stage reads all of them before and after,
+//      counters which cannot be opened (no permission, no pmu in a vm...) are reported as unavailable
+
+enum{ TOMO_PERF_CYCLES, TOMO_PERF_INSTRUCTIONS, TOMO_PERF_LLC_MISSES, TOMO_PERF_BRANCH_MISSES, TOMO_PERF_SIZE };
+
+class tomo_counters{
+
+    public:
+
+    bool available[TOMO_PERF_SIZE];
+    uint64_t value[TOMO_PERF_SIZE];
+
+    tomo_counters(){
+        for(int i=0;i<TOMO_PERF_SIZE;++i){
+            this->available[i] = false;
+            this->value[i] = 0;
+        }
+    }
+
+    void operator +=(const tomo_counters& b){
+        for(int i=0;i<TOMO_PERF_SIZE;++i){
+            this->available[i] = this->available[i] || b.available[i];
+            this->value[i] += b.value[i];
+        }
+    }
+
+    bool any_available(void) const{
+        for(int i=0;i<TOMO_PERF_SIZE;++i){
+            if(this->available[i])
+                return true;
+        }
+        return false;
+    }
+};
+
+class tomo_perf{
+
+    static bool enabled_;
+
+    public:
+
+    static const char* name(int counter);
+
+    static void enable(bool enabled = true){ enabled_ = enabled; }
+    static bool enabled(void){ return enabled_; }
+
+    // current values of every thread of the OpenMP team, opened on the first call
+    static void snapshot(vector<tomo_counters>& counters);
+    // end - start per thread
+    static void difference(vector<tomo_counters>& start, vector<tomo_counters>& end, vector<tomo_counters>& result);
+};
+
+#endif // TOMO_PERF
@@ -0,0 +1,270 @@
+#include "tomo_plan.h"
+#include <tiffio.h>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cctype>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+#include <omp.h>
+
+tomo_plan::tomo_plan(){
+    this->size_x = 0;
+    this->size_y = 0;
+    this->size_z = 0;
+    this->bits_per_sample = 16;
+    this->window_size = 5;
+    this->number_scales = 1;
+    this->threads = omp_get_max_threads();
+    this->memory_budget = physical_memory() / 4 * 3;
+    this->filter_slices = 0.0;
+    this->filter_halo_xy = 0;
+    this->filter_halo_z = 0;
+    this->mode = TOMO_PLAN_IN_MEMORY;
+    for(int m=0;m<3;++m){
+        this->output_bytes[m] = 0.0;
+        this->bytes[m] = 0;
+        this->seconds[m] = 0.0;
+    }
+}
+
+bool tomo_plan::read_headers(const string &prefix, vector<string> &address_tiffs){
+
+    int size_x = 0;
+    int size_y = 0;
+    int bits_per_sample = 8;
+
+    for(int i=0;i<address_tiffs.size();++i){
+        string address = address_tiffs[i];
+        if(address.empty() == false && address[0] != '/' && prefix.empty() == false)
+            address = prefix + "/" + address;
+
+        TIFF *tif = TIFFOpen(address.c_str(), "r");
+        if(tif == NULL){
+            cerr << "ERROR : cannot open " << address <<endl;
+            return false;
+        }
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint16_t bits = 8;
+        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &height);
+        TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bits);
+        TIFFClose(tif);
+
+        size_x = size_x > (int)width ? size_x : (int)width;
+        size_y = size_y > (int)height ? size_y : (int)height;
+        bits_per_sample = bits_per_sample > bits ? bits_per_sample : bits;
+    }
+
+    this->set_dimensions(size_x, size_y, address_tiffs.size(), bits_per_sample);
+    return true;
+}
+
+bool tomo_plan::read_filelist(const char *address_filelist){
+
+    fstream in_filelist(address_filelist, fstream::in);
+    if(in_filelist.is_open() == false){
+        cerr << "ERROR : cannot open " << address_filelist <<endl;
+        return false;
+    }
+
+    int size_tiffs = -1;
+    string prefix;
+    in_filelist >> size_tiffs >> prefix;
+    if(size_tiffs < 0){
+        cerr << "ERROR : cannot read " << address_filelist <<endl;
+        return false;
+    }
+    vector<string> address_tiffs(size_tiffs);
+    for(int i=0;i<size_tiffs;++i){
+        in_filelist >> address_tiffs[i];
+    }
+    in_filelist.close();
+
+    return this->read_headers(prefix, address_tiffs);
+}
+
+void tomo_plan::set_dimensions(int size_x, int size_y, int size_z, int bits_per_sample){
+    this->size_x = size_x;
+    this->size_y = size_y;
+    this->size_z = size_z;
+    this->bits_per_sample = bits_per_sample;
+    return;
+}
+
+void tomo_plan::add_output(double in_memory, double slab, double out_of_core){
+    this->output_bytes[TOMO_PLAN_IN_MEMORY] += in_memory;
+    this->output_bytes[TOMO_PLAN_SLAB] += slab;
+    this->output_bytes[TOMO_PLAN_OUT_OF_CORE] += out_of_core;
+    return;
+}
+
+void tomo_plan::add_filter(int radius_xy, int radius_z, int buffers){
+    this->filter_slices += 2.0 * radius_z + 1.0 + buffers;
+    this->filter_halo_xy += radius_xy;
+    this->filter_halo_z += radius_z;
+    return;
+}
+
+tomo_roi tomo_plan::read_box(const tomo_roi &roi){
+    return roi.grown(this->halo() + this->filter_halo_xy, this->halo() + this->filter_halo_z,
+                     this->size_x, this->size_y, this->size_z);
+}
+
+int tomo_plan::choose(void){
+
+    double size_slice = (double)this->size_x * (double)this->size_y;
+    double size_volume = size_slice * (double)this->size_z;
+    double window = (double)this->window_size;
+
+    //in memory : everything of every slice
+    this->bytes[TOMO_PLAN_IN_MEMORY] = (uint64_t)( size_volume *
+            (TOMO_PLAN_BYTES_SLICE + 2 * TOMO_PLAN_BYTES_MATRIX + TOMO_PLAN_BYTES_EIGEN_VALUES + TOMO_PLAN_BYTES_MEASURE) );
+    //several scales : the measure & eigen values of the best scale so far on top
+    if(this->number_scales > 1)
+        this->bytes[TOMO_PLAN_IN_MEMORY] += (uint64_t)( size_volume * (TOMO_PLAN_BYTES_EIGEN_VALUES + TOMO_PLAN_BYTES_MEASURE) );
+    //slab : gradient of window_size slices & tensor of one
+    this->bytes[TOMO_PLAN_SLAB] = (uint64_t)( size_volume * (TOMO_PLAN_BYTES_SLICE + TOMO_PLAN_BYTES_EIGEN_VALUES + TOMO_PLAN_BYTES_MEASURE) +
+            size_slice * (window + 1.0) * TOMO_PLAN_BYTES_MATRIX );
+    //out of core : window_size+4 slices, the rest for one slice
+    this->bytes[TOMO_PLAN_OUT_OF_CORE] = (uint64_t)( size_slice * ( (window + 4.0) * TOMO_PLAN_BYTES_SLICE +
+            (window + 1.0) * TOMO_PLAN_BYTES_MATRIX + TOMO_PLAN_BYTES_EIGEN_VALUES + TOMO_PLAN_BYTES_MEASURE ) );
+    //the outputs asked for & the pre-filters
+    for(int m=TOMO_PLAN_IN_MEMORY;m<=TOMO_PLAN_OUT_OF_CORE;++m){
+        this->bytes[m] += (uint64_t)( size_volume * this->output_bytes[m] + size_slice * this->filter_slices * TOMO_PLAN_BYTES_SLICE );
+    }
+
+    double seconds_compute = size_volume * ( window * window * window * TOMO_PLAN_SECONDS_PER_TAP + TOMO_PLAN_SECONDS_PER_VOXEL ) * this->number_scales;
+    seconds_compute /= this->threads > 0 ? this->threads : 1;
+    double seconds_read = size_volume * ( this->bits_per_sample / 8 ) / TOMO_PLAN_DISK_BYTES_PER_SECOND;
+    //measurement/%d.tif are written, read back & written again when renormalized
+    double seconds_measurement = 3.0 * size_volume * 2.0 / TOMO_PLAN_DISK_BYTES_PER_SECOND;
+
+    this->seconds[TOMO_PLAN_IN_MEMORY] = seconds_compute + seconds_read;
+    this->seconds[TOMO_PLAN_SLAB] = seconds_compute + seconds_read;
+    this->seconds[TOMO_PLAN_OUT_OF_CORE] = seconds_compute + seconds_read + seconds_measurement;
+
+    this->mode = TOMO_PLAN_OUT_OF_CORE;
+    for(int m=TOMO_PLAN_IN_MEMORY;m<TOMO_PLAN_OUT_OF_CORE;++m){
+        if(this->bytes[m] <= this->memory_budget){
+            this->mode = m;
+            break;
+        }
+    }
+
+    return this->mode;
+}
+
+void tomo_plan::print(ostream &out){
+
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+
+    out << "volume " << this->size_x << " x " << this->size_y << " x " << this->size_z
+        << ", " << this->bits_per_sample << " bits, window_size " << this->window_size
+        << ( this->number_scales > 1 ? " (largest of the scales)" : "" )
+        << ", " << this->threads << " threads" <<endl;
+    out << "memory budget " << fixed << setprecision(1) << (double)this->memory_budget / (1<<20) << " MB" <<endl;
+    for(int m=TOMO_PLAN_IN_MEMORY;m<=TOMO_PLAN_OUT_OF_CORE;++m){
+        out << (m == this->mode ? "* " : "  ") << left << setw(12) << name(m)
+            << right << setw(12) << setprecision(1) << (double)this->bytes[m] / (1<<20) << " MB"
+            << setw(12) << setprecision(1) << this->seconds[m] << " s"
+            << ( this->bytes[m] > this->memory_budget ? "  over budget" : "" ) <<endl;
+    }
+    if(this->bytes[TOMO_PLAN_OUT_OF_CORE] > this->memory_budget)
+        out << "even out of core is over budget" <<endl;
+
+    out.flags(flags);
+    out.precision(precision);
+    return;
+}
+
+const char* tomo_plan::name(int mode){
+    static const char* names[3] = { "in_memory", "slab", "out_of_core" };
+    return names[mode];
+}
+
+uint64_t tomo_plan::parse_bytes(const char *text){
+
+    char *end = NULL;
+    double number = strtod(text, &end);
+    switch( toupper(*end) ){
+    case 'K': number *= 1024.0; break;
+    case 'M': number *= 1024.0 * 1024.0; break;
+    case 'G': number *= 1024.0 * 1024.0 * 1024.0; break;
+    case 'T': number *= 1024.0 * 1024.0 * 1024.0 * 1024.0; break;
+    default: break;
+    }
+    return number > 0.0 ? (uint64_t)number : 0;
+}
+
+uint64_t tomo_plan::physical_memory(void){
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if(pages <= 0 || page_size <= 0)
+        return (uint64_t)1 << 32;
+    return (uint64_t)pages * (uint64_t)page_size;
+}
+
+static bool parse_range(const string &text, int &begin, int &end){
+
+    size_t colon = text.find(':');
+    if(colon == string::npos)
+        return false;
+    string text_begin = text.substr(0, colon);
+    string text_end = text.substr(colon+1);
+    begin = text_begin.empty() ? 0 : atoi(text_begin.c_str());
+    end = text_end.empty() ? -1 : atoi(text_end.c_str());
+    return begin >= 0 && (end < 0 || end > begin);
+}
+
+bool tomo_roi::parse(const char *text){
+
+    string ranges[3];
+    stringstream list(text);
+    for(int i=0;i<3;++i){
+        if(!getline(list, ranges[i], ',')){
+            cerr << "ERROR : roi " << text << " : x0:x1,y0:y1,z0:z1 expected" <<endl;
+            return false;
+        }
+    }
+    if( parse_range(ranges[0], this->x0, this->x1) == false ||
+            parse_range(ranges[1], this->y0, this->y1) == false ||
+            parse_range(ranges[2], this->z0, this->z1) == false ){
+        cerr << "ERROR : roi " << text << " : x0:x1,y0:y1,z0:z1 expected" <<endl;
+        return false;
+    }
+    return true;
+}
+
+tomo_roi tomo_roi::clipped(int size_x, int size_y, int size_z) const{
+    tomo_roi roi;
+    roi.x0 = min(this->x0, size_x);
+    roi.y0 = min(this->y0, size_y);
+    roi.z0 = min(this->z0, size_z);
+    roi.x1 = this->x1 < 0 ? size_x : min(this->x1, size_x);
+    roi.y1 = this->y1 < 0 ? size_y : min(this->y1, size_y);
+    roi.z1 = this->z1 < 0 ? size_z : min(this->z1, size_z);
+    return roi;
+}
+
+tomo_roi tomo_roi::grown(int halo_xy, int halo_z, int size_x, int size_y, int size_z) const{
+    tomo_roi roi = this->clipped(size_x, size_y, size_z);
+    roi.x0 = max(roi.x0 - halo_xy, 0);
+    roi.y0 = max(roi.y0 - halo_xy, 0);
+    roi.z0 = max(roi.z0 - halo_z, 0);
+    roi.x1 = min(roi.x1 + halo_xy, size_x);
+    roi.y1 = min(roi.y1 + halo_xy, size_y);
+    roi.z1 = min(roi.z1 + halo_z, size_z);
+    return roi;
+}
+
+tomo_roi tomo_roi::relative(const tomo_roi &b) const{
+    tomo_roi roi = *this;
+    roi.x0 -= b.x0; roi.x1 -= b.x0;
+    roi.y0 -= b.y0; roi.y1 -= b.y0;
+    roi.z0 -= b.z0; roi.z1 -= b.z0;
+    return roi;
+}
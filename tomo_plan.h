@@ -0,0 +1,113 @@
+#ifndef TOMO_PLAN
+#define TOMO_PLAN
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+// memory planner : picks how neuron_detection runs from the real dimensions and a memory budget
+//      in memory   : every intermediate of every slice is kept
+//      slab        : slices, eigen values & measurement are kept, gradient & tensor stream through a window of slices
+//      out of core : only the window of slices is kept, the measurement goes to measurement/%d.tif
+
+// region of interest, [x0,x1) x [y0,y1) x [z0,z1), an end of -1 is the end of the volume
+class tomo_roi{
+
+    public:
+
+    int x0, x1;
+    int y0, y1;
+    int z0, z1;
+
+    tomo_roi(){
+        this->x0 = this->y0 = this->z0 = 0;
+        this->x1 = this->y1 = this->z1 = -1;
+    }
+
+    // x0:x1,y0:y1,z0:z1 , a missing end is the end of the volume, e.g. 100:300,:,20:
+    bool parse(const char* text);
+    bool whole(void) const{
+        return x0 == 0 && y0 == 0 && z0 == 0 && x1 < 0 && y1 < 0 && z1 < 0;
+    }
+    bool empty(void) const{
+        return x1 <= x0 || y1 <= y0 || z1 <= z0;
+    }
+    // the ends filled in and the region clipped to the volume
+    tomo_roi clipped(int size_x, int size_y, int size_z) const;
+    // halo_xy voxels more along x & y, halo_z slices along z, clipped to the volume
+    tomo_roi grown(int halo_xy, int halo_z, int size_x, int size_y, int size_z) const;
+    // relative to the corner of b
+    tomo_roi relative(const tomo_roi& b) const;
+
+    int size_x(void) const{ return x1 - x0; }
+    int size_y(void) const{ return y1 - y0; }
+    int size_z(void) const{ return z1 - z0; }
+};
+
+enum tomo_plan_mode{ TOMO_PLAN_IN_MEMORY, TOMO_PLAN_SLAB, TOMO_PLAN_OUT_OF_CORE };
+
+// bytes per voxel of the containers used by tomo_super_tiff, malloc overhead included
+#define TOMO_PLAN_BYTES_SLICE 4            // float
+#define TOMO_PLAN_BYTES_MATRIX 40          // matrix(3) : 3x3 floats inline & its size
+#define TOMO_PLAN_BYTES_EIGEN_VALUES 56    // vector<float>(3)
+#define TOMO_PLAN_BYTES_MEASURE 4          // float
+
+// rough single thread costs, measured with bench
+#define TOMO_PLAN_SECONDS_PER_TAP 1.3e-7   // tensor, per voxel & window voxel
+#define TOMO_PLAN_SECONDS_PER_VOXEL 6.0e-7 // gradient, eigen values & measurement
+#define TOMO_PLAN_DISK_BYTES_PER_SECOND 2.0e8
+
+class tomo_plan{
+
+    public:
+
+    int size_x;
+    int size_y;
+    int size_z;
+    int bits_per_sample;
+    int window_size;   // the largest one with several scales
+    int number_scales;
+    int threads;
+    uint64_t memory_budget; // bytes
+
+    double output_bytes[3]; // per voxel of the volume, what the outputs asked for keep on top, per mode
+    double filter_slices;   // slices the pre-filters keep, in every mode
+    int filter_halo_xy;     // how far the pre-filters read, one after the other
+    int filter_halo_z;
+
+    int mode;
+    uint64_t bytes[3];      // estimated peak per mode
+    double seconds[3];      // estimated time per mode
+
+    tomo_plan();
+
+    // reads the headers only, the largest slice is used for the estimation
+    bool read_headers(const string& prefix, vector<string>& address_tiffs);
+    bool read_filelist(const char* address_filelist);
+    void set_dimensions(int size_x, int size_y, int size_z, int bits_per_sample = 16);
+
+    // an output keeping bytes per voxel of the whole volume in each mode, before choose()
+    void add_output(double in_memory, double slab, double out_of_core);
+    // a pre-filter reading radius_xy voxels & 2 radius_z + 1 slices around & allocating buffers slices,
+    //      before choose() & read_box()
+    void add_filter(int radius_xy, int radius_z, int buffers);
+
+    // the gradient of the outermost tensor window needs one voxel more
+    int halo(void){ return this->window_size/2 + 1; }
+    // the part of the volume read for roi, the halo & the reach of the pre-filters included
+    tomo_roi read_box(const tomo_roi& roi);
+
+    // estimates every mode and picks the first one within the budget, out of core otherwise
+    int choose(void);
+    void print(ostream& out);
+
+    static const char* name(int mode);
+    // e.g. 2048, 512M, 16G
+    static uint64_t parse_bytes(const char* text);
+    static uint64_t physical_memory(void);
+};
+
+#endif // TOMO_PLAN
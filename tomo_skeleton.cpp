@@ -0,0 +1,355 @@
+#include "tomo_skeleton.h"
+#include "tomo_metrics.h"
+#include "tomo_trace.h"
+#include "tomo_distance.h"
+#include <queue>
+#include <unordered_map>
+
+#define TOMO_SKELETON_CENTER 13 // of the 3x3x3 cube, cell (dz+1)*9 + (dy+1)*3 + dx+1
+
+// adjacency inside the 3x3x3 cube around a voxel, the center left out
+class tomo_cube{
+
+    public:
+
+    int size26[27];
+    int adjacent26[27][26];
+    int size6[27];
+    int adjacent6[27][6];
+    bool in18[27];  // not a corner
+
+    tomo_cube(){
+        for(int a=0;a<27;++a){
+            int ax = a%3, ay = (a/3)%3, az = a/9;
+            this->size26[a] = this->size6[a] = 0;
+            this->in18[a] = a != TOMO_SKELETON_CENTER && (ax != 1) + (ay != 1) + (az != 1) < 3;
+            for(int b=0;b<27;++b){
+                int bx = b%3, by = (b/3)%3, bz = b/9;
+                int distance = abs(ax-bx) + abs(ay-by) + abs(az-bz);
+                if(a == b || a == TOMO_SKELETON_CENTER || b == TOMO_SKELETON_CENTER)
+                    continue;
+                if(abs(ax-bx) <= 1 && abs(ay-by) <= 1 && abs(az-bz) <= 1)
+                    this->adjacent26[a][ this->size26[a]++ ] = b;
+                if(distance == 1)
+                    this->adjacent6[a][ this->size6[a]++ ] = b;
+            }
+        }
+    }
+};
+
+static const tomo_cube& cube(void){
+    static tomo_cube cube;
+    return cube;
+}
+
+// face neighbours, the thinning directions
+static const int face_dx[6] = {-1, 1, 0, 0, 0, 0};
+static const int face_dy[6] = { 0, 0,-1, 1, 0, 0};
+static const int face_dz[6] = { 0, 0, 0, 0,-1, 1};
+
+void tomo_skeleton::begin(int size_x, int size_y){
+    this->size_x_ = size_x;
+    this->size_y_ = size_y;
+    this->size_z_ = 0;
+    this->voxels_.assign( (size_t)(size_x+2) * (size_y+2), 0 );
+    return;
+}
+
+void tomo_skeleton::add_slice(vector< vector<float> > &slice, float scale, float threshold){
+
+    ++this->size_z_;
+    size_t plane = (size_t)(this->size_x_+2) * (this->size_y_+2);
+    this->voxels_.resize( this->voxels_.size() + plane, 0 );
+    for(int y=0;y<this->size_y_;++y){
+        uint8_t *row = &this->voxels_[ this->index_(1, y+1, this->size_z_) ];
+        for(int x=0;x<this->size_x_;++x){
+            row[x] = slice[y][x] * scale >= threshold ? 1 : 0;
+        }
+    }
+
+    return;
+}
+
+void tomo_skeleton::end(void){
+    size_t plane = (size_t)(this->size_x_+2) * (this->size_y_+2);
+    this->voxels_.resize( this->voxels_.size() + plane, 0 );
+    return;
+}
+
+int tomo_skeleton::neighbours_(size_t index){
+    int stride_y = this->size_x_+2;
+    size_t stride_z = (size_t)stride_y * (this->size_y_+2);
+    int number = 0;
+    for(int dz=-1;dz<=1;++dz){
+        for(int dy=-1;dy<=1;++dy){
+            const uint8_t *row = &this->voxels_[ index + dz*stride_z + dy*stride_y ];
+            number += row[-1] + row[0] + row[1];
+        }
+    }
+    return number - this->voxels_[index];
+}
+
+// one 26-connected component of the foreground around & one 6-connected component of the
+// background touching a face
+bool tomo_skeleton::simple_(size_t index){
+
+    const tomo_cube &c = cube();
+    int stride_y = this->size_x_+2;
+    size_t stride_z = (size_t)stride_y * (this->size_y_+2);
+
+    uint8_t cell[27];
+    for(int dz=-1;dz<=1;++dz){
+        for(int dy=-1;dy<=1;++dy){
+            const uint8_t *row = &this->voxels_[ index + dz*stride_z + dy*stride_y ];
+            int a = (dz+1)*9 + (dy+1)*3;
+            cell[a] = row[-1];
+            cell[a+1] = row[0];
+            cell[a+2] = row[1];
+        }
+    }
+
+    int stack[27];
+    bool seen[27];
+
+    //foreground
+    fill(seen, seen+27, false);
+    int components = 0;
+    for(int a=0;a<27;++a){
+        if(a == TOMO_SKELETON_CENTER || cell[a] == 0 || seen[a])
+            continue;
+        if(++components > 1)
+            return false;
+        int size_stack = 0;
+        stack[size_stack++] = a;
+        seen[a] = true;
+        while(size_stack > 0){
+            int b = stack[--size_stack];
+            for(int n=0;n<c.size26[b];++n){
+                int d = c.adjacent26[b][n];
+                if(cell[d] != 0 && seen[d] == false){
+                    seen[d] = true;
+                    stack[size_stack++] = d;
+                }
+            }
+        }
+    }
+    if(components != 1)
+        return false;
+
+    //background, the components of the 18-neighbourhood that reach a face
+    fill(seen, seen+27, false);
+    components = 0;
+    for(int f=0;f<6;++f){
+        int a = (face_dz[f]+1)*9 + (face_dy[f]+1)*3 + face_dx[f]+1;
+        if(cell[a] != 0 || seen[a])
+            continue;
+        if(++components > 1)
+            return false;
+        int size_stack = 0;
+        stack[size_stack++] = a;
+        seen[a] = true;
+        while(size_stack > 0){
+            int b = stack[--size_stack];
+            for(int n=0;n<c.size6[b];++n){
+                int d = c.adjacent6[b][n];
+                if(c.in18[d] && cell[d] == 0 && seen[d] == false){
+                    seen[d] = true;
+                    stack[size_stack++] = d;
+                }
+            }
+        }
+    }
+
+    return components == 1;
+}
+
+size_t tomo_skeleton::thin_subfield_(int direction, int subfield){
+
+    int stride_y = this->size_x_+2;
+    size_t stride_z = (size_t)stride_y * (this->size_y_+2);
+    long face = face_dz[direction]*(long)stride_z + face_dy[direction]*stride_y + face_dx[direction];
+    int parity_x = subfield & 1, parity_y = (subfield >> 1) & 1, parity_z = (subfield >> 2) & 1;
+    size_t deleted = 0;
+
+    //no two voxels of a subfield see each other, deleting in place is the same in any order
+    #pragma omp parallel for schedule(dynamic) reduction(+:deleted)
+    for(int z=1+parity_z;z<=this->size_z_;z+=2){
+        for(int y=1+parity_y;y<=this->size_y_;y+=2){
+            for(int x=1+parity_x;x<=this->size_x_;x+=2){
+                size_t i = this->index_(x, y, z);
+                if(this->voxels_[i] == 0 || this->voxels_[i+face] != 0)
+                    continue;
+                if(this->neighbours_(i) <= 1 || this->simple_(i) == false)
+                    continue;
+                this->voxels_[i] = 0;
+                ++deleted;
+            }
+        }
+    }
+
+    return deleted;
+}
+
+void tomo_skeleton::measure_radii_(void){
+
+    size_t size_slice = (size_t)this->size_x_ * this->size_y_;
+    this->radii_.resize(size_slice * this->size_z_);
+
+    #pragma omp parallel for schedule(dynamic)
+    for(int z=0;z<this->size_z_;++z){
+        float *slice = &this->radii_[0] + size_slice * z;
+        for(int y=0;y<this->size_y_;++y){
+            const uint8_t *row = &this->voxels_[ this->index_(1, y+1, z+1) ];
+            for(int x=0;x<this->size_x_;++x){
+                slice[(size_t)y * this->size_x_ + x] = row[x] != 0 ? TOMO_DISTANCE_INF : 0.0f;
+            }
+        }
+        tomo_distance::transform_slice(slice, this->size_x_, this->size_y_);
+    }
+    if(this->radii_.size() > 0)
+        tomo_distance::transform_z(&this->radii_[0], this->size_x_, this->size_y_, this->size_z_);
+    tomo_distance::root(this->radii_);
+
+    return;
+}
+
+void tomo_skeleton::thin(void){
+
+    this->measure_radii_();
+
+    tomo_trace_scope trace("thinning");
+
+    size_t deleted = 0;
+    int iteration = 0;
+    do{
+        deleted = 0;
+        for(int direction=0;direction<6;++direction){
+            for(int subfield=0;subfield<8;++subfield){
+                deleted += this->thin_subfield_(direction, subfield);
+            }
+        }
+        ++iteration;
+    }while(deleted > 0);
+    cout << "thinned in " << iteration << " iterations" <<endl;
+
+    return;
+}
+
+bool tomo_skeleton::save_swc(const char *address){
+
+    int stride_y = this->size_x_+2;
+    size_t stride_z = (size_t)stride_y * (this->size_y_+2);
+    long offsets[26];
+    int number_offsets = 0;
+    for(int dz=-1;dz<=1;++dz){
+        for(int dy=-1;dy<=1;++dy){
+            for(int dx=-1;dx<=1;++dx){
+                if(dx != 0 || dy != 0 || dz != 0)
+                    offsets[number_offsets++] = dz*(long)stride_z + dy*stride_y + dx;
+            }
+        }
+    }
+
+    fstream out_swc(address, fstream::out);
+    if(out_swc.is_open() == false){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+    out_swc << "# xyz-size " << this->size_x_ << " " << this->size_y_ << " " << this->size_z_ <<endl;
+    out_swc << "# id type x y z radius parent" <<endl;
+
+    unordered_map<size_t, int> ids;   // -1 : seen while looking for the root
+    int number_nodes = 0, number_trees = 0;
+    for(int z=1;z<=this->size_z_;++z){
+        for(int y=1;y<=this->size_y_;++y){
+            for(int x=1;x<=this->size_x_;++x){
+                size_t first = this->index_(x, y, z);
+                if(this->voxels_[first] == 0 || ids.count(first) > 0)
+                    continue;
+
+                //the component, its first end point is the root
+                vector<size_t> component(1, first);
+                ids[first] = -1;
+                for(size_t c=0;c<component.size();++c){
+                    for(int n=0;n<26;++n){
+                        size_t neighbour = component[c] + offsets[n];
+                        if(this->voxels_[neighbour] != 0 && ids.count(neighbour) == 0){
+                            ids[neighbour] = -1;
+                            component.push_back(neighbour);
+                        }
+                    }
+                }
+                size_t root = first;
+                bool end_point = false;
+                for(size_t c=0;c<component.size();++c){
+                    if(this->neighbours_(component[c]) == 1 && (end_point == false || component[c] < root)){
+                        root = component[c];
+                        end_point = true;
+                    }
+                }
+
+                //breadth first, every parent written before its children
+                queue< pair<size_t, int> > nodes;
+                nodes.push( make_pair(root, -1) );
+                ids[root] = ++number_nodes;
+                while(nodes.empty() == false){
+                    size_t node = nodes.front().first;
+                    int parent = nodes.front().second;
+                    nodes.pop();
+                    int id = ids[node];
+                    int node_x = node % stride_y - 1;
+                    int node_y = (node / stride_y) % (this->size_y_+2) - 1;
+                    int node_z = node / stride_z - 1;
+                    float radius = this->radii_.size() > 0 ? this->radii_[ ((size_t)node_z * this->size_y_ + node_y) * this->size_x_ + node_x ] : 1.0f;
+                    out_swc << id << " 0 " << node_x << " " << node_y << " " << node_z << " " << radius << " " << parent <<endl;
+                    for(int n=0;n<26;++n){
+                        size_t neighbour = node + offsets[n];
+                        if(this->voxels_[neighbour] != 0 && ids[neighbour] == -1){
+                            ids[neighbour] = ++number_nodes;
+                            nodes.push( make_pair(neighbour, id) );
+                        }
+                    }
+                }
+                ++number_trees;
+            }
+        }
+    }
+    cout << number_nodes << " skeleton nodes in " << number_trees << " trees" <<endl;
+    tomo_metrics::add_bytes_written( out_swc.tellp() );
+    out_swc.close();
+
+    return true;
+}
+
+tomo_skeleton_sink::tomo_skeleton_sink(const char *address, float threshold){
+
+    // keep the absolute address, the working directory keeps changing
+    this->address_ = absolute_address(address);
+    this->threshold_ = threshold;
+    this->size_z_ = 0;
+}
+
+void tomo_skeleton_sink::measure_slice(int index_z, vector< vector<float> > &slice){
+
+    if(index_z != this->size_z_){
+        cerr << "ERROR : skeleton expects slice " << this->size_z_ << ", got " << index_z <<endl;
+        exit(-1);
+    }
+    if(index_z == 0)
+        this->skeleton_.begin(slice.size() > 0 ? slice[0].size() : 0, slice.size());
+    this->skeleton_.add_slice(slice, 1.0, this->threshold_);
+    ++this->size_z_;
+
+    return;
+}
+
+void tomo_skeleton_sink::finish(float /*normalized*/){
+
+    tomo_stage stage("skeleton");
+
+    this->skeleton_.end();
+    this->skeleton_.thin();
+    this->skeleton_.save_swc(this->address_.c_str());
+
+    return;
+}
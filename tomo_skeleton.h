@@ -0,0 +1,64 @@
+#ifndef TOMO_SKELETON
+#define TOMO_SKELETON
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "tomo_tiff.h"
+
+using namespace std;
+
+// centrelines of the voxels with measure >= threshold
+//      thinning : the simple points that are not end points are deleted, one face direction & one
+//      subfield at a time, the 8 subfields of (x%2, y%2, z%2) hold no two neighbours so a subfield
+//      is thinned in parallel without changing the topology (26-connected foreground, 6 background)
+//      swc : one node per voxel of the skeleton, every component a tree from its first end point,
+//      the cycles broken where the breadth first search meets them
+
+class tomo_skeleton{
+
+    int size_x_;
+    int size_y_;
+    int size_z_;
+    vector<uint8_t> voxels_;    // one background voxel more on every side, x fastest
+    vector<float> radii_;       // distance to the background before thinning, without the margin
+
+    size_t index_(int x, int y, int z){return ((size_t)z * (this->size_y_+2) + y) * (this->size_x_+2) + x;}
+    bool simple_(size_t index);
+    int neighbours_(size_t index);
+    size_t thin_subfield_(int direction, int subfield);
+    void measure_radii_(void);
+
+    public:
+
+    tomo_skeleton(){this->size_x_ = this->size_y_ = this->size_z_ = 0;}
+
+    // the slices one after the other, between begin & end
+    void begin(int size_x, int size_y);
+    void add_slice(vector< vector<float> >& slice, float scale, float threshold);
+    void end(void);
+
+    // the radii first, see tomo_distance.h
+    void thin(void);
+    // radius : the distance of the node to the background
+    bool save_swc(const char* address);
+};
+
+// streaming : keeps one byte per voxel, the radii & the thinning once every slice is there
+class tomo_skeleton_sink : public tomo_slice_sink{
+
+    string address_;
+    float threshold_;
+    int size_z_;
+    tomo_skeleton skeleton_;
+
+    public:
+
+    // address : relative to the working directory at construction
+    tomo_skeleton_sink(const char* address, float threshold);
+
+    void measure_slice(int index_z, vector< vector<float> >& slice);
+    void finish(float normalized);
+};
+
+#endif // TOMO_SKELETON
@@ -0,0 +1,207 @@
+#include "tomo_somata.h"
+#include "tomo_hessian.h"
+#include "tomo_metrics.h"
+#include "tomo_trace.h"
+#include <algorithm>
+#include <cmath>
+
+tomo_soma_options::tomo_soma_options(){
+    this->minimum_radius = 3.0;
+    this->maximum_radius = 12.0;
+    this->scales = 5;
+    this->minimum = 0.0;
+    this->top = 0;
+}
+
+bool tomo_soma_options::parse(const char *spec){
+
+    vector< pair<string,string> > items;
+    if(parse_spec(spec, this->prefix, items) == false)
+        return false;
+    if(this->prefix.empty()){
+        cerr << "ERROR : somata need a prefix" <<endl;
+        return false;
+    }
+
+    for(int i=0;i<items.size();++i){
+        string &key = items[i].first;
+        string &value = items[i].second;
+
+        if(key == "rmin")
+            this->minimum_radius = atof(value.c_str());
+        else if(key == "rmax")
+            this->maximum_radius = atof(value.c_str());
+        else if(key == "scales")
+            this->scales = atoi(value.c_str());
+        else if(key == "min")
+            this->minimum = atof(value.c_str());
+        else if(key == "top")
+            this->top = atoi(value.c_str());
+        else{
+            cerr << "ERROR : unknown key " << key <<endl;
+            return false;
+        }
+    }
+
+    if(this->minimum_radius <= 0 || this->maximum_radius < this->minimum_radius || this->scales < 1 || this->top < 0){
+        cerr << "ERROR : radii " << this->minimum_radius << " to " << this->maximum_radius << ", scales " << this->scales
+             << " & top " << this->top << " not handled!" <<endl;
+        return false;
+    }
+
+    return true;
+}
+
+float tomo_somata::radius(const tomo_soma_options &options, int s){
+    if(options.scales == 1)
+        return options.minimum_radius;
+    return options.minimum_radius * pow(options.maximum_radius / options.minimum_radius, (float)s / (float)(options.scales - 1));
+}
+
+void tomo_somata::response(vector< vector< vector<float> >* > &volume, float radius,
+                           vector< vector< vector<float> > > &response){
+
+    vector<float> kernel;
+    float variance;
+    int before;
+    tomo_hessian::gaussian(radius / sqrt(3.0), kernel, variance, before);
+
+    vector< vector< vector<float> > > smoothed;
+    tomo_hessian::smooth(volume, kernel, before, smoothed);
+
+    int size_z = smoothed.size();
+    response.resize(size_z);
+    #pragma omp parallel for schedule(dynamic)
+    for(int z=0;z<size_z;++z){
+        tomo_trace_scope trace("soma_response", z);
+        int size_y = smoothed[z].size();
+        int size_x = size_y > 0 ? smoothed[z][0].size() : 0;
+        response[z].resize(size_y);
+        for(int y=0;y<size_y;++y){
+            const float *rows[3][3];
+            for(int dz=0;dz<3;++dz){
+                int nz = z+dz-1 < 0 ? 0 : (z+dz-1 >= size_z ? size_z-1 : z+dz-1);
+                for(int dy=0;dy<3;++dy){
+                    int ny = y+dy-1 < 0 ? 0 : (y+dy-1 >= size_y ? size_y-1 : y+dy-1);
+                    rows[dz][dy] = &smoothed[nz][ny][0];
+                }
+            }
+            response[z][y].resize(size_x);
+            tomo_hessian::laplacian_row(rows, size_x, -variance, &response[z][y][0]);
+        }
+    }
+
+    return;
+}
+
+void tomo_somata::find(vector< vector< vector<float> > >* around[3], float radius,
+                       const tomo_soma_options &options, tomo_best_heap<tomo_soma> &heap){
+
+    vector< vector< vector<float> > > &response = *around[1];
+    int size_z = response.size();
+
+    #pragma omp parallel
+    {
+        tomo_best_heap<tomo_soma> heap_thread(options.top);
+
+        #pragma omp for schedule(dynamic)
+        for(int z=0;z<size_z;++z){
+            int size_y = response[z].size();
+            for(int y=0;y<size_y;++y){
+                int size_x = response[z][y].size();
+                for(int x=0;x<size_x;++x){
+                    float value = response[z][y][x];
+                    if(value < options.minimum || value <= 0.0)
+                        continue;
+
+                    bool soma = true;
+                    for(int ds=-1;ds<=1 && soma;++ds){
+                        if(around[1+ds] == NULL)
+                            continue;
+                        vector< vector< vector<float> > > &neighbours = *around[1+ds];
+                        for(int dz=-1;dz<=1 && soma;++dz){
+                            int nz = z+dz;
+                            if(nz < 0 || nz >= size_z)
+                                continue;
+                            for(int dy=-1;dy<=1 && soma;++dy){
+                                int ny = y+dy;
+                                if(ny < 0 || ny >= size_y)
+                                    continue;
+                                for(int dx=-1;dx<=1;++dx){
+                                    int nx = x+dx;
+                                    if(nx < 0 || nx >= size_x)
+                                        continue;
+                                    float neighbour = neighbours[nz][ny][nx];
+                                    bool before = ds < 0 || (ds == 0 && (dz < 0 || (dz == 0 && (dy < 0 || (dy == 0 && dx < 0)))));
+                                    if(neighbour > value || (neighbour == value && before)){
+                                        soma = false;
+                                        break;
+                                    }
+                                }
+                            }
+                        }
+                    }
+
+                    if(soma){
+                        tomo_soma found = {x, y, z, radius, value};
+                        heap_thread.push(found);
+                    }
+                }
+            }
+        }
+
+        #pragma omp critical
+        heap.merge(heap_thread);
+    }
+
+    return;
+}
+
+void tomo_somata::detect(vector< vector< vector<float> >* > &volume, const tomo_soma_options &options,
+                         vector<tomo_soma> &somata){
+
+    //the responses of the scales s-1, s & s+1
+    vector< vector< vector<float> > > responses[3];
+    tomo_best_heap<tomo_soma> heap(options.top);
+    for(int s=0;s<options.scales;++s){
+        tomo_trace_scope trace("soma_scale", s);
+        if(s == 0)
+            tomo_somata::response(volume, tomo_somata::radius(options, 0), responses[1]);
+        if(s+1 < options.scales)
+            tomo_somata::response(volume, tomo_somata::radius(options, s+1), responses[2]);
+
+        vector< vector< vector<float> > >* around[3] = {s > 0 ? &responses[0] : NULL,
+                                                        &responses[1],
+                                                        s+1 < options.scales ? &responses[2] : NULL};
+        tomo_somata::find(around, tomo_somata::radius(options, s), options, heap);
+
+        responses[0].swap(responses[1]);
+        responses[1].swap(responses[2]);
+        responses[2].clear();
+    }
+
+    heap.sorted(somata);
+
+    return;
+}
+
+bool tomo_somata::save(const tomo_soma_options &options, vector<tomo_soma> &somata, int size_x, int size_y, int size_z){
+
+    string address = options.prefix + ".csv";
+    fstream out_somata(address.c_str(), fstream::out);
+    if(out_somata.is_open() == false){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+    out_somata << "# xyz-size " << size_x << " " << size_y << " " << size_z <<endl;
+    out_somata << "x,y,z,radius,score" <<endl;
+    for(int i=0;i<somata.size();++i){
+        out_somata << somata[i].x << "," << somata[i].y << "," << somata[i].z << ","
+                   << fixed << setprecision(3) << somata[i].radius << ","
+                   << scientific << setprecision(8) << somata[i].score <<endl;
+    }
+    tomo_metrics::add_bytes_written( out_somata.tellp() );
+    out_somata.close();
+
+    return true;
+}
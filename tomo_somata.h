@@ -0,0 +1,75 @@
+#ifndef TOMO_SOMATA
+#define TOMO_SOMATA
+
+#include <string>
+#include <vector>
+#include "tomo_tiff.h"
+#include "tomo_peaks.h"
+
+using namespace std;
+
+// cell bodies : the bright blobs of the gray scale, from the slices already loaded for the detection
+//      scale-normalized laplacian of gaussian -sigma^2 (Lxx + Lyy + Lzz), the gaussian from tomo_hessian.h,
+//      at scales radii geometric from the minimum to the maximum radius, sigma = radius / sqrt(3)
+//      a soma is >= minimum and >= its 26 neighbours at its scale & the scales around, strictly > those met
+//      before it (x, then y, then z, then the smaller scales) so a plateau gives a single soma
+//      prefix.csv : x,y,z,radius,score sorted by score, the best first
+
+class tomo_soma{
+
+    public:
+
+    int x;
+    int y;
+    int z;
+    float radius;
+    float score;
+
+    // as the peaks, then the smaller scale
+    bool better(const tomo_soma& b) const{
+        int order = tomo_compare_candidates(*this, b);
+        return order != 0 ? order < 0 : this->radius < b.radius;
+    }
+};
+
+class tomo_soma_options{
+
+    public:
+
+    string prefix;
+    float minimum_radius;   // in voxels
+    float maximum_radius;
+    int scales;
+    float minimum;          // in gray scale units
+    int top;                // the best top somata only, 0 keeps them all
+
+    tomo_soma_options();
+
+    // spec : prefix[:key=value,...] with the keys rmin, rmax, scales, min & top,
+    //        e.g. somata:rmin=3,rmax=12,scales=5,min=100
+    bool parse(const char* spec);
+};
+
+class tomo_somata{
+
+    public:
+
+    // the radius of scale s
+    static float radius(const tomo_soma_options& options, int s);
+
+    // the normalized laplacian of gaussian at radius, negated so bright blobs are positive, in parallel
+    static void response(vector< vector< vector<float> >* >& volume, float radius,
+                         vector< vector< vector<float> > >& response);
+
+    // the somata of scale, around : the responses of the scales before & after, NULL outside
+    static void find(vector< vector< vector<float> > >* around[3], float radius,
+                     const tomo_soma_options& options, tomo_best_heap<tomo_soma>& heap);
+
+    // every scale, 3 responses kept at a time, the somata sorted & cut to the top ones
+    static void detect(vector< vector< vector<float> >* >& volume, const tomo_soma_options& options,
+                       vector<tomo_soma>& somata);
+
+    static bool save(const tomo_soma_options& options, vector<tomo_soma>& somata, int size_x, int size_y, int size_z);
+};
+
+#endif // TOMO_SOMATA
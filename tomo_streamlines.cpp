@@ -0,0 +1,172 @@
+#include "tomo_streamlines.h"
+#include "tomo_orientation.h"
+#include "tomo_peaks.h"
+#include "tomo_metrics.h"
+#include "tomo_trace.h"
+
+tomo_streamline_options::tomo_streamline_options(){
+    this->seed = -1.0;
+    this->stop = -1.0;
+    this->step = 0.5;
+    this->length = 1000;
+    this->seeds = 1000;
+    this->angle = 60.0;
+}
+
+bool tomo_streamline_options::parse(const char *spec){
+
+    vector< pair<string,string> > items;
+    if(parse_spec(spec, this->address, items) == false)
+        return false;
+    if(this->address.empty()){
+        cerr << "ERROR : streamlines need an address" <<endl;
+        return false;
+    }
+
+    for(int i=0;i<items.size();++i){
+        string &key = items[i].first;
+        string &value = items[i].second;
+
+        if(key == "seed")
+            this->seed = atof(value.c_str());
+        else if(key == "stop")
+            this->stop = atof(value.c_str());
+        else if(key == "step")
+            this->step = atof(value.c_str());
+        else if(key == "length")
+            this->length = atoi(value.c_str());
+        else if(key == "seeds")
+            this->seeds = atoi(value.c_str());
+        else if(key == "angle")
+            this->angle = atof(value.c_str());
+        else{
+            cerr << "ERROR : unknown key " << key <<endl;
+            return false;
+        }
+    }
+
+    if(this->step <= 0 || this->length <= 0 || this->seeds <= 0 || this->angle <= 0){
+        cerr << "ERROR : step " << this->step << ", length " << this->length << ", seeds " << this->seeds
+             << " & angle " << this->angle << " must be > 0" <<endl;
+        return false;
+    }
+
+    return true;
+}
+
+// the orientation & measure of the voxel nearest to p, false outside the volume
+static bool sample(vector< vector< vector<float> > > &measure, vector< vector< vector<uint32_t> > > &orientation,
+                   const float *p, float *direction, float &value){
+    int x = lrintf(p[0]), y = lrintf(p[1]), z = lrintf(p[2]);
+    if(z < 0 || z >= measure.size() || y < 0 || y >= measure[z].size() || x < 0 || x >= measure[z][y].size())
+        return false;
+    value = measure[z][y][x];
+    tomo_orientation_decode(orientation[z][y][x], direction);
+    return true;
+}
+
+// the direction flipped to go on the same way as previous
+static void align(float *direction, const float *previous){
+    if(direction[0]*previous[0] + direction[1]*previous[1] + direction[2]*previous[2] < 0.0f){
+        direction[0] = -direction[0];
+        direction[1] = -direction[1];
+        direction[2] = -direction[2];
+    }
+}
+
+static void trace_one_way(vector< vector< vector<float> > > &measure, float scale,
+                          vector< vector< vector<uint32_t> > > &orientation,
+                          const tomo_streamline_options &options, const float *seed, float sign, vector<float> &line){
+
+    float minimum_cosine = cos(options.angle * M_PI / 180.0);
+    float p[3] = {seed[0], seed[1], seed[2]};
+    float previous[3], direction[3], middle[3], value;
+
+    sample(measure, orientation, p, previous, value);
+    previous[0] *= sign; previous[1] *= sign; previous[2] *= sign;
+
+    for(int s=0;s<options.length;++s){
+
+        //midpoint step
+        if(sample(measure, orientation, p, direction, value) == false)
+            break;
+        align(direction, previous);
+        for(int a=0;a<3;++a){
+            middle[a] = p[a] + 0.5f * options.step * direction[a];
+        }
+        if(sample(measure, orientation, middle, direction, value) == false)
+            break;
+        align(direction, previous);
+
+        if(direction[0]*previous[0] + direction[1]*previous[1] + direction[2]*previous[2] < minimum_cosine)
+            break;
+        for(int a=0;a<3;++a){
+            p[a] += options.step * direction[a];
+            previous[a] = direction[a];
+        }
+
+        if(sample(measure, orientation, p, direction, value) == false || value * scale < options.stop)
+            break;
+        line.insert(line.end(), p, p+3);
+    }
+
+    return;
+}
+
+void tomo_streamlines::trace(vector< vector< vector<float> > > &measure, float scale,
+                             vector< vector< vector<uint32_t> > > &orientation,
+                             const tomo_streamline_options &options, vector<tomo_streamline> &lines){
+
+    //seeds, the strongest local maxima
+    tomo_peak_options peak_options;
+    peak_options.minimum = options.seed;
+    peak_options.top = options.seeds;
+    vector<tomo_peak> seeds;
+    tomo_peaks::find(measure, scale, peak_options, seeds);
+
+    lines.assign(seeds.size(), tomo_streamline());
+    #pragma omp parallel for schedule(dynamic)
+    for(int i=0;i<seeds.size();++i){
+        tomo_trace_scope trace("streamline", seeds[i].z);
+        tomo_streamline &line = lines[i];
+        line.seed[0] = seeds[i].x;
+        line.seed[1] = seeds[i].y;
+        line.seed[2] = seeds[i].z;
+        trace_one_way(measure, scale, orientation, options, line.seed, 1.0f, line.forward);
+        trace_one_way(measure, scale, orientation, options, line.seed, -1.0f, line.backward);
+    }
+
+    return;
+}
+
+bool tomo_streamlines::save_swc(const char *address, vector<tomo_streamline> &lines, int size_x, int size_y, int size_z){
+
+    fstream out_swc(address, fstream::out);
+    if(out_swc.is_open() == false){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+    out_swc << "# xyz-size " << size_x << " " << size_y << " " << size_z <<endl;
+    out_swc << "# id type x y z radius parent" <<endl;
+    out_swc << fixed << setprecision(3);
+
+    int id = 0;
+    for(int i=0;i<lines.size();++i){
+        tomo_streamline &line = lines[i];
+        int root = ++id;
+        out_swc << root << " 0 " << line.seed[0] << " " << line.seed[1] << " " << line.seed[2] << " 1.0 -1" <<endl;
+        for(int way=0;way<2;++way){
+            vector<float> &points = way == 0 ? line.forward : line.backward;
+            int parent = root;
+            for(size_t p=0;p+2<points.size();p+=3){
+                out_swc << ++id << " 0 " << points[p] << " " << points[p+1] << " " << points[p+2] << " 1.0 " << parent <<endl;
+                parent = id;
+            }
+        }
+    }
+    cout << lines.size() << " streamlines, " << id << " points" <<endl;
+    tomo_metrics::add_bytes_written( out_swc.tellp() );
+    out_swc.close();
+
+    return true;
+}
@@ -0,0 +1,58 @@
+#ifndef TOMO_STREAMLINES
+#define TOMO_STREAMLINES
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+// neurite tracing along the orientation field (tomo_orientation.h), in memory
+//      seeds : the peaks of the measure >= seed (tomo_peaks.h), the best seeds ones
+//      every seed is traced both ways, midpoint steps along the orientation of the nearest voxel,
+//      until the measure drops below stop, the line leaves the volume, turns more than angle
+//      degrees in a step or is length steps long
+//      swc : one tree per seed, the seed as root & the two directions as its branches
+
+class tomo_streamline_options{
+
+    public:
+
+    string address;
+    float seed;     // in the units before normalization, -1.0 for the default
+    float stop;     // the same, the seed threshold when not given
+    float step;     // in voxels
+    int length;     // steps each way
+    int seeds;
+    float angle;    // degrees
+
+    tomo_streamline_options();
+
+    // spec : address[:key=value,...] with the keys seed, stop, step, length, seeds & angle,
+    //        e.g. lines.swc:seed=0.5,step=0.5,seeds=2000
+    bool parse(const char* spec);
+};
+
+class tomo_streamline{
+
+    public:
+
+    float seed[3];
+    vector<float> forward;  // xyz after the seed
+    vector<float> backward; // xyz the other way
+};
+
+class tomo_streamlines{
+
+    public:
+
+    // seeds in parallel, dynamically scheduled, the lines in the order of the seeds
+    //      scale : the measure is multiplied by it first, the normalization for tomo_super_tiff
+    static void trace(vector< vector< vector<float> > >& measure, float scale,
+                      vector< vector< vector<uint32_t> > >& orientation,
+                      const tomo_streamline_options& options, vector<tomo_streamline>& lines);
+
+    static bool save_swc(const char* address, vector<tomo_streamline>& lines, int size_x, int size_y, int size_z);
+};
+
+#endif // TOMO_STREAMLINES
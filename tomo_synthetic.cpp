@@ -0,0 +1,389 @@
+#include "tomo_synthetic.h"
+
+tomo_fibre::tomo_fibre(const float *a, const float *b, float radius){
+
+    this->radius = radius;
+    this->ab_length2_ = 0.0;
+    for(int i=0;i<3;++i){
+        this->a[i] = a[i];
+        this->b[i] = b[i];
+        this->ab_[i] = b[i] - a[i];
+        this->ab_length2_ += this->ab_[i] * this->ab_[i];
+    }
+    return;
+}
+
+bool tomo_fibre::bounding_box(int index_z, int &x0, int &x1, int &y0, int &y1){
+
+    // every point of the cylinder is within radius of its axis,
+    // so only the axis part with |axis_z - z| <= radius can reach slice z
+    float z = (float)index_z;
+    float t0 = 0.0;
+    float t1 = 1.0;
+
+    if( fabs(this->ab_[2]) < 1e-6 ){
+        if( fabs(this->a[2] - z) > this->radius )
+            return false;
+    }else{
+        t0 = (z - this->radius - this->a[2]) / this->ab_[2];
+        t1 = (z + this->radius - this->a[2]) / this->ab_[2];
+        if(t0 > t1){
+            float tmp = t0;
+            t0 = t1;
+            t1 = tmp;
+        }
+        t0 = t0 < 0.0 ? 0.0 : t0;
+        t1 = t1 > 1.0 ? 1.0 : t1;
+        if(t0 > t1)
+            return false;
+    }
+
+    float xa = this->a[0] + this->ab_[0] * t0;
+    float xb = this->a[0] + this->ab_[0] * t1;
+    float ya = this->a[1] + this->ab_[1] * t0;
+    float yb = this->a[1] + this->ab_[1] * t1;
+
+    x0 = (int)floor( (xa < xb ? xa : xb) - this->radius );
+    x1 = (int)ceil( (xa > xb ? xa : xb) + this->radius );
+    y0 = (int)floor( (ya < yb ? ya : yb) - this->radius );
+    y1 = (int)ceil( (ya > yb ? ya : yb) + this->radius );
+
+    return true;
+}
+
+bool tomo_fibre::inside(float x, float y, float z){
+
+    float ap[3] = { x - this->a[0], y - this->a[1], z - this->a[2] };
+    float dot_ap_ab = ap[0]*this->ab_[0] + ap[1]*this->ab_[1] + ap[2]*this->ab_[2];
+
+    //between the two caps
+    if( dot_ap_ab <= 0.0 || dot_ap_ab >= this->ab_length2_ )
+        return false;
+
+    float distance2 = ap[0]*ap[0] + ap[1]*ap[1] + ap[2]*ap[2] - dot_ap_ab * dot_ap_ab / this->ab_length2_;
+    return distance2 <= this->radius * this->radius;
+}
+
+tomo_synthetic::tomo_synthetic(){
+    this->size_x = 200;
+    this->size_y = 200;
+    this->size_z = 200;
+    this->number_fibres = 15;
+    this->radius = 2.0;
+    this->orientation = "random";
+    this->foreground = 1.0;
+    this->background = 0.0;
+    this->noise = 0.0;
+    this->bits_per_sample = 16;
+    this->seed = 1;
+}
+
+bool tomo_synthetic::parse(const char *spec){
+
+    stringstream list(spec);
+    string item;
+
+    while(getline(list, item, ',')){
+        size_t position = item.find('=');
+        if(position == string::npos){
+            cerr << "ERROR : " << item << " is not key=value" <<endl;
+            return false;
+        }
+        string key = item.substr(0, position);
+        string value = item.substr(position+1);
+
+        if(key == "x")
+            this->size_x = atoi(value.c_str());
+        else if(key == "y")
+            this->size_y = atoi(value.c_str());
+        else if(key == "z")
+            this->size_z = atoi(value.c_str());
+        else if(key == "fibres")
+            this->number_fibres = atoi(value.c_str());
+        else if(key == "radius")
+            this->radius = atof(value.c_str());
+        else if(key == "orientation")
+            this->orientation = value;
+        else if(key == "foreground")
+            this->foreground = atof(value.c_str());
+        else if(key == "background")
+            this->background = atof(value.c_str());
+        else if(key == "noise")
+            this->noise = atof(value.c_str());
+        else if(key == "bits")
+            this->bits_per_sample = atoi(value.c_str());
+        else if(key == "seed")
+            this->seed = strtoul(value.c_str(), NULL, 10);
+        else{
+            cerr << "ERROR : unknown key " << key <<endl;
+            return false;
+        }
+    }
+
+    if( this->size_x <= 0 || this->size_y <= 0 || this->size_z <= 0 ){
+        cerr << "ERROR : size " << this->size_x << "x" << this->size_y << "x" << this->size_z << " not handled!" <<endl;
+        return false;
+    }
+    if( this->bits_per_sample != 8 && this->bits_per_sample != 16 ){
+        cerr << "ERROR : bits " << this->bits_per_sample << " not handled!" <<endl;
+        return false;
+    }
+    if( this->orientation != "random" && this->orientation != "fan" &&
+            this->orientation != "x" && this->orientation != "y" && this->orientation != "z" ){
+        cerr << "ERROR : orientation " << this->orientation << " not handled!" <<endl;
+        return false;
+    }
+
+    return true;
+}
+
+void tomo_synthetic::add_fibre(const float *a, const float *b, float radius){
+    this->fibres_.push_back( tomo_fibre(a, b, radius) );
+    return;
+}
+
+void tomo_synthetic::make_fibres(){
+
+    this->fibres_.clear();
+
+    srand(this->seed);
+    float size[3] = { (float)this->size_x, (float)this->size_y, (float)this->size_z };
+    float diagonal = sqrt( size[0]*size[0] + size[1]*size[1] + size[2]*size[2] );
+
+    for(int t=0;t<this->number_fibres;++t){
+
+        float a[3];
+        float b[3];
+
+        if(this->orientation == "fan"){
+            //spread along x and rotate within the yz-plane, as create_experimental_data does
+            float theta = M_PI / 2.0 / (float)this->number_fibres * (float)t;
+            float rotation_r = 0.4 * (size[1] < size[2] ? size[1] : size[2]);
+            a[0] = b[0] = ( (float)t + 0.5 ) * size[0] / (float)this->number_fibres;
+            a[1] = rotation_r * cos(theta) + size[1] / 2.0;
+            a[2] = rotation_r * sin(theta) + size[2] / 2.0;
+            b[1] = size[1] - a[1];
+            b[2] = size[2] - a[2];
+
+        }else{
+            //a line through a random point, long enough to cross the whole volume
+            float centre[3];
+            float direction[3] = {0.0, 0.0, 0.0};
+            for(int i=0;i<3;++i){
+                centre[i] = (float)rand() / (float)RAND_MAX * size[i];
+            }
+
+            if(this->orientation == "x")
+                direction[0] = 1.0;
+            else if(this->orientation == "y")
+                direction[1] = 1.0;
+            else if(this->orientation == "z")
+                direction[2] = 1.0;
+            else{
+                float cos_theta = 2.0 * (float)rand() / (float)RAND_MAX - 1.0;
+                float sin_theta = sqrt(1.0 - cos_theta*cos_theta);
+                float phi = 2.0 * M_PI * (float)rand() / (float)RAND_MAX;
+                direction[0] = sin_theta * cos(phi);
+                direction[1] = sin_theta * sin(phi);
+                direction[2] = cos_theta;
+            }
+
+            for(int i=0;i<3;++i){
+                a[i] = centre[i] - direction[i] * diagonal;
+                b[i] = centre[i] + direction[i] * diagonal;
+            }
+        }
+
+        this->add_fibre(a, b, this->radius);
+    }
+
+    return;
+}
+
+float tomo_synthetic::noise_(int x, int y, int z){
+
+    // hashed per voxel, so it doesn't depend on the order or the number of threads
+    uint64_t h = ( (uint64_t)this->seed * 0x9E3779B97F4A7C15ULL ) ^ ( (uint64_t)x << 42 ) ^ ( (uint64_t)y << 21 ) ^ (uint64_t)z;
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+
+    //box-muller
+    float u1 = ( (float)(h >> 40) + 1.0 ) / 16777217.0;
+    float u2 = (float)( (h >> 8) & 0xFFFFFF ) / 16777216.0;
+    return this->noise * sqrt( -2.0 * log(u1) ) * cos( 2.0 * M_PI * u2 );
+}
+
+void tomo_synthetic::active_fibres_(int index_z, vector<int> &boxes){
+
+    //index, x0, x1, y0, y1 for every fibre crossing slice z
+    boxes.clear();
+    for(int f=0;f<this->fibres_.size();++f){
+        int x0, x1, y0, y1;
+        if( this->fibres_[f].bounding_box(index_z, x0, x1, y0, y1) == false )
+            continue;
+        x0 = x0 < 0 ? 0 : x0;
+        y0 = y0 < 0 ? 0 : y0;
+        x1 = x1 >= this->size_x ? this->size_x-1 : x1;
+        y1 = y1 >= this->size_y ? this->size_y-1 : y1;
+        if( x0 > x1 || y0 > y1 )
+            continue;
+        boxes.push_back(f);
+        boxes.push_back(x0);
+        boxes.push_back(x1);
+        boxes.push_back(y0);
+        boxes.push_back(y1);
+    }
+
+    return;
+}
+
+void tomo_synthetic::make_row_(int index_z, int index_y, vector<int> &boxes, float *row, uint8_t *mask, bool with_noise){
+
+    for(int x=0;x<this->size_x;++x){
+        row[x] = this->background;
+        mask[x] = 0;
+    }
+
+    for(int b=0;b<boxes.size();b+=5){
+        if( index_y < boxes[b+3] || index_y > boxes[b+4] )
+            continue;
+        tomo_fibre &fibre = this->fibres_[ boxes[b] ];
+        for(int x=boxes[b+1];x<=boxes[b+2];++x){
+            if( fibre.inside((float)x, (float)index_y, (float)index_z) ){
+                row[x] = this->foreground;
+                mask[x] = 255;
+            }
+        }
+    }
+
+    if(with_noise && this->noise > 0.0){
+        for(int x=0;x<this->size_x;++x){
+            row[x] += this->noise_(x, index_y, index_z);
+        }
+    }
+
+    return;
+}
+
+void tomo_synthetic::make_slice(int index_z, vector< vector<float> > &slice, bool with_noise){
+
+    vector<int> boxes;
+    vector<uint8_t> mask(this->size_x);
+    this->active_fibres_(index_z, boxes);
+
+    slice.resize(this->size_y);
+    for(int y=0;y<this->size_y;++y){
+        slice[y].resize(this->size_x);
+        this->make_row_(index_z, y, boxes, &slice[y][0], &mask[0], with_noise);
+    }
+
+    return;
+}
+
+void tomo_synthetic::write_slice_(int index_z, const char *address, const char *address_mask){
+
+    TIFF *tif = TIFFOpen(address, "w");
+    TIFF *tif_mask = TIFFOpen(address_mask, "w");
+    if(tif == NULL || tif_mask == NULL){
+        cerr << "ERROR : cannot create file " << address << " or " << address_mask <<endl;
+        if(tif != NULL) TIFFClose(tif);
+        if(tif_mask != NULL) TIFFClose(tif_mask);
+        return;
+    }
+
+    TIFF *tifs[2] = { tif, tif_mask };
+    int bits[2] = { this->bits_per_sample, 8 };
+    for(int t=0;t<2;++t){
+        TIFFSetField(tifs[t], TIFFTAG_IMAGEWIDTH, this->size_x);
+        TIFFSetField(tifs[t], TIFFTAG_IMAGELENGTH, this->size_y);
+        TIFFSetField(tifs[t], TIFFTAG_BITSPERSAMPLE, bits[t]);
+        TIFFSetField(tifs[t], TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tifs[t], TIFFTAG_ROWSPERSTRIP, 16);
+        TIFFSetField(tifs[t], TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+        TIFFSetField(tifs[t], TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tifs[t], TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tifs[t], TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+    }
+
+    //one row at a time
+    vector<int> boxes;
+    vector<float> row(this->size_x);
+    vector<uint8_t> mask(this->size_x);
+    vector<uint16_t> data_16(this->bits_per_sample == 16 ? this->size_x : 0);
+    vector<uint8_t> data_8(this->bits_per_sample == 8 ? this->size_x : 0);
+    float max_gray_scale = this->bits_per_sample == 16 ? 65535.0 : 255.0;
+
+    this->active_fibres_(index_z, boxes);
+    for(int y=0;y<this->size_y;++y){
+
+        this->make_row_(index_z, y, boxes, &row[0], &mask[0], true);
+
+        for(int x=0;x<this->size_x;++x){
+            float value = row[x] < 0.0 ? 0.0 : ( row[x] > 1.0 ? 1.0 : row[x] );
+            if(this->bits_per_sample == 16)
+                data_16[x] = (uint16_t)(value * max_gray_scale + 0.5);
+            else
+                data_8[x] = (uint8_t)(value * max_gray_scale + 0.5);
+        }
+
+        if(this->bits_per_sample == 16)
+            TIFFWriteScanline(tif, &data_16[0], y);
+        else
+            TIFFWriteScanline(tif, &data_8[0], y);
+        TIFFWriteScanline(tif_mask, &mask[0], y);
+    }
+
+    TIFFClose(tif);
+    TIFFClose(tif_mask);
+    return;
+}
+
+void tomo_synthetic::generate(const char *address){
+
+    if(this->fibres_.empty())
+        this->make_fibres();
+
+    cout << "generating " << this->size_x << "x" << this->size_y << "x" << this->size_z
+         << " with " << this->fibres_.size() << " fibres..." <<endl;
+
+    string prefix(address);
+    mkdir(address, 0755);
+    mkdir( (prefix + "/mask").c_str(), 0755 );
+
+    progressbar *progress = progressbar_new("Generating", this->size_z);
+    #pragma omp parallel for schedule(dynamic)
+    for(int i=0;i<this->size_z;++i){
+        char filename[50] = {0};
+        sprintf(filename, "%d.tif", i);
+        this->write_slice_(i, (prefix + "/" + filename).c_str(), (prefix + "/mask/" + filename).c_str());
+        #pragma omp critical
+        progressbar_inc(progress);
+    }
+    progressbar_finish(progress);
+
+    //make filelists
+    char original_directory[100];
+    char filelist_directory[100];
+    getcwd(original_directory,100);
+    chdir(address);
+    getcwd(filelist_directory,100);
+
+    fstream out_filelist("exp.txt",fstream::out);
+    fstream out_mask("mask.txt",fstream::out);
+    out_filelist << this->size_z <<endl;
+    out_filelist << filelist_directory <<endl;
+    out_mask << this->size_z <<endl;
+    out_mask << filelist_directory << "/mask" <<endl;
+    for(int i=0;i<this->size_z;++i){
+        out_filelist << i << ".tif" <<endl;
+        out_mask << i << ".tif" <<endl;
+    }
+    out_filelist.close();
+    out_mask.close();
+
+    chdir(original_directory);
+    return;
+}
@@ -0,0 +1,64 @@
+#ifndef TOMO_SYNTHETIC
+#define TOMO_SYNTHETIC
+
+#include "tomo_tiff.h"
+
+// synthetic fibre volumes for load testing
+//      slices are generated independently from the fibre list, so any size can be
+//      written slice by slice in constant memory together with its ground-truth mask
+
+class tomo_fibre{
+
+    float ab_[3];
+    float ab_length2_;
+
+    public:
+
+    float a[3]; // xyz
+    float b[3];
+    float radius;
+
+    tomo_fibre(const float* a, const float* b, float radius);
+
+    // the part of the fibre inside slice z, false if it misses the slice
+    bool bounding_box(int index_z, int& x0, int& x1, int& y0, int& y1);
+    bool inside(float x, float y, float z);
+};
+
+class tomo_synthetic{
+
+    vector<tomo_fibre> fibres_;
+
+    float noise_(int x, int y, int z);
+    void active_fibres_(int index_z, vector<int>& boxes);
+    void make_row_(int index_z, int index_y, vector<int>& boxes, float* row, uint8_t* mask, bool with_noise);
+    void write_slice_(int index_z, const char* address, const char* address_mask);
+
+    public:
+
+    int size_x;
+    int size_y;
+    int size_z;
+    int number_fibres;
+    float radius;
+    string orientation; // random, fan, x, y, z
+    float foreground;
+    float background;
+    float noise;        // standard deviation of the gaussian noise, 1.0 is the full scale
+    int bits_per_sample;// 8 or 16
+    unsigned int seed;
+
+    tomo_synthetic();
+
+    // spec : comma separated key=value, e.g. x=4000,y=4000,z=2000,fibres=50,radius=3,noise=0.05,bits=16
+    bool parse(const char* spec);
+
+    void make_fibres();
+    void add_fibre(const float* a, const float* b, float radius);
+    void make_slice(int index_z, vector< vector<float> >& slice, bool with_noise = true);
+
+    // writes address/%d.tif, address/mask/%d.tif and the filelists exp.txt & mask.txt
+    void generate(const char* address);
+};
+
+#endif // TOMO_SYNTHETIC
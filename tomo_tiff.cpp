@@ -1,16 +1,93 @@
 #include "tomo_tiff.h"
+#include "tomo_synthetic.h"
+#include "tomo_metrics.h"
+#include "tomo_checkpoint.h"
+#include "tomo_gradient.h"
+#include "tomo_halo.h"
+#include "tomo_components.h"
+#include "tomo_peaks.h"
+#include "tomo_skeleton.h"
+#include "tomo_distance.h"
+#include "tomo_orientation.h"
+#include "tomo_streamlines.h"
+#include "tomo_hessian.h"
+#include "tomo_somata.h"
+
+// the gaussian window as [k][j][i] in one array
+static vector<float> flatten_window(vector< vector< vector<float> > >& window){
+    vector<float> weights;
+    for(int k=0;k<window.size();++k){
+        for(int j=0;j<window[k].size();++j){
+            weights.insert(weights.end(), window[k][j].begin(), window[k][j].end());
+        }
+    }
+    return weights;
+}
+
+// N taps of one window row added to the 6 sums of the tensor, unrolled at compile time
+template<int N>
+struct tensor_taps{
+    static inline void add(matrix *taps, const float *weights, float *sum){
+        tensor_taps<N-1>::add(taps, weights, sum);
+        matrix &tap = taps[N-1];
+        float weight = weights[N-1];
+        sum[0] += tap[0][0] * weight;
+        sum[1] += tap[1][1] * weight;
+        sum[2] += tap[2][2] * weight;
+        sum[3] += tap[0][1] * weight;
+        sum[4] += tap[0][2] * weight;
+        sum[5] += tap[1][2] * weight;
+    }
+};
+
+template<>
+struct tensor_taps<0>{
+    static inline void add(matrix* /*taps*/, const float* /*weights*/, float* /*sum*/){}
+};
+
+template<class T>
+static double count_voxels(vector< vector<T> >& slice){
+    return slice.size() > 0 ? (double)slice.size() * (double)slice[0].size() : 0.0;
+}
+
+template<class T>
+static double count_volume_voxels(vector< vector< vector<T> > >& volume){
+    double voxels = 0.0;
+    for(int i=0;i<volume.size();++i){
+        voxels += count_voxels(volume[i]);
+    }
+    return voxels;
+}
 
 tomo_tiff::tomo_tiff(const char* address){
+    this->read_(address, tomo_roi());
+}
+
+tomo_tiff::tomo_tiff(const char* address, const tomo_roi& roi){
+    this->read_(address, roi);
+}
+
+void tomo_tiff::read_(const char* address, const tomo_roi& roi){
+    tomo_trace_scope trace("tiff_read");
     TIFF *tif = TIFFOpen( address, "r" );
     if(tif == NULL){
         cerr << "ERROR : cannot open " << address << endl;
         return;
     }
 
+    uint16_t bits_per_sample = 0;
+    uint16_t samples_per_pixel = 0;
     TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &this->height_);
     TIFFGetField(tif, TIFFTAG_IMAGEWIDTH,  &this->width_);
-    TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &this->bits_per_sample_);
-    TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &this->samples_per_pixel_);
+    TIFFGetField(tif, TIFFTAG_BITSPERSAMPLE, &bits_per_sample);
+    TIFFGetField(tif, TIFFTAG_SAMPLESPERPIXEL, &samples_per_pixel);
+    this->bits_per_sample_ = bits_per_sample;
+    this->samples_per_pixel_ = samples_per_pixel;
+
+    //only the rows & columns of the roi
+    tomo_roi region = roi.clipped(this->width_, this->height_, 1);
+    this->height_ = region.size_y();
+    this->width_ = region.size_x();
 
     //init
     this->address_ = string(address);
@@ -23,15 +100,25 @@ tomo_tiff::tomo_tiff(const char* address){
     unsigned int line_size = TIFFScanlineSize(tif);
     char* buf = new char[ line_size * this->height_];
     for(unsigned int i=0;i<this->height_;++i){
-        TIFFReadScanline( tif, &buf[i*line_size], i );
+        TIFFReadScanline( tif, &buf[i*line_size], region.y0 + i );
     }
 
     if(this->bits_per_sample_ == 16 && this->samples_per_pixel_ == 1){
         for(unsigned int i=0;i<this->height_;++i){
+            uint16_t *line = (uint16_t*)&buf[i*line_size] + region.x0;
+            for(unsigned int j=0;j<this->width_;++j){
+                this->gray_scale_[i][j] = (float)line[j] / 65535.0;
+            }
+        }
+    }
+    else if(this->bits_per_sample_ == 8 && this->samples_per_pixel_ == 1){
+        for(unsigned int i=0;i<this->height_;++i){
+            uint8_t *line = (uint8_t*)&buf[i*line_size] + region.x0;
             for(unsigned int j=0;j<this->width_;++j){
-                this->gray_scale_[i][j] = (float)((uint16_t*)buf)[ i*this->width_ + j ] / 65535.0;
+                this->gray_scale_[i][j] = (float)line[j] / 255.0;
             }
         }
+        this->bits_per_sample_ = 16; // saved as 16 bits like everything else
     }
     else{
         cerr << "ERROR : " << address << " not handled!" <<endl;
@@ -39,6 +126,7 @@ tomo_tiff::tomo_tiff(const char* address){
         cerr << "samples_per_pixel : " << this->samples_per_pixel_ <<endl;
     }
 
+    tomo_metrics::add_bytes_read( (uint64_t)line_size * this->height_ );
     delete [] buf;
     TIFFClose(tif);
 
@@ -46,6 +134,7 @@ tomo_tiff::tomo_tiff(const char* address){
 }
 
 void tomo_tiff::save(const char* address, int max_gray_scale ){
+    tomo_trace_scope trace("tiff_write");
     TIFF *tif = TIFFOpen(address, "w");
     if(tif == NULL){
         cerr << "ERROR : cannot create file " << address <<endl;
@@ -79,6 +168,7 @@ void tomo_tiff::save(const char* address, int max_gray_scale ){
             }
         }
         TIFFWriteEncodedStrip(tif, 0, &data[0], this->height_*this->width_*2);
+        tomo_metrics::add_bytes_written( (uint64_t)this->height_*this->width_*2 );
     }
     else{
         cerr << "ERROR : " << address << " not handled!" <<endl;
@@ -94,7 +184,7 @@ vector<float>& tomo_tiff::operator [](int index_y){
     return this->gray_scale_[index_y];
 }
 
-void tomo_super_tiff::make_gaussian_window_(const int size, const float standard_deviation){
+void tomo_super_tiff::make_gaussian_window_(const int size, const float standard_deviation, bool saving){
 
     //init
     this->gaussian_window_.resize(size);
@@ -143,6 +233,9 @@ void tomo_super_tiff::make_gaussian_window_(const int size, const float standard
         }
     }
 
+    if(saving == false)
+        return;
+
     //normalize the maximum to 1 for output
     float normalize_ratio = 1.0 / maximum;
     vector< vector< vector<float> > >output_test( gaussian_window_ );
@@ -166,7 +259,20 @@ void tomo_super_tiff::make_gaussian_window_(const int size, const float standard
     return;
 }
 
-tomo_super_tiff::tomo_super_tiff(const char *address_filelist){
+tomo_super_tiff::tomo_super_tiff(const char *address_filelist, tomo_plan plan, tomo_roi roi){
+
+    this->plan_ = plan;
+    this->source_ = NULL;
+    this->saving_measure_slices_ = true;
+    this->resuming_ = false;
+    this->halo_ = 0;
+    this->margin_ = 0;
+    this->measure_kind_ = TOMO_MEASURE_EXPERIMENTAL;
+    this->measure_constant_ = 0.0;
+    this->frangi_constant_ = 0.0;
+    this->orientation_enabled_ = false;
+    this->engine_ = TOMO_ENGINE_TENSOR;
+    this->filtered_ = false;
 
     fstream in_filelist(address_filelist,fstream::in);
 
@@ -186,20 +292,34 @@ tomo_super_tiff::tomo_super_tiff(const char *address_filelist){
     }
     this->prefix_ = string(prefix);
 
-    if(size_tiffs < TIFF_IMAGE_LARGE_SIZE){
+    //plan from the headers before reading anything
+    if(this->plan_.read_headers(this->prefix_, this->address_tiffs_) == false)
+        exit(-1);
+    if(roi.whole() == false){
+        this->set_roi_(roi);
+        size_tiffs = this->address_tiffs_.size();
+    }
+    this->plan_.choose();
+    this->plan_.print(cout);
+
+    if(this->plan_.mode != TOMO_PLAN_OUT_OF_CORE){
         cout << "change working directory to " << prefix <<endl;
         chdir(prefix);
 
+        tomo_stage stage("read");
         progressbar *progress = progressbar_new("Reading .tifs",size_tiffs);
         #pragma omp parallel for
         for(int i=0;i<size_tiffs;++i){
-            tiffs_[i] = tomo_tiff(this->address_tiffs_[i].c_str());
+            tiffs_[i] = tomo_tiff(this->address_tiffs_[i].c_str(), this->box_);
             #pragma omp critical
             {
                 progressbar_inc(progress);
             }
         }
         progressbar_finish(progress);
+        for(int i=0;i<size_tiffs;++i){
+            stage.add_voxels( count_voxels(this->tiffs_[i].gray_scale_) );
+        }
 
         cout << "change working directory back to " << original_dir <<endl;
         chdir(original_dir);
@@ -212,54 +332,392 @@ tomo_super_tiff::tomo_super_tiff(const char *address_filelist){
     return;
 }
 
-float tomo_super_tiff::Ix_(int x, int y, int z){
-    if( x+1 >= this->tiffs_[z][y].size() )
-        return this->tiffs_[z][y][x] - this->tiffs_[z][y][x-1];
-    else if( x-1 < 0)
-        return this->tiffs_[z][y][x+1] - this->tiffs_[z][y][x];
-    else
-        return ( this->tiffs_[z][y][x+1] - this->tiffs_[z][y][x-1] ) / 2.0;
+tomo_super_tiff::tomo_super_tiff(vector< vector< vector<float> > >& volume, tomo_plan plan){
+
+    this->plan_ = plan;
+    this->source_ = NULL;
+    this->saving_measure_slices_ = true;
+    this->resuming_ = false;
+    this->halo_ = 0;
+    this->margin_ = 0;
+    this->measure_kind_ = TOMO_MEASURE_EXPERIMENTAL;
+    this->measure_constant_ = 0.0;
+    this->frangi_constant_ = 0.0;
+    this->orientation_enabled_ = false;
+    this->engine_ = TOMO_ENGINE_TENSOR;
+    this->filtered_ = false;
+
+    //the volume is in memory already, there is nothing to reload slices from
+    this->plan_.set_dimensions(volume.size() > 0 ? volume[0][0].size() : 0, volume.size() > 0 ? volume[0].size() : 0, volume.size());
+    if(this->plan_.choose() == TOMO_PLAN_OUT_OF_CORE)
+        this->plan_.mode = TOMO_PLAN_SLAB;
+
+    this->tiffs_.resize(volume.size());
+    this->address_tiffs_.resize(volume.size());
+    #pragma omp parallel for
+    for(int i=0;i<volume.size();++i){
+        this->tiffs_[i] = tomo_tiff(volume[i]);
+    }
+    return;
 }
 
-float tomo_super_tiff::Iy_(int x, int y, int z){
-    if( y+1 >= this->tiffs_[z].size() )
-        return this->tiffs_[z][y][x] - this->tiffs_[z][y-1][x];
-    else if( y-1 < 0)
-        return this->tiffs_[z][y+1][x] - this->tiffs_[z][y][x];
-    else
-        return ( this->tiffs_[z][y+1][x] - this->tiffs_[z][y-1][x] ) / 2.0;
+tomo_super_tiff::tomo_super_tiff(tomo_slice_source *source, tomo_plan plan){
+
+    this->plan_ = plan;
+    this->source_ = source;
+    this->saving_measure_slices_ = true;
+    this->resuming_ = false;
+    this->halo_ = 0;
+    this->margin_ = 0;
+    this->measure_kind_ = TOMO_MEASURE_EXPERIMENTAL;
+    this->measure_constant_ = 0.0;
+    this->frangi_constant_ = 0.0;
+    this->orientation_enabled_ = false;
+    this->engine_ = TOMO_ENGINE_TENSOR;
+    this->filtered_ = false;
+
+    int size_tiffs = source->size();
+    this->tiffs_.resize(size_tiffs);
+    this->address_tiffs_.resize(size_tiffs);
+
+    //a source has no headers, the first slice tells the dimensions
+    if(size_tiffs > 0){
+        this->load_tiff_(0);
+        this->plan_.set_dimensions(this->tiffs_[0].width_, this->tiffs_[0].height_, size_tiffs);
+        this->tiffs_[0].clear();
+    }
+    this->plan_.choose();
+    this->plan_.print(cout);
+
+    if(this->plan_.mode != TOMO_PLAN_OUT_OF_CORE){
+        tomo_stage stage("read");
+        progressbar *progress = progressbar_new("Loading slices",size_tiffs);
+        #pragma omp parallel for
+        for(int i=0;i<size_tiffs;++i){
+            this->load_tiff_(i);
+            #pragma omp critical
+            {
+                progressbar_inc(progress);
+            }
+        }
+        progressbar_finish(progress);
+        for(int i=0;i<size_tiffs;++i){
+            stage.add_voxels( count_voxels(this->tiffs_[i].gray_scale_) );
+        }
+
+    }else{
+        cout << "size_tiffs = " << size_tiffs <<endl;
+        cout << "loading slices when needed due to the lack of memory." <<endl;
+    }
+    return;
+}
+
+void tomo_super_tiff::set_roi_(const tomo_roi &roi){
+
+    tomo_roi region = roi.clipped(this->plan_.size_x, this->plan_.size_y, this->plan_.size_z);
+    if(region.empty()){
+        cerr << "ERROR : the roi is outside of the " << this->plan_.size_x << " x " << this->plan_.size_y
+             << " x " << this->plan_.size_z << " volume" <<endl;
+        exit(-1);
+    }
+
+    this->halo_ = this->plan_.halo();
+    this->box_ = this->plan_.read_box(region);
+    this->roi_ = region.relative(this->box_);
+
+    this->address_tiffs_ = vector<string>(this->address_tiffs_.begin() + this->box_.z0, this->address_tiffs_.begin() + this->box_.z1);
+    this->tiffs_.clear();
+    this->tiffs_.resize(this->address_tiffs_.size());
+    this->plan_.set_dimensions(this->box_.size_x(), this->box_.size_y(), this->box_.size_z(), this->plan_.bits_per_sample);
+
+    cout << "roi " << region.x0 << ":" << region.x1 << "," << region.y0 << ":" << region.y1 << "," << region.z0 << ":" << region.z1
+         << ", reading " << this->box_.x0 << ":" << this->box_.x1 << "," << this->box_.y0 << ":" << this->box_.y1
+         << "," << this->box_.z0 << ":" << this->box_.z1 <<endl;
+
+    return;
 }
 
-float tomo_super_tiff::Iz_(int x, int y, int z){
-    if( z+1 >= this->tiffs_.size() )
-        return this->tiffs_[z][y][x] - this->tiffs_[z-1][y][x];
-    else if( z-1 < 0)
-        return this->tiffs_[z+1][y][x] - this->tiffs_[z][y][x];
-    else
-        return ( this->tiffs_[z+1][y][x] - this->tiffs_[z-1][y][x] ) / 2.0;
+template<class T>
+static void crop_slice(vector< vector<T> > &slice, const tomo_roi &roi){
+    if(slice.size() == 0)
+        return;
+    slice.erase(slice.begin() + roi.y1, slice.end());
+    slice.erase(slice.begin(), slice.begin() + roi.y0);
+    for(int j=0;j<slice.size();++j){
+        slice[j].erase(slice[j].begin() + roi.x1, slice[j].end());
+        slice[j].erase(slice[j].begin(), slice[j].begin() + roi.x0);
+    }
+    return;
 }
 
-float tomo_super_tiff::summation_within_window_gaussianed_(int x, int y, int z, int size){
+template<class T>
+static void crop_volume(vector< vector< vector<T> > > &volume, const tomo_roi &roi){
+    if(volume.size() == 0)
+        return;
+    volume.erase(volume.begin() + roi.z1, volume.end());
+    volume.erase(volume.begin(), volume.begin() + roi.z0);
+    #pragma omp parallel for
+    for(int i=0;i<volume.size();++i){
+        crop_slice(volume[i], roi);
+    }
+    return;
+}
 
-    float summation = 0.0;
+void tomo_super_tiff::crop_to_roi_(){
 
-    for(int i=0;i<size;++i){ // x
-        for(int j=0;j<size;++j){ // y
-            for(int k=0;k<size;++k){ // z
+    if(this->roi_.whole())
+        return;
+
+    crop_volume(this->measure_, this->roi_);
+    crop_volume(this->eigen_values_, this->roi_);
+    crop_volume(this->orientation_, this->roi_);
+    //the ghosts of the differential matrix go along
+    tomo_roi roi_margin = this->roi_;
+    roi_margin.x1 += 2*this->margin_;
+    roi_margin.y1 += 2*this->margin_;
+    crop_volume(this->differential_matrix_, roi_margin);
+    for(int i=0;i<this->differential_matrix_.size();++i){
+        tomo_halo_fill(this->differential_matrix_[i], this->margin_, TOMO_HALO_ZERO, matrix(3,0.0));
+    }
+    crop_volume(this->tensor_, this->roi_);
+
+    this->tiffs_.erase(this->tiffs_.begin() + this->roi_.z1, this->tiffs_.end());
+    this->tiffs_.erase(this->tiffs_.begin(), this->tiffs_.begin() + this->roi_.z0);
+    this->address_tiffs_.erase(this->address_tiffs_.begin() + this->roi_.z1, this->address_tiffs_.end());
+    this->address_tiffs_.erase(this->address_tiffs_.begin(), this->address_tiffs_.begin() + this->roi_.z0);
+    for(int i=0;i<this->tiffs_.size();++i){
+        crop_slice(this->tiffs_[i].gray_scale_, this->roi_);
+        this->tiffs_[i].height_ = this->roi_.size_y();
+        this->tiffs_[i].width_ = this->roi_.size_x();
+    }
+
+    this->plan_.set_dimensions(this->roi_.size_x(), this->roi_.size_y(), this->roi_.size_z(), this->plan_.bits_per_sample);
+    this->roi_ = tomo_roi();
+
+    return;
+}
+
+void tomo_super_tiff::load_tiff_(int index_z){
+
+    if(this->source_ == NULL){
+        this->tiffs_[index_z] = tomo_tiff( this->address_tiffs_[index_z].c_str(), this->box_ );
+        return;
+    }
 
-                int sx = x+i;
-                int sy = y+j;
-                int sz = z+k;
+    tomo_tiff &tiff = this->tiffs_[index_z];
+    this->source_->load(index_z, tiff.gray_scale_);
+    tiff.height_ = tiff.gray_scale_.size();
+    tiff.width_ = tiff.height_ > 0 ? tiff.gray_scale_[0].size() : 0;
+    tiff.bits_per_sample_ = 16;
+    tiff.samples_per_pixel_ = 1;
 
-                sz = sz < 0 ? 0 : sz;
-                sy = sy < 0 ? 0 : sy;
-                sx = sx < 0 ? 0 : sx;
+    return;
+}
 
-                sz = sz >= this->tiffs_.size() ? this->tiffs_.size()-1 : sz;
-                sy = sy >= this->tiffs_[sz].size() ? this->tiffs_[sz].size()-1 : sy;
-                sx = sx >= this->tiffs_[sz][sy].size() ? this->tiffs_[sz][sy].size()-1 : sx;
+void tomo_super_tiff::filter_slices_(){
 
-                summation += this->tiffs_[sz][sy][sx] * this->gaussian_window_[k][j][i];
+    if(this->filters_.size() == 0 || this->filtered_)
+        return;
+    this->filtered_ = true;
+
+    int size_z = this->tiffs_.size();
+    for(int f=0;f<this->filters_.size();++f){
+        tomo_stage stage("filter");
+        tomo_slice_filter *filter = this->filters_[f];
+        int radius = filter->radius_z();
+
+        //filtered slice z goes back in place once the raw one is no longer needed, radius slices later
+        vector< vector< vector<float> > > pending(radius+1);
+        vector< vector< vector<float> >* > window(2*radius + 1);
+        progressbar *progress = progressbar_new("Filtering",size_z);
+        for(int i=0;i<size_z;++i){
+            tomo_trace_scope trace("filter_slice", i);
+            for(int t=0;t<window.size();++t){
+                int k = i - radius + t;
+                window[t] = &this->tiffs_[ k < 0 ? 0 : (k >= size_z ? size_z-1 : k) ].gray_scale_;
+            }
+            filter->filter(i, window, pending[i % (radius+1)]);
+            stage.add_voxels( count_voxels(pending[i % (radius+1)]) );
+            if(i - radius >= 0)
+                this->tiffs_[i-radius].gray_scale_.swap( pending[(i-radius) % (radius+1)] );
+            progressbar_inc(progress);
+        }
+        for(int i=size_z-radius>0 ? size_z-radius : 0;i<size_z;++i){
+            this->tiffs_[i].gray_scale_.swap( pending[i % (radius+1)] );
+        }
+        filter->release();
+        progressbar_finish(progress);
+    }
+
+    return;
+}
+
+vector< vector<float> >& tomo_super_tiff::filter_input_(int filter, int index_z){
+
+    vector< vector<float> > &slice = this->filter_cache_[filter][index_z];
+    if(slice.size() > 0)
+        return slice;
+
+    if(filter == 0){
+        this->load_tiff_(index_z);
+        slice.swap(this->tiffs_[index_z].gray_scale_);
+        return slice;
+    }
+
+    int radius = this->filters_[filter-1]->radius_z();
+    int size_z = this->tiffs_.size();
+    vector< vector< vector<float> >* > window(2*radius + 1);
+    for(int t=0;t<window.size();++t){
+        int k = index_z - radius + t;
+        window[t] = &this->filter_input_(filter-1, k < 0 ? 0 : (k >= size_z ? size_z-1 : k));
+    }
+    this->filters_[filter-1]->filter(index_z, window, slice);
+
+    return slice;
+}
+
+void tomo_super_tiff::load_filtered_tiff_(int index_z){
+
+    if(this->filters_.size() == 0){
+        this->load_tiff_(index_z);
+        return;
+    }
+
+    int last = this->filters_.size() - 1;
+    this->filter_cache_.resize(this->filters_.size());
+    for(int f=0;f<=last;++f){
+        this->filter_cache_[f].resize(this->tiffs_.size());
+    }
+    int radius = this->filters_[last]->radius_z();
+    int size_z = this->tiffs_.size();
+    vector< vector< vector<float> >* > window(2*radius + 1);
+    for(int t=0;t<window.size();++t){
+        int k = index_z - radius + t;
+        window[t] = &this->filter_input_(last, k < 0 ? 0 : (k >= size_z ? size_z-1 : k));
+    }
+
+    tomo_tiff &tiff = this->tiffs_[index_z];
+    this->filters_[last]->filter(index_z, window, tiff.gray_scale_);
+    tiff.height_ = tiff.gray_scale_.size();
+    tiff.width_ = tiff.height_ > 0 ? tiff.gray_scale_[0].size() : 0;
+
+    return;
+}
+
+void tomo_super_tiff::free_filter_cache_(int begin_z, int end_z){
+
+    //the input of a filter is needed as far as the radii of it & the filters after it
+    int reach = 0;
+    for(int f=this->filter_cache_.size()-1;f>=0;--f){
+        reach += this->filters_[f]->radius_z();
+        for(int i=0;i<this->filter_cache_[f].size();++i){
+            if(i < begin_z - reach || i >= end_z + reach)
+                vector< vector<float> >().swap(this->filter_cache_[f][i]);
+        }
+    }
+
+    return;
+}
+
+void tomo_super_tiff::emit_slice_(int index_z){
+
+    //the sinks only see the roi, indexed from its corner
+    if(this->roi_.whole() == false && this->sinks_.size() > 0){
+        if(index_z < this->roi_.z0 || index_z >= this->roi_.z1)
+            return;
+        vector< vector<float> > measure = this->measure_[index_z];
+        crop_slice(measure, this->roi_);
+        vector< vector< vector<float> > > eigen_values;
+        if(index_z < this->eigen_values_.size()){
+            eigen_values = this->eigen_values_[index_z];
+            crop_slice(eigen_values, this->roi_);
+        }
+        vector< vector<uint32_t> > orientation;
+        if(index_z < this->orientation_.size()){
+            orientation = this->orientation_[index_z];
+            crop_slice(orientation, this->roi_);
+        }
+        for(int s=0;s<this->sinks_.size();++s){
+            if(eigen_values.size() > 0)
+                this->sinks_[s]->eigen_values_slice(index_z - this->roi_.z0, eigen_values);
+            if(orientation.size() > 0)
+                this->sinks_[s]->orientation_slice(index_z - this->roi_.z0, orientation);
+            this->sinks_[s]->measure_slice(index_z - this->roi_.z0, measure);
+        }
+        return;
+    }
+
+    for(int s=0;s<this->sinks_.size();++s){
+        if(index_z < this->eigen_values_.size() && this->eigen_values_[index_z].size() > 0)
+            this->sinks_[s]->eigen_values_slice(index_z, this->eigen_values_[index_z]);
+        if(index_z < this->orientation_.size() && this->orientation_[index_z].size() > 0)
+            this->sinks_[s]->orientation_slice(index_z, this->orientation_[index_z]);
+        this->sinks_[s]->measure_slice(index_z, this->measure_[index_z]);
+    }
+
+    return;
+}
+
+void tomo_super_tiff::emit_finish_(float normalized){
+
+    for(int s=0;s<this->sinks_.size();++s){
+        this->sinks_[s]->finish(normalized);
+    }
+
+    return;
+}
+
+void tomo_super_tiff::make_differential_row_(int z, int y, vector< vector<float> >& products){
+
+    int size_x = this->tiffs_[z][y].size();
+    if(size_x == 0)
+        return;
+    int size_y = this->tiffs_[z].size();
+    int size_z = this->tiffs_.size();
+
+    //one-sided differences on the borders
+    tomo_gradient_rows rows;
+    rows.center = &this->tiffs_[z][y][0];
+    rows.previous_y = &this->tiffs_[z][ y-1 >= 0 ? y-1 : y ][0];
+    rows.next_y = &this->tiffs_[z][ y+1 < size_y ? y+1 : y ][0];
+    rows.scale_y = y-1 >= 0 && y+1 < size_y ? 0.5 : 1.0;
+    rows.previous_z = &this->tiffs_[ z-1 >= 0 ? z-1 : z ][y][0];
+    rows.next_z = &this->tiffs_[ z+1 < size_z ? z+1 : z ][y][0];
+    rows.scale_z = z-1 >= 0 && z+1 < size_z ? 0.5 : 1.0;
+    rows.size_x = size_x;
+
+    float *rows_products[TOMO_GRADIENT_PRODUCTS];
+    products.resize(TOMO_GRADIENT_PRODUCTS);
+    for(int p=0;p<TOMO_GRADIENT_PRODUCTS;++p){
+        products[p].resize(size_x);
+        rows_products[p] = &products[p][0];
+    }
+    tomo_gradient::row(rows, rows_products);
+
+    matrix *matrix_row = &this->differential_matrix_[z][this->margin_+y][this->margin_];
+    for(int x=0;x<size_x;++x){
+        matrix &this_matrix = matrix_row[x];
+        this_matrix[0][0] = products[TOMO_GRADIENT_IXIX][x];
+        this_matrix[1][1] = products[TOMO_GRADIENT_IYIY][x];
+        this_matrix[2][2] = products[TOMO_GRADIENT_IZIZ][x];
+
+        this_matrix[0][1] = this_matrix[1][0] = products[TOMO_GRADIENT_IXIY][x];
+        this_matrix[0][2] = this_matrix[2][0] = products[TOMO_GRADIENT_IXIZ][x];
+        this_matrix[1][2] = this_matrix[2][1] = products[TOMO_GRADIENT_IYIZ][x];
+    }
+
+    return;
+}
+
+float tomo_super_tiff::summation_within_window_gaussianed_(vector< vector< vector<float> > >& planes, int x, int y, int size){
+
+    // planes : the size slices under the window, with size ghosts replicated around
+    float summation = 0.0;
+
+    for(int i=0;i<size;++i){ // x
+        for(int j=0;j<size;++j){ // y
+            for(int k=0;k<size;++k){ // z
+                summation += planes[k][size+y+j][size+x+i] * this->gaussian_window_[k][j][i];
             }
         }
     }
@@ -301,16 +759,25 @@ void tomo_super_tiff::down_size(int magnification, const char *save_prefix, floa
     process = 0;
     #pragma omp parallel for
     for(int z=0;z<result.size();++z){
+
+        //the slices under the window, clamped to the volume
+        vector< vector< vector<float> > > planes(magnification);
+        for(int k=0;k<magnification;++k){
+            int sz = z*magnification - magnification/2 + k;
+            sz = sz < 0 ? 0 : sz;
+            sz = sz >= this->tiffs_.size() ? this->tiffs_.size()-1 : sz;
+            tomo_halo_copy(this->tiffs_[sz].gray_scale_, planes[k], magnification, TOMO_HALO_REPLICATE, 0.0f);
+        }
+
         for(int y=0;y<result[z].size();++y){
             for(int x=0;x<result[z][y].size();++x){
 
                 int sx = x*magnification;
                 int sy = y*magnification;
-                int sz = z*magnification;
 
-                result[z][y][x] = this->summation_within_window_gaussianed_( sx-magnification/2,
+                result[z][y][x] = this->summation_within_window_gaussianed_( planes,
+                                                                             sx-magnification/2,
                                                                              sy-magnification/2,
-                                                                             sz-magnification/2,
                                                                              magnification);
             }
         }
@@ -349,19 +816,23 @@ void tomo_super_tiff::down_size(int magnification, const char *save_prefix, floa
 
 void tomo_super_tiff::make_differential_matrix_(){
 
-    //init
+    tomo_stage stage("gradient");
+
+    //init, with zero ghosts for the tensor window
+    this->margin_ = this->plan_.window_size/2;
     progressbar *progress = progressbar_new("Initializing",this->tiffs_.size());
     differential_matrix_.resize(this->tiffs_.size());
     #pragma omp parallel for
     for(int i=0;i<differential_matrix_.size();++i){
-        this->differential_matrix_[i].resize(this->tiffs_[i].size());
-        for(int j=0;j<differential_matrix_[i].size();++j){
-            differential_matrix_[i][j].resize(this->tiffs_[i][j].size(),matrix(3,0));
-        }
+        int size_x = this->tiffs_[i].size() > 0 ? this->tiffs_[i][0].size() : 0;
+        tomo_halo_resize(this->differential_matrix_[i], size_x, this->tiffs_[i].size(), this->margin_, matrix(3,0));
         #pragma omp critical
         progressbar_inc(progress);
     }
     progressbar_finish(progress);
+    for(int i=0;i<this->tiffs_.size();++i){
+        stage.add_voxels( count_voxels(this->tiffs_[i].gray_scale_) );
+    }
 
     /* differential_matrix      j->
      * __                           __
@@ -376,25 +847,16 @@ void tomo_super_tiff::make_differential_matrix_(){
     progress = progressbar_new("Calculating",this->tiffs_.size());
     #pragma omp parallel for
     for(int z=0;z<this->tiffs_.size();++z){
+        tomo_trace_scope trace("gradient_slice", z);
+        vector< vector<float> > products;
         for(int y=0;y<this->tiffs_[z].size();++y){
-            for(int x=0;x<this->tiffs_[z][y].size();++x){
-
-                matrix &this_matrix = differential_matrix_[z][y][x];
-                float Ix = this->Ix_(x,y,z);
-                float Iy = this->Iy_(x,y,z);
-                float Iz = this->Iz_(x,y,z);
-
-                this_matrix[0][0] = Ix*Ix;
-                this_matrix[1][1] = Iy*Iy;
-                this_matrix[2][2] = Iz*Iz;
-
-                this_matrix[0][1] = this_matrix[1][0] = Ix*Iy;
-                this_matrix[0][2] = this_matrix[2][0] = Ix*Iz;
-                this_matrix[1][2] = this_matrix[2][1] = Iy*Iz;
-            }
+            this->make_differential_row_(z, y, products);
+        }
+        {
+            tomo_trace_scope trace_progress("progress");
+            #pragma omp critical
+            progressbar_inc(progress);
         }
-        #pragma omp critical
-        progressbar_inc(progress);
     }
     progressbar_finish(progress);
 
@@ -403,93 +865,40 @@ void tomo_super_tiff::make_differential_matrix_(){
 
 void tomo_super_tiff::make_tensor_(const int window_size){
 
+    tomo_stage stage("tensor");
+
     //init
-    this->tensor_.resize(this->differential_matrix_.size());
-    progressbar *progress = progressbar_new("Initializing",this->differential_matrix_.size());
+    this->tensor_.resize(this->tiffs_.size());
+    progressbar *progress = progressbar_new("Initializing",this->tiffs_.size());
     #pragma omp parallel for
     for(int i=0;i<this->tensor_.size();++i){
-        this->tensor_[i].resize(this->differential_matrix_[i].size());
+        this->tensor_[i].resize(this->tiffs_[i].size());
         for(int j=0;j<this->tensor_[i].size();++j){
-            this->tensor_[i][j].resize(this->differential_matrix_[i][j].size());
+            this->tensor_[i][j].resize(this->tiffs_[i][j].size());
         }
         #pragma omp critical
         progressbar_inc(progress);
     }
     progressbar_finish(progress);
+    stage.add_voxels( count_volume_voxels(this->tensor_) );
+    this->make_ghost_row_(window_size);
 
     // struct tensor A = sum_u_v_w( gaussian(u,v,w) * differential(u,v,w) )
 
     //for every points
+    vector<float> weights = flatten_window(this->gaussian_window_);
     progress = progressbar_new("Calculating",this->tensor_.size());
     #pragma omp parallel for
     for(int z=0;z<this->tensor_.size();++z){
+        tomo_trace_scope trace("tensor_slice", z);
         for(int y=0;y<this->tensor_[z].size();++y){
-            for(int x=0;x<this->tensor_[z][y].size();++x){
-
-                matrix temp(3,0);
-                //inside the window
-                for(int k=z-window_size/2;k<z+(window_size+1)/2;++k){
-                    for(int j=y-window_size/2;j<y+(window_size+1)/2;++j){
-                        for(int i=x-window_size/2;i<x+(window_size+1)/2;++i){
-                            //check boundary
-                            if( k < 0 || k >= this->tensor_.size() ||
-                                    j < 0 || j >= this->tensor_[k].size() ||
-                                    i < 0 || i >= this->tensor_[k][j].size())
-                                continue;
-                            //sum it up with gaussian ratio
-                            int k_g = k - (z-window_size/2);
-                            int j_g = j - (y-window_size/2);
-                            int i_g = i - (x-window_size/2);
-                            temp += differential_matrix_[k][j][i] * gaussian_window_[k_g][j_g][i_g];
-                        }
-                    }
-                }
-                this->tensor_[z][y][x] = temp;
-            }
+            this->make_tensor_row_(window_size, z, y, weights);
         }
-        #pragma omp critical
-        progressbar_inc(progress);
-    }
-    progressbar_finish(progress);
-
-    return;
-}
-
-void tomo_super_tiff::make_nobles_measure_(float measure_constant){
-
-    cout << "making nobles measures..."<<endl;
-
-    //init
-
-    this->measure_.resize( this->tensor_.size() );
-    progressbar *progress = progressbar_new("Initializing", this->tensor_.size());
-    #pragma omp parallel for
-    for(int i=0;i<measure_.size();++i){
-        this->measure_[i].resize(this->tensor_[i].size());
-        for(int j=0;j<measure_[i].size();++j){
-            this->measure_[i][j].resize(this->tensor_[i][j].size(),0.0);
-        }
-        #pragma omp critical
-        progressbar_inc(progress);
-    }
-    progressbar_finish(progress);
-
-    //calculate measure
-    // Noble's cornor measure :
-    //      Mc = 2* det(tensor) / ( trace(tensor) + c )
-
-    progress = progressbar_new("Calculating",this->measure_.size());
-    #pragma omp parallel for
-    for(int i=0;i<measure_.size();++i){
-        for(int j=0;j<measure_[i].size();++j){
-            for(int k=0;k<measure_[i][j].size();++k){
-                float trace = this->tensor_[i][j][k].trace();
-                this->measure_[i][j][k] = 2 * this->tensor_[i][j][k].det();
-                this->measure_[i][j][k] /= trace*trace + measure_constant;
-            }
+        {
+            tomo_trace_scope trace_progress("progress");
+            #pragma omp critical
+            progressbar_inc(progress);
         }
-        #pragma omp critical
-        progressbar_inc(progress);
     }
     progressbar_finish(progress);
 
@@ -498,6 +907,8 @@ void tomo_super_tiff::make_nobles_measure_(float measure_constant){
 
 void tomo_super_tiff::make_eigen_values_(){
 
+    tomo_stage stage("eigen", count_volume_voxels(this->tensor_));
+
     cout << "making eigen values..." <<endl;
 
     //init
@@ -517,12 +928,23 @@ void tomo_super_tiff::make_eigen_values_(){
         progressbar_inc(progress);
     }
     progressbar_finish(progress);
+    this->orientation_.clear();
+    if(this->orientation_enabled_){
+        this->orientation_.resize(this->tensor_.size());
+        for(int i=0;i<this->orientation_.size();++i){
+            this->orientation_[i].resize(this->tensor_[i].size());
+            for(int j=0;j<this->orientation_[i].size();++j){
+                this->orientation_[i][j].resize(this->tensor_[i][j].size(), 0);
+            }
+        }
+    }
 
     //using gsl for eigenvalue
     progress = progressbar_new("Calculating",this->tensor_.size());
 
     #pragma omp parallel for
     for(int i=0;i<this->tensor_.size();++i){
+        tomo_trace_scope trace("eigen_slice", i);
         for(int j=0;j<this->tensor_[i].size();++j){
             for(int k=0;k<this->tensor_[i][j].size();++k){
 
@@ -549,7 +971,12 @@ void tomo_super_tiff::make_eigen_values_(){
                 //save absolute of it to eigen_values_
                 for(int x=0;x<3;++x){
                     float ev = gsl_vector_get(eigen_value,x);
-                    this->eigen_values_[i][j][k][x] = ev > 0.0 ? ev : -ev;
+                    this->eigen_values_[i][j][k][x] = ev > 0.0 || this->engine_ == TOMO_ENGINE_HESSIAN ? ev : -ev;
+                }
+                if(this->orientation_enabled_){
+                    this->orientation_[i][j][k] = tomo_orientation_encode(gsl_matrix_get(eigen_vector,0,0),
+                                                                          gsl_matrix_get(eigen_vector,1,0),
+                                                                          gsl_matrix_get(eigen_vector,2,0));
                 }
 
                 //free everything
@@ -559,17 +986,23 @@ void tomo_super_tiff::make_eigen_values_(){
                 gsl_eigen_symmv_free(w);
             }
         }
-        #pragma omp critical
-        progressbar_inc(progress);
+        {
+            tomo_trace_scope trace_progress("progress");
+            #pragma omp critical
+            progressbar_inc(progress);
+        }
     }
     progressbar_finish(progress);
 
     return ;
 }
 
-void tomo_super_tiff::experimental_measurement(float threshold){
+void tomo_super_tiff::make_measure_(float threshold){
+
+    tomo_stage stage("measure", count_volume_voxels(this->eigen_values_));
 
     cout << "making measurement..." <<endl;
+    this->make_frangi_constant_();
 
     //resize & init
     this->measure_.resize(this->eigen_values_.size());
@@ -589,25 +1022,61 @@ void tomo_super_tiff::experimental_measurement(float threshold){
     progress = progressbar_new("Calculating",this->measure_.size());
     #pragma omp parallel for
     for(int i=0;i<this->measure_.size();++i){
-        for(int j=0;j<this->measure_[i].size();++j){
-            for(int k=0;k<this->measure_[i][j].size();++k){
-                vector<float> &ev = this->eigen_values_[i][j][k];
-                measure_[i][j][k] = 0.3 * ( ev[0] + ev[1] + ev[2]) * ( ev[0] + ev[1] + ev[2]) - ev[0] * ev[1] * ev[2];
-                if( threshold > 0 ){
-                    if(measure_[i][j][k] >= threshold )
-                        measure_[i][j][k] = 1.0;
-                    else
-                        measure_[i][j][k] = 0.0;
+        tomo_trace_scope trace("measure_slice", i);
+        this->measure_rows_(i, 0, this->measure_[i].size(), threshold);
+        {
+            tomo_trace_scope trace_progress("progress");
+            #pragma omp critical
+            progressbar_inc(progress);
+        }
+    }
+    progressbar_finish(progress);
+
+    return;
+}
+
+void tomo_super_tiff::make_frangi_constant_(){
+
+    if(this->frangi_automatic_() == false)
+        return;
+
+    //the frobenius norm of the hessian from its eigen values
+    float maximum = 0.0;
+    #pragma omp parallel
+    {
+        float maximum_thread = 0.0;
+        #pragma omp for
+        for(int i=0;i<this->eigen_values_.size();++i){
+            for(int j=0;j<this->eigen_values_[i].size();++j){
+                for(int k=0;k<this->eigen_values_[i][j].size();++k){
+                    vector<float> &ev = this->eigen_values_[i][j][k];
+                    float norm2 = ev[0]*ev[0] + ev[1]*ev[1] + ev[2]*ev[2];
+                    maximum_thread = norm2 > maximum_thread ? norm2 : maximum_thread;
                 }
             }
         }
         #pragma omp critical
-        progressbar_inc(progress);
+        maximum = maximum_thread > maximum ? maximum_thread : maximum;
     }
-    progressbar_finish(progress);
+    this->frangi_constant_ = 0.5 * sqrt(maximum);
+    cout << "frangi constant " << this->frangi_constant_ <<endl;
+
+    return;
+}
+
+void tomo_super_tiff::experimental_measurement(float threshold){
+
+    this->make_measure_(threshold);
+
+    //hand the raw measurement over to the sinks
+    for(int i=0;i<this->measure_.size() && this->sinks_.size() > 0;++i){
+        this->emit_slice_(i);
+    }
+    this->crop_to_roi_();
 
     //normalize
     this->experimental_measurement_normalize_();
+    this->emit_finish_(this->normalized_measure_);
 
     return ;
 
@@ -615,7 +1084,10 @@ void tomo_super_tiff::experimental_measurement(float threshold){
 
 void tomo_super_tiff::make_differential_matrix_(int start_z, int number_z){
 
+    tomo_stage stage("gradient");
+
     //init
+    this->margin_ = this->plan_.window_size/2;
     this->differential_matrix_.resize(this->tiffs_.size());
 
     /* differential_matrix      j->
@@ -636,30 +1108,18 @@ void tomo_super_tiff::make_differential_matrix_(int start_z, int number_z){
         }
         else if(this->differential_matrix_[z].size() == 0){ // only calculate one which not calculated before
 
-            //init
-            this->differential_matrix_[z].resize(this->tiffs_[z].size());
-            #pragma omp parallel for
-            for(int y=0;y<this->differential_matrix_[z].size();++y){
-                this->differential_matrix_[z][y].resize(this->tiffs_[z][y].size(),matrix(3,0.0));
-            }
+            //init, with zero ghosts for the tensor window
+            int size_x = this->tiffs_[z].size() > 0 ? this->tiffs_[z][0].size() : 0;
+            tomo_halo_resize(this->differential_matrix_[z], size_x, this->tiffs_[z].size(), this->margin_, matrix(3,0.0));
+            stage.add_voxels( count_voxels(this->tiffs_[z].gray_scale_) );
 
             //calculating
-            #pragma omp parallel for
-            for(int y=0;y<this->tiffs_[z].size();++y){
-                for(int x=0;x<this->tiffs_[z][y].size();++x){
-
-                    matrix &this_matrix = differential_matrix_[z][y][x];
-                    float Ix = this->Ix_(x,y,z);
-                    float Iy = this->Iy_(x,y,z);
-                    float Iz = this->Iz_(x,y,z);
-
-                    this_matrix[0][0] = Ix*Ix;
-                    this_matrix[1][1] = Iy*Iy;
-                    this_matrix[2][2] = Iz*Iz;
-
-                    this_matrix[0][1] = this_matrix[1][0] = Ix*Iy;
-                    this_matrix[0][2] = this_matrix[2][0] = Ix*Iz;
-                    this_matrix[1][2] = this_matrix[2][1] = Iy*Iz;
+            #pragma omp parallel
+            {
+                vector< vector<float> > products;
+                #pragma omp for
+                for(int y=0;y<this->tiffs_[z].size();++y){
+                    this->make_differential_row_(z, y, products);
                 }
             }
         }
@@ -669,6 +1129,8 @@ void tomo_super_tiff::make_differential_matrix_(int start_z, int number_z){
 }
 
 void tomo_super_tiff::make_tensor_(const int window_size, int index_z){
+
+    tomo_stage stage("tensor", count_voxels(this->tiffs_[index_z].gray_scale_));
     //init
     this->tensor_.clear();
     this->tensor_.resize(this->tiffs_.size());
@@ -683,31 +1145,192 @@ void tomo_super_tiff::make_tensor_(const int window_size, int index_z){
     }
 
     //calculating
+    this->make_ghost_row_(window_size);
+    vector<float> weights = flatten_window(this->gaussian_window_);
     #pragma omp parallel for
     for(int y=0;y<this->tiffs_[index_z].size();++y){
-        for(int x=0;x<this->tiffs_[index_z][y].size();++x){
-
-            matrix temp(3,0);
-            //inside the window
-            for(int k=index_z-window_size/2;k<index_z+(window_size+1)/2;++k){
-                for(int j=y-window_size/2;j<y+(window_size+1)/2;++j){
-                    for(int i=x-window_size/2;i<x+(window_size+1)/2;++i){
-                        //check boundary
-                        if( k < 0 || k >= this->tensor_.size() ||
-                                j < 0 || j >= this->tensor_[k].size() ||
-                                i < 0 || i >= this->tensor_[k][j].size())
-                            continue;
-                        //sum it up with gaussian ratio
-                        int k_g = k - (index_z-window_size/2);
-                        int j_g = j - (y-window_size/2);
-                        int i_g = i - (x-window_size/2);
-                        temp += differential_matrix_[k][j][i] * gaussian_window_[k_g][j_g][i_g];
-                    }
+        this->make_tensor_row_(window_size, index_z, y, weights);
+    }
+
+    return;
+}
+
+void tomo_super_tiff::make_hessian_rows_(int index_z){
+
+    //the smoothed slices around, the borders repeated
+    int last_z = this->smoothed_.size() - 1;
+    int size_y = this->smoothed_[index_z].size();
+    int size_x = size_y > 0 ? this->smoothed_[index_z][0].size() : 0;
+    vector< vector<float> > *slices[3];
+    for(int dz=-1;dz<=1;++dz){
+        int z = index_z + dz < 0 ? 0 : (index_z + dz > last_z ? last_z : index_z + dz);
+        slices[dz+1] = &this->smoothed_[z];
+    }
+
+    vector<float> kernel;
+    float variance;
+    int before;
+    tomo_hessian::kernel(this->gaussian_window_, kernel, variance, before);
+
+    this->tensor_[index_z].resize(size_y);
+    #pragma omp parallel for
+    for(int y=0;y<size_y;++y){
+        const float *rows[3][3];
+        for(int dz=0;dz<3;++dz){
+            for(int dy=-1;dy<=1;++dy){
+                int row = y + dy < 0 ? 0 : (y + dy >= size_y ? size_y-1 : y + dy);
+                rows[dz][dy+1] = &(*slices[dz])[row][0];
+            }
+        }
+        this->tensor_[index_z][y].resize(size_x);
+        tomo_hessian::row(rows, size_x, variance, &this->tensor_[index_z][y][0]);
+    }
+
+    return;
+}
+
+void tomo_super_tiff::make_hessian_(){
+
+    tomo_stage stage("hessian");
+
+    vector<float> kernel;
+    float variance;
+    int before;
+    tomo_hessian::kernel(this->gaussian_window_, kernel, variance, before);
+    int size_z = this->tiffs_.size();
+
+    vector< vector< vector<float> >* > volume(size_z);
+    for(int z=0;z<size_z;++z){
+        volume[z] = &this->tiffs_[z].gray_scale_;
+    }
+    tomo_hessian::smooth(volume, kernel, before, this->smoothed_);
+    stage.add_voxels( count_volume_voxels(this->smoothed_) );
+
+    this->tensor_.resize(size_z);
+    for(int z=0;z<size_z;++z){
+        tomo_trace_scope trace("hessian_slice", z);
+        this->make_hessian_rows_(z);
+    }
+    this->smoothed_.clear();
+
+    return;
+}
+
+void tomo_super_tiff::make_hessian_(int index_z){
+
+    tomo_stage stage("hessian", count_voxels(this->tiffs_[index_z].gray_scale_));
+
+    vector<float> kernel;
+    float variance;
+    int before;
+    tomo_hessian::kernel(this->gaussian_window_, kernel, variance, before);
+    int size_z = this->tiffs_.size();
+
+    //the smoothed slices of index_z-1 to index_z+1 & the xy-smoothed ones under their kernel, the others freed
+    this->smoothed_xy_.resize(size_z);
+    this->smoothed_.resize(size_z);
+    int xy_begin = index_z - 1 - before, xy_end = index_z + 1 - before + (int)kernel.size();
+    for(int z=0;z<size_z;++z){
+        if(z < xy_begin)
+            this->smoothed_xy_[z].clear();
+        if(z < index_z - 1)
+            this->smoothed_[z].clear();
+    }
+    for(int k=xy_begin;k<xy_end;++k){
+        int z = k < 0 ? 0 : (k >= size_z ? size_z-1 : k);
+        if(this->smoothed_xy_[z].size() == 0)
+            tomo_hessian::smooth_xy(this->tiffs_[z].gray_scale_, kernel, before, this->smoothed_xy_[z]);
+    }
+    for(int z=index_z-1;z<=index_z+1;++z){
+        if(z < 0 || z >= size_z || this->smoothed_[z].size() > 0)
+            continue;
+        vector< vector< vector<float> >* > slices(kernel.size());
+        for(int t=0;t<kernel.size();++t){
+            int k = z - before + t;
+            slices[t] = &this->smoothed_xy_[ k < 0 ? 0 : (k >= size_z ? size_z-1 : k) ];
+        }
+        tomo_hessian::smooth_z(slices, kernel, this->smoothed_[z]);
+    }
+
+    this->tensor_.clear();
+    this->tensor_.resize(size_z);
+    this->make_hessian_rows_(index_z);
+
+    return;
+}
+
+template<int W>
+void tomo_super_tiff::make_tensor_row_(const int window_size, int z, int y, const vector<float>& weights){
+
+    const int size = W > 0 ? W : window_size;
+    const int before = size/2;          // taps before the center
+    const int after = (size+1)/2 - 1;   // and after
+    vector<matrix> &tensor_row = this->tensor_[z][y];
+
+    //the rows under the window, at x = 0, the ghost row past the first & last slice
+    matrix *rows_fixed[W > 0 ? W*W : 1];
+    vector<matrix*> rows_generic(W > 0 ? 0 : size*size);
+    matrix **rows = W > 0 ? rows_fixed : &rows_generic[0];
+    for(int k=z-before, r=0;k<=z+after;++k){
+        bool inside = k >= 0 && k < this->differential_matrix_.size() && this->differential_matrix_[k].size() > 0;
+        for(int j=y-before;j<=y+after;++j, ++r){
+            rows[r] = inside ? &this->differential_matrix_[k][this->margin_+j][this->margin_] : &this->ghost_row_[this->margin_];
+        }
+    }
+
+    //the ghosts are zero, no boundary check, the taps of a row are unrolled when the size is known
+    for(int x=0;x<tensor_row.size();++x){
+
+        float sum[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}; // xx yy zz xy xz yz
+        const float *weight = &weights[0];
+        for(int r=0;r<size*size;++r){
+            matrix *taps = rows[r] + x - before;
+            if(W > 0){
+                tensor_taps<(W > 0 ? W : 1)>::add(taps, weight, sum);
+            }else{
+                for(int i=0;i<size;++i){
+                    tensor_taps<1>::add(taps+i, weight+i, sum);
                 }
             }
-            this->tensor_[index_z][y][x] = temp;
+            weight += size;
+        }
+
+        matrix &tensor = tensor_row[x];
+        tensor.resize(3);
+        tensor[0][0] = sum[0];
+        tensor[1][1] = sum[1];
+        tensor[2][2] = sum[2];
+        tensor[0][1] = tensor[1][0] = sum[3];
+        tensor[0][2] = tensor[2][0] = sum[4];
+        tensor[1][2] = tensor[2][1] = sum[5];
+    }
+
+    return;
+}
+
+void tomo_super_tiff::make_ghost_row_(const int window_size){
+
+    if(window_size/2 > this->margin_){
+        cerr << "ERROR : the differential matrix has a margin of " << this->margin_
+             << ", window_size " << window_size << " needs " << window_size/2 <<endl;
+        exit(-1);
+    }
+    int size_x = this->tiffs_.size() > 0 && this->tiffs_[0].size() > 0 ? this->tiffs_[0][0].size() : 0;
+    this->ghost_row_.assign(size_x + 2*this->margin_, matrix(3,0.0));
 
-        }
+    return;
+}
+
+void tomo_super_tiff::make_tensor_row_(const int window_size, int z, int y, const vector<float>& weights){
+
+    //dedicated kernels for the usual window sizes, -w 5 by default
+    switch(window_size){
+    case 3:  this->make_tensor_row_<3>(window_size, z, y, weights); break;
+    case 5:  this->make_tensor_row_<5>(window_size, z, y, weights); break;
+    case 7:  this->make_tensor_row_<7>(window_size, z, y, weights); break;
+    case 9:  this->make_tensor_row_<9>(window_size, z, y, weights); break;
+    case 11: this->make_tensor_row_<11>(window_size, z, y, weights); break;
+    default: this->make_tensor_row_<0>(window_size, z, y, weights); break;
     }
 
     return;
@@ -740,7 +1363,9 @@ void tomo_super_tiff::eigen_values_initialize_(){
 
 void tomo_super_tiff::make_eigen_values_(int index_z){
 
-    if(this->tiffs_.size() >= TIFF_IMAGE_LARGE_SIZE){ // for the super large data
+    tomo_stage stage("eigen", count_voxels(this->tiffs_[index_z].gray_scale_));
+
+    if(this->plan_.mode == TOMO_PLAN_OUT_OF_CORE){ // for the super large data
         //allocate the needed and free others
         this->eigen_values_.clear();
         this->eigen_values_.resize( this->tiffs_.size() );
@@ -755,6 +1380,15 @@ void tomo_super_tiff::make_eigen_values_(int index_z){
             }
         }
     }
+    if(this->orientation_enabled_){
+        if(this->plan_.mode == TOMO_PLAN_OUT_OF_CORE)
+            this->orientation_.clear();
+        this->orientation_.resize( this->tiffs_.size() );
+        this->orientation_[index_z].resize( this->tensor_[index_z].size() );
+        for(int j=0;j<this->orientation_[index_z].size();++j){
+            this->orientation_[index_z][j].resize( this->tensor_[index_z][j].size(), 0 );
+        }
+    }
 
     //using gsl for eigenvalue
     #pragma omp parallel for
@@ -784,7 +1418,12 @@ void tomo_super_tiff::make_eigen_values_(int index_z){
             //save absolute of it to eigen_values_
             for(int x=0;x<3;++x){
                 float ev = gsl_vector_get(eigen_value,x);
-                this->eigen_values_[index_z][j][k][x] = ev > 0.0 ? ev : -ev;
+                this->eigen_values_[index_z][j][k][x] = ev > 0.0 || this->engine_ == TOMO_ENGINE_HESSIAN ? ev : -ev;
+            }
+            if(this->orientation_enabled_){
+                this->orientation_[index_z][j][k] = tomo_orientation_encode(gsl_matrix_get(eigen_vector,0,0),
+                                                                            gsl_matrix_get(eigen_vector,1,0),
+                                                                            gsl_matrix_get(eigen_vector,2,0));
             }
 
             //free everything
@@ -845,7 +1484,9 @@ void tomo_super_tiff::experimental_measurement_normalize_(){
 
 void tomo_super_tiff::experimental_measurement_(int index_z, float threshold){
 
-    if( this->tiffs_.size() >= TIFF_IMAGE_LARGE_SIZE ){ // for the super large data
+    tomo_stage stage("measure", count_voxels(this->tiffs_[index_z].gray_scale_));
+
+    if( this->plan_.mode == TOMO_PLAN_OUT_OF_CORE ){ // for the super large data
         //allocate the needed and free others
         this->measure_.clear();
         this->measure_.resize( this->tiffs_.size() );
@@ -859,18 +1500,79 @@ void tomo_super_tiff::experimental_measurement_(int index_z, float threshold){
 
     #pragma omp parallel for
     for(int j=0;j<this->measure_[index_z].size();++j){
-        for(int k=0;k<this->measure_[index_z][j].size();++k){
-            vector<float> &ev = this->eigen_values_[index_z][j][k];
-            measure_[index_z][j][k] = 0.3 * ( ev[0] + ev[1] + ev[2]) * ( ev[0] + ev[1] + ev[2]) - ev[0] * ev[1] * ev[2];
-            if( threshold > 0 ){
-                if( measure_[index_z][j][k] >= threshold )
-                    measure_[index_z][j][k] = 1.0;
-                else
-                    measure_[index_z][j][k] = 0.0;
-            }
+        this->measure_rows_(index_z, j, j+1, threshold);
+    }
+
+    return;
+}
+
+template<class measure_policy, bool thresholded>
+void tomo_super_tiff::measure_rows_(int index_z, int row_begin, int row_end, const measure_policy &measure, float threshold){
+
+    for(int j=row_begin;j<row_end;++j){
+        vector<float> &measure_row = this->measure_[index_z][j];
+        vector< vector<float> > &eigen_values_row = this->eigen_values_[index_z][j];
+        for(int k=0;k<measure_row.size();++k){
+            vector<float> &ev = eigen_values_row[k];
+            float value = measure(ev[0], ev[1], ev[2]);
+            if(thresholded)
+                value = value >= threshold ? 1.0 : 0.0;
+            measure_row[k] = value;
         }
     }
 
+    return;
+}
+
+void tomo_super_tiff::measure_rows_(int index_z, int row_begin, int row_end, float threshold){
+
+    //one instantiation per measure & threshold, picked once per row
+    bool thresholded = threshold > 0;
+    switch(this->measure_kind_){
+    case TOMO_MEASURE_NOBLE:
+        if(thresholded)
+            this->measure_rows_<tomo_measure_noble, true>(index_z, row_begin, row_end, tomo_measure_noble(this->measure_constant_), threshold);
+        else
+            this->measure_rows_<tomo_measure_noble, false>(index_z, row_begin, row_end, tomo_measure_noble(this->measure_constant_), threshold);
+        break;
+    case TOMO_MEASURE_EIGEN_RATIO:
+        if(thresholded)
+            this->measure_rows_<tomo_measure_eigen_ratio, true>(index_z, row_begin, row_end, tomo_measure_eigen_ratio(), threshold);
+        else
+            this->measure_rows_<tomo_measure_eigen_ratio, false>(index_z, row_begin, row_end, tomo_measure_eigen_ratio(), threshold);
+        break;
+    case TOMO_MEASURE_FRANGI:
+        if(thresholded)
+            this->measure_rows_<tomo_measure_frangi, true>(index_z, row_begin, row_end, tomo_measure_frangi(this->frangi_constant_), threshold);
+        else
+            this->measure_rows_<tomo_measure_frangi, false>(index_z, row_begin, row_end, tomo_measure_frangi(this->frangi_constant_), threshold);
+        break;
+    default:
+        if(thresholded)
+            this->measure_rows_<tomo_measure_experimental, true>(index_z, row_begin, row_end, tomo_measure_experimental(), threshold);
+        else
+            this->measure_rows_<tomo_measure_experimental, false>(index_z, row_begin, row_end, tomo_measure_experimental(), threshold);
+        break;
+    }
+
+    return;
+}
+
+void tomo_super_tiff::replan_(int window_size){
+
+    //the window changes the footprint, slices not loaded yet stay out of core
+    if(this->plan_.window_size != window_size){
+        bool loaded = this->plan_.mode != TOMO_PLAN_OUT_OF_CORE;
+        this->plan_.window_size = window_size;
+        this->plan_.choose();
+        if(loaded == false)
+            this->plan_.mode = TOMO_PLAN_OUT_OF_CORE;
+        else if(this->plan_.mode == TOMO_PLAN_OUT_OF_CORE && this->source_ == NULL && this->prefix_.empty())
+            this->plan_.mode = TOMO_PLAN_SLAB; // nothing to reload the slices from
+        cout << "plan : " << tomo_plan::name(this->plan_.mode) <<endl;
+    }
+    if(this->roi_.whole() == false && window_size/2 + 1 > this->halo_)
+        cout << "the roi was read for a smaller window_size, its borders are computed without the whole window" <<endl;
 
     return;
 }
@@ -883,42 +1585,75 @@ void tomo_super_tiff::neuron_detection(const int window_size, float threshold, c
     this->make_gaussian_window_(window_size,standard_deviation*(float)window_size/2.0);
     cout << "\tdone!"<<endl;
 
-    if(this->tiffs_.size() < TIFF_IMAGE_MEDIUM_SIZE){ // prevent starvation
-        cout << "making differential matrix..." <<endl;
-        this->make_differential_matrix_();
+    this->replan_(window_size);
+
+    if(this->engine_ == TOMO_ENGINE_HESSIAN && this->plan_.mode == TOMO_PLAN_OUT_OF_CORE){
+        cerr << "ERROR : the hessian engine needs every slice in memory, try --roi or a larger --memory-budget" <<endl;
+        exit(-1);
+    }
+    if(this->plan_.mode != TOMO_PLAN_OUT_OF_CORE)
+        this->filter_slices_();
 
-        cout << "making struct tensor..." <<endl;
-        this->make_tensor_(window_size);
+    if(this->plan_.mode == TOMO_PLAN_IN_MEMORY){ // prevent starvation
+        if(this->engine_ == TOMO_ENGINE_HESSIAN){
+            cout << "making hessian..." <<endl;
+            this->make_hessian_();
+        }else{
+            cout << "making differential matrix..." <<endl;
+            this->make_differential_matrix_();
+
+            cout << "making struct tensor..." <<endl;
+            this->make_tensor_(window_size);
+        }
 
         this->make_eigen_values_();
 
         this->experimental_measurement( threshold );
 
-    }else if(this->tiffs_.size() < TIFF_IMAGE_LARGE_SIZE){//too large to process normally, using half serial processing
+    }else if(this->plan_.mode == TOMO_PLAN_SLAB){//too large to process normally, using half serial processing
 
         //init
         this->eigen_values_initialize_();
         this->experimental_measurement_initialize_();
 
         //load data when needed, free it otherwise
+        bool frangi_deferred = this->frangi_automatic_();
         progressbar *progress = progressbar_new("Calculating",this->tiffs_.size());
         for(int i=0;i<this->tiffs_.size();++i){
+            tomo_trace_scope trace("slice", i);
 
             int number_z = window_size;
             int start_z = (i - window_size/2) >= 0 ? (i - window_size/2) : 0 ;
             start_z = (start_z+number_z) <= this->tiffs_.size() ? start_z  : this->tiffs_.size() - number_z;
 
-            this->make_differential_matrix_(start_z, number_z);
-            this->make_tensor_(window_size, i);
+            if(this->engine_ == TOMO_ENGINE_HESSIAN){
+                this->make_hessian_(i);
+            }else{
+                this->make_differential_matrix_(start_z, number_z);
+                this->make_tensor_(window_size, i);
+            }
             this->make_eigen_values_(i);
-            this->experimental_measurement_(i, threshold);
+            if(frangi_deferred == false){
+                this->experimental_measurement_(i, threshold);
+                this->emit_slice_(i);
+            }
 
             progressbar_inc(progress);
         }
         progressbar_finish(progress);
+        //frangi without a constant waits for every eigen value
+        if(frangi_deferred){
+            this->make_frangi_constant_();
+            for(int i=0;i<this->tiffs_.size();++i){
+                this->experimental_measurement_(i, threshold);
+                this->emit_slice_(i);
+            }
+        }
+        this->crop_to_roi_();
 
         //normalize
         this->experimental_measurement_normalize_();
+        this->emit_finish_(this->normalized_measure_);
 
     }else{ //super large, using full serial processing
 
@@ -928,9 +1663,61 @@ void tomo_super_tiff::neuron_detection(const int window_size, float threshold, c
         //resize eigen value and measurement
         this->measure_.resize(this->tiffs_.size());
 
+        //only the slices of the roi are computed & written, measurement/0.tif is its first one
+        tomo_roi roi = this->roi_.clipped(this->plan_.size_x, this->plan_.size_y, this->tiffs_.size());
+
+        //slices already in measurement/ are kept when resuming
+        tomo_checkpoint checkpoint;
+        if(this->saving_measure_slices_){
+            string filters;
+            for(int f=0;f<this->filters_.size();++f){
+                filters += (f > 0 ? " " : "") + this->filters_[f]->spec();
+            }
+            //the slices read, by their place on the disk, a slice source only by its size
+            string input = this->prefix_.empty() ? string() : absolute_address(this->prefix_.c_str());
+            for(int i=0;i<this->address_tiffs_.size();++i){
+                input += "\n" + this->address_tiffs_[i];
+            }
+            if(checkpoint.open("measurement", roi.size_x(), roi.size_y(), this->tiffs_.size(),
+                               this->box_, roi, input,
+                               window_size, standard_deviation, threshold,
+                               this->measure_kind_, this->measure_constant_, this->engine_, filters, this->resuming_) == false)
+                exit(-1);
+            for(int i=roi.z0;i<roi.z1;++i){
+                char address_tiff[100] = {0};
+                sprintf(address_tiff, "measurement/%d.tif", i - roi.z0);
+                if(checkpoint.recover_renormalized(address_tiff, i) == false)
+                    exit(-1);
+            }
+        }
+
         //load data when needed, free it otherwise
-        progressbar *progress = progressbar_new("Calculating",this->tiffs_.size());
-        for(int i=0;i<this->tiffs_.size();++i){
+        progressbar *progress = progressbar_new("Calculating",roi.size_z());
+        for(int i=roi.z0;i<roi.z1;++i){
+            tomo_trace_scope trace("slice", i);
+
+            if(this->saving_measure_slices_ && checkpoint.done(i)){
+                maximums_measurements[i] = checkpoint.maximum(i);
+                if(this->sinks_.size() > 0){ // the sinks still see every slice, from the disk
+                    char address_tiff[100] = {0};
+                    sprintf(address_tiff, "measurement/%d.tif", i - roi.z0);
+                    tomo_tiff tiff_measure(address_tiff);
+                    float ratio = checkpoint.renormalized(i) ? checkpoint.final_maximum() : checkpoint.maximum(i);
+                    this->measure_.clear();
+                    this->measure_.resize(this->tiffs_.size());
+                    this->measure_[i] = tiff_measure.gray_scale_;
+                    for(int j=0;j<this->measure_[i].size();++j){
+                        for(int k=0;k<this->measure_[i][j].size();++k){
+                            this->measure_[i][j][k] *= ratio;
+                        }
+                    }
+                    for(int s=0;s<this->sinks_.size();++s){ // already cropped
+                        this->sinks_[s]->measure_slice(i - roi.z0, this->measure_[i]);
+                    }
+                }
+                progressbar_inc(progress);
+                continue;
+            }
 
             int number_z = window_size;
             int start_z = (i - window_size/2) >= 0 ? (i - window_size/2) : 0 ;
@@ -941,15 +1728,21 @@ void tomo_super_tiff::neuron_detection(const int window_size, float threshold, c
 
             char original_directory[100] = {0};
             getcwd(original_directory,100);
-            chdir(this->prefix_.c_str()); // change to the directory of original data
-            #pragma omp for
-            for(int j=0;j<this->tiffs_.size();++j){
-                if( j < start_z-2 || j >= start_z+number_z+2 ){ // free it
-                    this->tiffs_[j].clear();
-
-                }else if(this->tiffs_[j].size() == 0){ // load it
-                    this->tiffs_[j] = tomo_tiff( this->address_tiffs_[j].c_str() );
+            if(this->source_ == NULL)
+                chdir(this->prefix_.c_str()); // change to the directory of original data
+            {
+                tomo_stage stage("read");
+                #pragma omp for
+                for(int j=0;j<this->tiffs_.size();++j){
+                    if( j < start_z-2 || j >= start_z+number_z+2 ){ // free it
+                        this->tiffs_[j].clear();
+
+                    }else if(this->tiffs_[j].size() == 0){ // load it
+                        this->load_filtered_tiff_(j);
+                        stage.add_voxels( count_voxels(this->tiffs_[j].gray_scale_) );
+                    }
                 }
+                this->free_filter_cache_(start_z-2, start_z+number_z+2);
             }
             chdir(original_directory);//change it back
             fclose(err_redir);
@@ -960,28 +1753,41 @@ void tomo_super_tiff::neuron_detection(const int window_size, float threshold, c
             this->make_eigen_values_(i);
             // todo : save eigen_values[i] for tmp. and find maximum
             this->experimental_measurement_(i, threshold);
+            this->emit_slice_(i);
+            if(this->roi_.whole() == false)
+                crop_slice(this->measure_[i], this->roi_);
             // save measurements[i] for tmp. and find maximum for the first normalization
-            for(int j=0;j<this->measure_[i].size();++j){
-                for(int k=0;k<this->measure_[i][j].size();++k){
-                    maximums_measurements[i] = maximums_measurements[i] > this->measure_[i][j][k] ?
-                                maximums_measurements[i] : this->measure_[i][j][k];
+            {
+                tomo_trace_scope trace("slice_maximum", i);
+                for(int j=0;j<this->measure_[i].size();++j){
+                    for(int k=0;k<this->measure_[i][j].size();++k){
+                        maximums_measurements[i] = maximums_measurements[i] > this->measure_[i][j][k] ?
+                                    maximums_measurements[i] : this->measure_[i][j][k];
+                    }
                 }
             }
-            #pragma omp for
-            for(int j=0;j<this->measure_[i].size();++j){
-                for(int k=0;k<this->measure_[i][j].size();++k){
-                    this->measure_[i][j][k] /= maximums_measurements[i];
+            if(this->saving_measure_slices_){
+                tomo_stage stage("save_measure_slices", count_voxels(this->measure_[i]));
+                #pragma omp for
+                for(int j=0;j<this->measure_[i].size();++j){
+                    for(int k=0;k<this->measure_[i][j].size();++k){
+                        this->measure_[i][j][k] /= maximums_measurements[i];
+                    }
                 }
+                char address_tiff[100] = {0};
+                sprintf(address_tiff, "measurement/%d.tif", i - roi.z0);
+                tomo_tiff tiff_mearsure(this->measure_[i]);
+                if(tomo_checkpoint::save_tiff(tiff_mearsure, address_tiff) == false)
+                    exit(-1);
+                checkpoint.complete(i, maximums_measurements[i]);
             }
-            char address_tiff[100] = {0};
-            mkdir("measurement",0755);
-            sprintf(address_tiff, "measurement/%d.tif", i);
-            tomo_tiff tiff_mearsure(this->measure_[i]);
-            tiff_mearsure.save( address_tiff );
 
             progressbar_inc(progress);
         }
         progressbar_finish(progress);
+        for(int f=0;f<this->filters_.size();++f){
+            this->filters_[f]->release();
+        }
 
         // renormalize the tmp. eigen_values and tmp. measurements
         // find maximum of maximums
@@ -990,21 +1796,33 @@ void tomo_super_tiff::neuron_detection(const int window_size, float threshold, c
             final_maximum_measurements = final_maximum_measurements > maximums_measurements[i] ?
                         final_maximum_measurements : maximums_measurements[i];
         }
+        this->normalized_measure_ = final_maximum_measurements;
+        this->emit_finish_(final_maximum_measurements);
+
+        if(this->saving_measure_slices_ == false) // nothing on the disk to renormalize
+            return;
+
         //save info.txt
         fstream out_info("info.txt", fstream::out);
         if(out_info.is_open() == false){
             cerr << "ERROR : cannot open info.txt" <<endl;
             exit(-1);
         }
-        out_info << "xyz-size " << this->measure_.back().back().size() << " " << this->measure_.back().size() << " " << this->measure_.size() <<endl;
+        out_info << "xyz-size " << roi.size_x() << " " << roi.size_y() << " " << roi.size_z() <<endl;
         out_info << "normalized " << fixed << setprecision(8) << final_maximum_measurements <<endl;
         out_info << "order xyz"<<endl;
         out_info.close();
 
+        if(checkpoint.normalized() == false)
+            checkpoint.normalize(final_maximum_measurements);
+
+        tomo_stage stage("renormalize_measure_slices");
         #pragma omp for
-        for(int i=0;i<this->measure_.size();++i){
+        for(int i=roi.z0;i<roi.z1;++i){
+            if(checkpoint.renormalized(i))
+                continue;
             char address_tiff[100] = {0};
-            sprintf(address_tiff, "measurement/%d.tif", i);
+            sprintf(address_tiff, "measurement/%d.tif", i - roi.z0);
             tomo_tiff tiff_measure(address_tiff);
             for(int j=0;j<tiff_measure.size();++j){
                 for(int k=0;k<tiff_measure[j].size();++k){
@@ -1012,15 +1830,229 @@ void tomo_super_tiff::neuron_detection(const int window_size, float threshold, c
                     tiff_measure[j][k] /= final_maximum_measurements;
                 }
             }
-            tiff_measure.save(address_tiff);
+            if(checkpoint.save_renormalized(tiff_measure, address_tiff, i) == false)
+                exit(-1);
+            stage.add_voxels( count_voxels(tiff_measure.gray_scale_) );
+        }
+        checkpoint.close();
+    }
+
+    return;
+}
+
+void tomo_super_tiff::neuron_detection_multiscale(vector<int> window_sizes, int combine, float threshold, const float standard_deviation){
+
+    int window_size_max = 0;
+    for(int s=0;s<window_sizes.size();++s){
+        window_size_max = window_size_max > window_sizes[s] ? window_size_max : window_sizes[s];
+    }
+    this->replan_(window_size_max);
+    if(this->plan_.mode == TOMO_PLAN_SLAB && combine == TOMO_COMBINE_MAX && this->frangi_automatic_() == false){
+        this->filter_slices_();
+        this->neuron_detection_multiscale_slab_(window_sizes, threshold, standard_deviation);
+        return;
+    }
+    if(this->plan_.mode != TOMO_PLAN_IN_MEMORY){
+        cerr << "ERROR : multi-scale needs every slice in memory, or the slab plan with --combine max & no automatic frangi constant,"
+             << " try --roi or a larger --memory-budget" <<endl;
+        exit(-1);
+    }
+    this->filter_slices_();
+
+    //the gradient is the same for every scale
+    if(this->engine_ == TOMO_ENGINE_TENSOR){
+        cout << "making differential matrix..." <<endl;
+        this->make_differential_matrix_();
+    }
+
+    vector< vector< vector<float> > > combined;
+    vector< vector< vector< vector<float> > > > combined_eigen_values;
+    vector< vector< vector<uint32_t> > > combined_orientation;
+
+    for(int s=0;s<window_sizes.size();++s){
+
+        int window_size = window_sizes[s];
+        cout << "scale " << s+1 << "/" << window_sizes.size() << " window_size : " << window_size <<endl;
+        this->make_gaussian_window_(window_size,standard_deviation*(float)window_size/2.0);
+        if(this->engine_ == TOMO_ENGINE_HESSIAN)
+            this->make_hessian_();
+        else
+            this->make_tensor_(window_size);
+        this->make_eigen_values_();
+        this->make_measure_(-1.0);
+
+        //scale normalized : every scale counts up to 1
+        float ratio = 1.0;
+        if(combine == TOMO_COMBINE_NORMALIZED){
+            float maximum = 0.0;
+            for(int i=0;i<this->measure_.size();++i){
+                for(int j=0;j<this->measure_[i].size();++j){
+                    for(int k=0;k<this->measure_[i][j].size();++k){
+                        maximum = this->measure_[i][j][k] > maximum ? this->measure_[i][j][k] : maximum;
+                    }
+                }
+            }
+            ratio = maximum > 0.0 ? 1.0 / maximum : 0.0;
+        }
+
+        //the eigen values of the winning scale are kept with it
+        tomo_stage stage("combine_scales", count_volume_voxels(this->measure_));
+        if(s == 0){
+            combined.swap(this->measure_);
+            combined_eigen_values.swap(this->eigen_values_);
+            combined_orientation.swap(this->orientation_);
+            #pragma omp parallel for
+            for(int i=0;i<combined.size();++i){
+                for(int j=0;j<combined[i].size();++j){
+                    for(int k=0;k<combined[i][j].size();++k){
+                        combined[i][j][k] *= ratio;
+                    }
+                }
+            }
+            continue;
+        }
+        #pragma omp parallel for
+        for(int i=0;i<combined.size();++i){
+            for(int j=0;j<combined[i].size();++j){
+                for(int k=0;k<combined[i][j].size();++k){
+                    float value = this->measure_[i][j][k] * ratio;
+                    if(value > combined[i][j][k]){
+                        combined[i][j][k] = value;
+                        combined_eigen_values[i][j][k] = this->eigen_values_[i][j][k];
+                        if(this->orientation_enabled_)
+                            combined_orientation[i][j][k] = this->orientation_[i][j][k];
+                    }
+                }
+            }
+        }
+    }
+    this->measure_.swap(combined);
+    this->eigen_values_.swap(combined_eigen_values);
+    this->orientation_.swap(combined_orientation);
+
+    if(threshold > 0){
+        #pragma omp parallel for
+        for(int i=0;i<this->measure_.size();++i){
+            for(int j=0;j<this->measure_[i].size();++j){
+                for(int k=0;k<this->measure_[i][j].size();++k){
+                    this->measure_[i][j][k] = this->measure_[i][j][k] >= threshold ? 1.0 : 0.0;
+                }
+            }
+        }
+    }
+
+    for(int i=0;i<this->measure_.size() && this->sinks_.size() > 0;++i){
+        this->emit_slice_(i);
+    }
+    this->crop_to_roi_();
+
+    this->experimental_measurement_normalize_();
+    this->emit_finish_(this->normalized_measure_);
+
+    return;
+}
+
+void tomo_super_tiff::neuron_detection_multiscale_slab_(vector<int> &window_sizes, float threshold, const float standard_deviation){
+
+    this->eigen_values_initialize_();
+    this->experimental_measurement_initialize_();
+
+    vector< vector<float> > combined;
+    vector< vector< vector<float> > > combined_eigen_values;
+    vector< vector<uint32_t> > combined_orientation;
+    //the hessian engine keeps the smoothed slices between the slices, one cache per scale
+    vector< vector< vector< vector<float> > > > smoothed_xy(window_sizes.size()), smoothed(window_sizes.size());
+
+    //the gaussian window of every scale once, swapped in while its scale runs
+    vector< vector< vector< vector<float> > > > gaussian_windows(window_sizes.size());
+    for(int s=0;s<window_sizes.size();++s){
+        this->make_gaussian_window_(window_sizes[s],standard_deviation*(float)window_sizes[s]/2.0, false);
+        gaussian_windows[s].swap(this->gaussian_window_);
+    }
+
+    progressbar *progress = progressbar_new("Calculating",this->tiffs_.size());
+    for(int i=0;i<this->tiffs_.size();++i){
+        tomo_trace_scope trace("slice", i);
+
+        //the gradient of the slices under the largest window, every smaller one reads inside it
+        if(this->engine_ == TOMO_ENGINE_TENSOR){
+            int number_z = this->plan_.window_size;
+            int start_z = (i - number_z/2) >= 0 ? (i - number_z/2) : 0 ;
+            start_z = (start_z+number_z) <= this->tiffs_.size() ? start_z  : this->tiffs_.size() - number_z;
+            this->make_differential_matrix_(start_z, number_z);
+        }
+
+        //the slice of every scale, the same steps as the slab of neuron_detection
+        for(int s=0;s<window_sizes.size();++s){
+            int window_size = window_sizes[s];
+
+            this->gaussian_window_.swap(gaussian_windows[s]);
+            if(this->engine_ == TOMO_ENGINE_HESSIAN){
+                this->smoothed_xy_.swap(smoothed_xy[s]);
+                this->smoothed_.swap(smoothed[s]);
+                this->make_hessian_(i);
+                this->smoothed_xy_.swap(smoothed_xy[s]);
+                this->smoothed_.swap(smoothed[s]);
+            }else{
+                this->make_tensor_(window_size, i);
+            }
+            this->gaussian_window_.swap(gaussian_windows[s]);
+            this->make_eigen_values_(i);
+            this->experimental_measurement_(i, -1.0);
+
+            //the eigen values of the winning scale are kept with it
+            tomo_stage stage("combine_scales", count_voxels(this->measure_[i]));
+            if(s == 0){
+                combined = this->measure_[i];
+                combined_eigen_values = this->eigen_values_[i];
+                if(this->orientation_enabled_)
+                    combined_orientation = this->orientation_[i];
+                continue;
+            }
+            #pragma omp parallel for
+            for(int j=0;j<combined.size();++j){
+                for(int k=0;k<combined[j].size();++k){
+                    float value = this->measure_[i][j][k];
+                    if(value > combined[j][k]){
+                        combined[j][k] = value;
+                        combined_eigen_values[j][k] = this->eigen_values_[i][j][k];
+                        if(this->orientation_enabled_)
+                            combined_orientation[j][k] = this->orientation_[i][j][k];
+                    }
+                }
+            }
+        }
+        this->measure_[i].swap(combined);
+        this->eigen_values_[i].swap(combined_eigen_values);
+        if(this->orientation_enabled_)
+            this->orientation_[i].swap(combined_orientation);
+
+        if(threshold > 0){
+            #pragma omp parallel for
+            for(int j=0;j<this->measure_[i].size();++j){
+                for(int k=0;k<this->measure_[i][j].size();++k){
+                    this->measure_[i][j][k] = this->measure_[i][j][k] >= threshold ? 1.0 : 0.0;
+                }
+            }
         }
+        this->emit_slice_(i);
+
+        progressbar_inc(progress);
     }
+    progressbar_finish(progress);
+    this->crop_to_roi_();
+
+    //normalize
+    this->experimental_measurement_normalize_();
+    this->emit_finish_(this->normalized_measure_);
 
     return;
 }
 
 void tomo_super_tiff::save_measure(const char *prefix){
 
+    tomo_stage stage("save_measure", count_volume_voxels(this->measure_));
+
     char original_directory[100];
     getcwd(original_directory,100);
     mkdir(prefix, 0755);
@@ -1070,8 +2102,136 @@ void tomo_super_tiff::save_measure(const char *prefix){
 
 }
 
+void tomo_super_tiff::save_components(const char *prefix, float threshold){
+
+    tomo_stage stage("components", count_volume_voxels(this->measure_));
+
+    vector<uint32_t> labels;
+    vector<tomo_component> components;
+    tomo_components::label(this->measure_, this->normalized_measure_, threshold, labels, components);
+    cout << components.size() << " components" <<endl;
+
+    if(this->measure_.size() == 0)
+        return;
+    tomo_components::save_raw( (string(prefix) + ".raw").c_str(), labels );
+    tomo_components::save_table( (string(prefix) + ".csv").c_str(), components,
+                                 this->measure_[0][0].size(), this->measure_[0].size(), this->measure_.size() );
+
+    return;
+}
+
+void tomo_super_tiff::save_peaks(const tomo_peak_options &options){
+
+    tomo_stage stage("peaks", count_volume_voxels(this->measure_));
+
+    vector<tomo_peak> peaks;
+    tomo_peaks::find(this->measure_, this->normalized_measure_, options, peaks);
+    cout << peaks.size() << " peaks" <<endl;
+
+    if(this->measure_.size() == 0)
+        return;
+    tomo_peaks::save(options, peaks, this->measure_[0][0].size(), this->measure_[0].size(), this->measure_.size());
+
+    return;
+}
+
+void tomo_super_tiff::save_skeleton(const char *address, float threshold){
+
+    tomo_stage stage("skeleton", count_volume_voxels(this->measure_));
+
+    if(this->measure_.size() == 0)
+        return;
+    tomo_skeleton skeleton;
+    skeleton.begin(this->measure_[0][0].size(), this->measure_[0].size());
+    for(int i=0;i<this->measure_.size();++i){
+        skeleton.add_slice(this->measure_[i], this->normalized_measure_, threshold);
+    }
+    skeleton.end();
+    skeleton.thin();
+    skeleton.save_swc(address);
+
+    return;
+}
+
+void tomo_super_tiff::save_distance(const char *prefix, float threshold){
+
+    tomo_stage stage("distance", count_volume_voxels(this->measure_));
+
+    if(this->measure_.size() == 0)
+        return;
+    int size_x = this->measure_[0][0].size();
+    int size_y = this->measure_[0].size();
+    int size_z = this->measure_.size();
+    size_t size_slice = (size_t)size_x * size_y;
+
+    vector<float> distance(size_slice * size_z);
+    #pragma omp parallel for schedule(dynamic)
+    for(int i=0;i<size_z;++i){
+        tomo_distance::threshold_slice(this->measure_[i], this->normalized_measure_, threshold, &distance[size_slice * i]);
+        tomo_distance::transform_slice(&distance[size_slice * i], size_x, size_y);
+    }
+    tomo_distance::transform_z(&distance[0], size_x, size_y, size_z);
+    tomo_distance::root(distance);
+    tomo_distance::save_raw( (string(prefix) + ".raw").c_str(), distance );
+
+    return;
+}
+
+void tomo_super_tiff::save_orientation(const char *prefix){
+
+    tomo_stage stage("save_orientation", count_volume_voxels(this->orientation_));
+
+    if(this->orientation_.size() == 0){
+        cerr << "ERROR : no orientation, set_orientation before the detection" <<endl;
+        return;
+    }
+    tomo_orientation::save_raw( (string(prefix) + ".raw").c_str(), this->orientation_ );
+
+    return;
+}
+
+void tomo_super_tiff::save_streamlines(const tomo_streamline_options &options){
+
+    tomo_stage stage("streamlines", count_volume_voxels(this->measure_));
+
+    if(this->orientation_.size() != this->measure_.size() || this->measure_.size() == 0){
+        cerr << "ERROR : no orientation, set_orientation before the detection" <<endl;
+        return;
+    }
+    vector<tomo_streamline> lines;
+    tomo_streamlines::trace(this->measure_, this->normalized_measure_, this->orientation_, options, lines);
+    tomo_streamlines::save_swc(options.address.c_str(), lines,
+                               this->measure_[0][0].size(), this->measure_[0].size(), this->measure_.size());
+
+    return;
+}
+
+void tomo_super_tiff::save_somata(const tomo_soma_options &options){
+
+    tomo_stage stage("somata");
+
+    if(this->tiffs_.size() == 0 || this->tiffs_[0].size() == 0){
+        cerr << "ERROR : no slices loaded, somata need every slice in memory" <<endl;
+        return;
+    }
+    vector< vector< vector<float> >* > volume(this->tiffs_.size());
+    for(int i=0;i<this->tiffs_.size();++i){
+        volume[i] = &this->tiffs_[i].gray_scale_;
+        stage.add_voxels( count_voxels(this->tiffs_[i].gray_scale_) * options.scales );
+    }
+
+    vector<tomo_soma> somata;
+    tomo_somata::detect(volume, options, somata);
+    cout << somata.size() << " somata" <<endl;
+    tomo_somata::save(options, somata, this->tiffs_[0][0].size(), this->tiffs_[0].size(), this->tiffs_.size());
+
+    return;
+}
+
 void tomo_super_tiff::save_measure_merge(const char *prefix){
 
+    tomo_stage stage("save_measure_merge", count_volume_voxels(this->measure_));
+
     char original_directory[100];
     getcwd(original_directory,100);
     mkdir(prefix, 0755);
@@ -1113,6 +2273,8 @@ void tomo_super_tiff::save_measure_merge(const char *prefix){
 
 void tomo_super_tiff::save_eigen_values_rgb(const char *prefix){
 
+    tomo_stage stage("save_eigen_values_rgb", count_volume_voxels(this->eigen_values_));
+
     //find maximum of eigen_values_
     float maximum = -1.0;
     for(int i=0;i<this->eigen_values_.size();++i){
@@ -1167,6 +2329,7 @@ void tomo_super_tiff::save_eigen_values_rgb(const char *prefix){
         }
 
         TIFFWriteEncodedStrip(tif, 0, &tmp_data[0], width * height * 6);
+        tomo_metrics::add_bytes_written( (uint64_t)width * height * 6 );
 
         TIFFClose(tif);
     }
@@ -1176,6 +2339,8 @@ void tomo_super_tiff::save_eigen_values_rgb(const char *prefix){
 }
 
 void tomo_super_tiff::save_eigen_values_rgb_merge(const char *prefix){
+
+    tomo_stage stage("save_eigen_values_rgb_merge", count_volume_voxels(this->eigen_values_));
     //find maximum of eigen_values_
     float maximum = -1.0;
     for(int i=0;i<this->eigen_values_.size();++i){
@@ -1207,8 +2372,9 @@ void tomo_super_tiff::save_eigen_values_rgb_merge(const char *prefix){
             cerr << "ERROR : cannot open to save " << prefix << "/" << address <<endl;
         }
 
-        int width = this->eigen_values_[i].size() + this->tiffs_[i].size();
-        int height = this->eigen_values_[i][0].size();
+        int width_original = this->tiffs_[i][0].size();
+        int width = width_original + this->eigen_values_[i][0].size();
+        int height = this->eigen_values_[i].size();
 
         TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
         TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
@@ -1224,15 +2390,16 @@ void tomo_super_tiff::save_eigen_values_rgb_merge(const char *prefix){
         for(int j=0;j<height;++j){
             for(int k=0;k<width;++k){
                 for(int m=0;m<3;++m){
-                    if(k < this->tiffs_[i].size())
+                    if(k < width_original)
                         tmp_data[index_tmp++] = (uint16_t)(this->tiffs_[i][j][k] * 65535.0);
                     else
-                        tmp_data[index_tmp++] = (uint16_t)(this->eigen_values_[i][j][k-tiffs_[i].size()][m] / maximum * 65535.0);
+                        tmp_data[index_tmp++] = (uint16_t)(this->eigen_values_[i][j][k-width_original][m] / maximum * 65535.0);
                 }
             }
         }
 
         TIFFWriteEncodedStrip(tif, 0, &tmp_data[0], width * height * 6);
+        tomo_metrics::add_bytes_written( (uint64_t)width * height * 6 );
 
         TIFFClose(tif);
     }
@@ -1243,6 +2410,8 @@ void tomo_super_tiff::save_eigen_values_rgb_merge(const char *prefix){
 
 void tomo_super_tiff::save_eigen_values_separated(const char *prefix){
 
+    tomo_stage stage("save_eigen_values_separated", count_volume_voxels(this->eigen_values_));
+
 
     //find maximum of eigen_values_
     float maximum = -1.0;
@@ -1308,6 +2477,8 @@ void tomo_super_tiff::save_eigen_values_separated(const char *prefix){
 
 void tomo_super_tiff::save_eigen_values_ev(const char *address){
 
+    tomo_stage stage("save_eigen_values_ev", count_volume_voxels(this->eigen_values_));
+
     cout << "saving " << address << "..." <<endl;
 
     fstream out_ev(address, fstream::out);
@@ -1349,12 +2520,15 @@ void tomo_super_tiff::save_eigen_values_ev(const char *address){
     }
     progressbar_finish(progress);
 
+    tomo_metrics::add_bytes_written( out_ev.tellp() );
     out_ev.close();
     return;
 }
 
 void tomo_super_tiff::load_eigen_values_ev(const char *address){
 
+    tomo_stage stage("read_eigen_values");
+
     cout << "reading " << address << "..." <<endl;
 
     fstream in_ev(address, fstream::in);
@@ -1418,11 +2592,13 @@ void tomo_super_tiff::load_eigen_values_ev(const char *address){
     }
 
     in_ev.close();
+    stage.add_voxels( count_volume_voxels(this->eigen_values_) );
 
     return;
 }
 
 void tomo_super_tiff::load_eigen_values_separated(const char *prefix){
+    tomo_stage stage("read_eigen_values");
     cout << "reading " << prefix << "..." <<endl;
     cout << "changing directory to " << prefix <<endl;
 
@@ -1503,45 +2679,41 @@ void tomo_super_tiff::load_eigen_values_separated(const char *prefix){
 
     cout << "changing directory back to " << original_directory << endl;
     chdir(original_directory);
+    stage.add_voxels( count_volume_voxels(this->eigen_values_) );
 
     return;
 }
 
-void create_experimental_data(const char *address){
-
-    int size = 200;
+static void make_experimental_fibres(tomo_synthetic& synthetic, int size){
 
-    vector< vector< vector<float> > > volumes;
+    //every length is scaled from the original 200^3 setting
+    float scale = (float)size / 200.0;
 
-    //init
-    volumes.resize(size);
-    #pragma omp parallel for
-    for(int i=0;i<size;++i){
-        volumes[i].resize(size);
-        for(int j=0;j<size;++j){
-            volumes[i][j].resize(size);
-        }
-    }
+    synthetic.size_x = synthetic.size_y = synthetic.size_z = size;
+    synthetic.foreground = 1.0;
+    synthetic.background = 0.0;
+    synthetic.noise = 0.0;
+    synthetic.bits_per_sample = 16;
 
-    float rotation_r = 80.0;
+    float rotation_r = 80.0 * scale;
 
-    vector<float> A(3,0.0);
-    vector<float> C(3,0.0);
-    A[0] = 9.0; // x
+    float A[3] = {0.0, 0.0, 0.0};
+    float B[3] = {0.0, 0.0, 0.0};
+    float C[3] = {0.0, 0.0, 0.0};
+    A[0] = 9.0 * scale; // x
 
     for(int t=0;t<15;++t){
 
         float theta = M_PI / 2.0 / 15.0 * (float)t;
 
-        float r = 2.0;
+        float r = 2.0 * scale;
         A[0] += (float)r;
 
-        vector<float> B(3,0.0);
         B[0] = A[0]; // x
 
         C[0] = A[0]; // x
-        C[1] = 100.0;
-        C[2] = 100.0;
+        C[1] = 100.0 * scale;
+        C[2] = 100.0 * scale;
 
         A[1] = rotation_r * cos(theta) + C[1]; // y
         A[2] = rotation_r * sin(theta) + C[2]; // z
@@ -1549,70 +2721,68 @@ void create_experimental_data(const char *address){
         B[1] = C[1]*2.0 - A[1]; // y
         B[2] = C[2]*2.0 - A[2]; // z
 
+        //create data: cylinder
+        synthetic.add_fibre(A, B, r);
 
-        vector<float> AB = B - A;
+        A[0] += (float)r + 9.0 * scale;
+    }// for t
 
-        #pragma omp parallel for
-        for(int i=0;i<size;++i){
-            for(int j=0;j<size;++j){
-                for(int k=0;k<size;++k){
-
-                    //create data: cylinder
-                    vector<float> P(3,0.0);
-                    P[0] = (float)k; // x
-                    P[1] = (float)j; // y
-                    P[2] = (float)i; // z
-
-                    vector<float> AP = P - A;
-                    vector<float> BP = P - B;
-                    vector<float> BA = A - B;
-                    float AC_length = vector_dot(AP,AB) / vector_length(AB);
-
-                    //it's in the cylinder
-                    if( vector_dot(AP,AB) > 0.0 && vector_dot(BP,BA) > 0.0 &&
-                            (vector_dot(AP,AP) - AC_length * AC_length) <= ((float)r * (float)r) ){
-                        volumes[i][j][k] = 1.0;
-                    }
-                }
-            }
-        }
+    return;
+}
 
-        A[0] += (float)r + 9.0;
-    }// for t
+void create_experimental_volume(vector< vector< vector<float> > >& volumes, int size){
 
-    //save volumes
-    char original_directory[100];
-    getcwd(original_directory,100);
-    mkdir(address,0755);
-    chdir(address);
+    tomo_synthetic synthetic;
+    make_experimental_fibres(synthetic, size);
 
+    volumes.clear();
+    volumes.resize(size);
     #pragma omp parallel for
-    for(int i=0;i<volumes.size();++i){
-        char filename[20];
-        sprintf(filename, "%d.tif", i);
-
-        tomo_tiff tmp(volumes[i]);
-        tmp.save(filename);
+    for(int i=0;i<size;++i){
+        synthetic.make_slice(i, volumes[i], false);
     }
 
-    //make filelist
-    char filelist_directory[100];
-    getcwd(filelist_directory,100);
+    return;
+}
+
+void create_experimental_data(const char *address){
+
+    tomo_synthetic synthetic;
+    make_experimental_fibres(synthetic, 200);
+    synthetic.generate(address);
 
-    fstream out_filelist("exp.txt",fstream::out);
+    return;
+}
 
-    out_filelist << volumes.size() <<endl;
-    out_filelist << filelist_directory <<endl;
+string absolute_address(const char *address){
+    if(address[0] == '/')
+        return address;
+    char current_directory[1024] = {0};
+    getcwd(current_directory, 1024);
+    return string(current_directory) + "/" + address;
+}
 
-    for(int i=0;i<volumes.size();++i){
-        char filename[20];
-        sprintf(filename, "%d.tif", i);
-        out_filelist << filename <<endl;
+bool parse_spec(const char *spec, string &name, vector< pair<string,string> > &items){
+
+    string text(spec);
+    size_t colon = text.find(':');
+    name = text.substr(0, colon);
+    items.clear();
+    if(colon == string::npos)
+        return true;
+
+    stringstream list(text.substr(colon+1));
+    string item;
+    while(getline(list, item, ',')){
+        size_t position = item.find('=');
+        if(position == string::npos){
+            cerr << "ERROR : " << item << " is not key=value" <<endl;
+            return false;
+        }
+        items.push_back( make_pair(item.substr(0, position), item.substr(position+1)) );
     }
-    out_filelist.close();
 
-    chdir(original_directory);
-    return;
+    return true;
 }
 
 void merge_measurements(const char *address_filelist, const char *prefix_output){
@@ -17,6 +17,9 @@
 #include <gsl/gsl_eigen.h>
 #include <iomanip>
 #include <sstream>
+#include <functional>
+#include "tomo_plan.h"
+#include "tomo_measure.h"
 
 extern "C"{
     #include <progressbar.h>
@@ -25,13 +28,18 @@ extern "C"{
 
 #include <omp.h>
 
-#define TIFF_IMAGE_MEDIUM_SIZE 500
-#define TIFF_IMAGE_LARGE_SIZE 1000
-
 using namespace std;
 
 class tomo_super_tiff;
 
+// how the measures of several window sizes are combined
+//      max        : the largest raw measure, what merge_measurements does with several runs
+//      normalized : every scale divided by its own maximum first, so each one counts as much
+enum{ TOMO_COMBINE_MAX, TOMO_COMBINE_NORMALIZED };
+
+// where the eigen values come from : the structure tensor, or the hessian of tomo_hessian.h
+enum{ TOMO_ENGINE_TENSOR, TOMO_ENGINE_HESSIAN };
+
 void merge_measurements(const char* address_filelist, const char* prefix_output);
 
 vector<float> operator -(vector<float> &a, vector<float> &b);
@@ -39,8 +47,15 @@ vector<float> operator +(vector<float> &a, vector<float> &b);
 float vector_dot(vector<float> &a, vector<float> &b);
 float vector_length(vector<float> &a);
 
+void create_experimental_volume(vector< vector< vector<float> > >& volumes, int size = 200);
 void create_experimental_data(const char* address);
 
+// address made absolute from the working directory now, the sinks write after it changed
+string absolute_address(const char* address);
+
+// spec : name[:key=value,...], the name & the items in order, false when an item is not key=value
+bool parse_spec(const char* spec, string& name, vector< pair<string,string> >& items);
+
 class tomo_tiff{
 
     string address_;
@@ -60,6 +75,8 @@ class tomo_tiff{
 
     vector< vector<float> > gray_scale_;
 
+    void read_(const char* address, const tomo_roi& roi);
+
     public:
 
     tomo_tiff(){
@@ -78,6 +95,8 @@ class tomo_tiff{
     }
 
     tomo_tiff(const char* address);
+    // only the rows & columns within roi, z is ignored
+    tomo_tiff(const char* address, const tomo_roi& roi);
 
     void save(const char* address, int max_gray_scale = 65535);
     vector<float>& operator [](int index_y);
@@ -96,37 +115,41 @@ class tomo_tiff{
 
 class matrix{
 
-    vector< vector<float> > number_;
+    // at most 3x3, kept inline so a row of matrixes is a single allocation
+    float number_[3][3];
+    int size_;
 
     public:
 
     matrix(const int size = 0, const float number = 0.0){
+        this->size_ = 0;
         this->resize(size,number);
     }
 
-    vector<float>& operator [](const int index_i){
+    float* operator [](const int index_i){
         return this->number_[index_i];
     }
     void resize(const int size,const float number = 0.0){
-        this->number_.resize(size);
+        if(size > 3){
+            cerr << "matrix size : " << size << " not handled!" <<endl;
+            return;
+        }
         for(int i=0;i<size;++i){
-            this->number_[i].resize(size,number);
+            for(int j=0;j<size;++j){
+                if(i >= this->size_ || j >= this->size_)
+                    this->number_[i][j] = number;
+            }
         }
+        this->size_ = size;
     }
     int size(void){
-        return this->number_.size();
-    }
-
-    const matrix& operator =(const matrix& b){
-        this->number_ = b.number_;
-        return *this;
+        return this->size_;
     }
 
     matrix operator *(float ratio){
-        matrix rtn;
-        rtn.number_ = this->number_;
-        for(int i=0;i<rtn.number_.size();++i){
-            for(int j=0;j<rtn.number_[i].size();++j){
+        matrix rtn(this->size_);
+        for(int i=0;i<rtn.size_;++i){
+            for(int j=0;j<rtn.size_;++j){
                 rtn.number_[i][j] = this->number_[i][j] * ratio;
             }
         }
@@ -134,19 +157,19 @@ class matrix{
     }
 
     void operator +=(matrix b){
-        if(this->number_.size() != b.size()){
+        if(this->size_ != b.size()){
             cerr << "matrixes' size don't match" <<endl;
             return;
         }
-        for(int i=0;i<this->number_.size();++i){
-            for(int j=0;j<this->number_[i].size();++j){
+        for(int i=0;i<this->size_;++i){
+            for(int j=0;j<this->size_;++j){
                 this->number_[i][j] += b.number_[i][j];
             }
         }
     }
 
     float det(){
-        if(number_.size() == 3){
+        if(size_ == 3){
             /*      00      01      02
              *
              *      10      11      12
@@ -163,7 +186,7 @@ class matrix{
             ans -= number_[0][0] * number_[2][1] * number_[1][2];
             return ans;
         }
-        else if(number_.size() == 2){
+        else if(size_ == 2){
             float ans = 0.0;
             /*      00      01
              *
@@ -174,70 +197,242 @@ class matrix{
             return ans;
         }
         else{
-            cerr << "matrix size : " << number_.size() << " determine not handled!" <<endl;
+            cerr << "matrix size : " << size_ << " determine not handled!" <<endl;
             return 0.0;
         }
     }
 
     float trace(){
         float ans = 0.0;
-        for(int i=0;i<number_.size();++i){
+        for(int i=0;i<size_;++i){
             ans += number_[i][i];
         }
         return ans;
     }
 };
 
+// slice source : feeds tomo_super_tiff slice by slice instead of a filelist of .tifs
+//      load() may be called from several threads at once, and again for the same index_z
+//      when the data is too large to be kept in memory
+class tomo_slice_source{
+
+    public:
+
+    virtual ~tomo_slice_source(){}
+
+    virtual int size(void) = 0;
+    virtual void load(int index_z, vector< vector<float> >& slice) = 0;
+};
+
+// slice filter : changes the gray scale of the slices before the gradient, e.g. denoising (tomo_median.h)
+//      filtered slice z is made from the slices z - radius_z() to z + radius_z(), the borders repeated,
+//      in place in memory & slab, through a cache of the slices around the window out of core
+class tomo_slice_filter{
+
+    public:
+
+    virtual ~tomo_slice_filter(){}
+
+    virtual int radius_z() const{return 0;}
+    // how far a filtered voxel reads along x & y, the roi is read that much wider
+    virtual int radius_xy() const{return 0;}
+    // whole slices it allocates while filtering one, for the plan
+    virtual int buffer_slices() const{return 0;}
+    // name & parameters, e.g. median 1:network, a resumed run has to use the same filters
+    virtual string spec() const = 0;
+    // window : the 2 radius_z() + 1 slices around, window[radius_z()] is the slice index_z
+    //      a pass runs index_z upward, starting from 0, so a filter may keep what the slices share
+    virtual void filter(int index_z, vector< vector< vector<float> >* >& window, vector< vector<float> >& filtered) = 0;
+    // the pass is over, frees what was kept between slices
+    virtual void release(){}
+};
+
+// slice sink : receives the results of neuron_detection slice by slice, in z order
+//      slices are only valid during the call and hold the raw measurement,
+//      finish() gives the maximum used for normalization once everything is done
+class tomo_peak_options;
+class tomo_streamline_options;
+class tomo_soma_options;
+
+class tomo_slice_sink{
+
+    public:
+
+    virtual ~tomo_slice_sink(){}
+
+    virtual void measure_slice(int /*index_z*/, vector< vector<float> >& /*slice*/){}
+    virtual void eigen_values_slice(int /*index_z*/, vector< vector< vector<float> > >& /*slice*/){}
+    // with set_orientation only, see tomo_orientation.h
+    virtual void orientation_slice(int /*index_z*/, vector< vector<uint32_t> >& /*slice*/){}
+    virtual void finish(float /*normalized*/){}
+};
+
+class tomo_callback_sink : public tomo_slice_sink{
+
+    public:
+
+    function<void(int, vector< vector<float> >&)> on_measure;
+    function<void(int, vector< vector< vector<float> > >&)> on_eigen_values;
+    function<void(float)> on_finish;
+
+    void measure_slice(int index_z, vector< vector<float> >& slice){
+        if(on_measure) on_measure(index_z, slice);
+    }
+    void eigen_values_slice(int index_z, vector< vector< vector<float> > >& slice){
+        if(on_eigen_values) on_eigen_values(index_z, slice);
+    }
+    void finish(float normalized){
+        if(on_finish) on_finish(normalized);
+    }
+};
+
 class tomo_super_tiff{
 
     string prefix_;
     vector<string> address_tiffs_;
     vector<tomo_tiff> tiffs_;//[z][y][x]
     vector< vector< vector<float> > > gaussian_window_;
-    vector< vector< vector<matrix> > >differential_matrix_;
+    vector< vector< vector<matrix> > >differential_matrix_; // [z][margin_+y][margin_+x], zero ghosts
     vector< vector< vector<matrix> > >tensor_;
     vector< vector< vector<float> > >measure_;
     vector< vector< vector< vector<float> > > >eigen_values_;
+    vector< vector< vector<uint32_t> > >orientation_;  // encoded eigen vector of the smallest eigen value
 
     float normalized_measure_;
 
-    // Noble's cornor measure :
-    //      Mc = 2* det(tensor) / ( trace(tensor) + c )
-
-    void make_gaussian_window_(const int size, const float standard_deviation);
+    tomo_plan plan_;
+    tomo_slice_source *source_;
+    vector<tomo_slice_sink*> sinks_;
+    vector<tomo_slice_filter*> filters_;
+    bool filtered_;
+    vector< vector< vector< vector<float> > > > filter_cache_; // [filter][z] its input, out of core only
+    bool saving_measure_slices_;
+    bool resuming_;
+
+    tomo_roi box_;  // the part of the volume read, roi with halo
+    tomo_roi roi_;  // what's kept in the end, relative to box_
+    int halo_;
+
+    int margin_;                // ghost rows & columns around every slice of differential_matrix_
+    vector<matrix> ghost_row_;  // stands for the rows of the slices outside
+
+    int measure_kind_;
+    float measure_constant_;    // frangi : < 0 for half the largest frobenius norm of the hessian
+    float frangi_constant_;     // the one in use, set once every eigen value is there
+    bool orientation_enabled_;
+
+    int engine_;    // TOMO_ENGINE_TENSOR or TOMO_ENGINE_HESSIAN
+    vector< vector< vector<float> > > smoothed_xy_; // [z][y][x] along x & y, the hessian engine only
+    vector< vector< vector<float> > > smoothed_;    // and z
+
+    // saving : gaussian/%d.tiff as well, scaled to a maximum of 1
+    void make_gaussian_window_(const int size, const float standard_deviation, bool saving = true);
     void make_differential_matrix_();
     void make_tensor_(const int window_size);
-    void make_nobles_measure_(float measure_constant = 0.0);
+    // tensor_[z][y] with the gaussian window flattened as weights, W = window_size or 0 for any size
+    void make_tensor_row_(const int window_size, int z, int y, const vector<float>& weights);
+    template<int W>
+    void make_tensor_row_(const int window_size, int z, int y, const vector<float>& weights);
+    void make_ghost_row_(const int window_size);
     void make_eigen_values_();
 
     //serial process
     void make_differential_matrix_(int start_z, int number_z);
     void make_tensor_(const int window_size, int index_z);
+    // tensor_ holds the hessian instead, from the gaussian window
+    void make_hessian_();
+    void make_hessian_(int index_z);
+    void make_hessian_rows_(int index_z);
     void eigen_values_initialize_();
     void make_eigen_values_(int index_z);
     void experimental_measurement_initialize_();
     void experimental_measurement_normalize_();
     void experimental_measurement_(int index_z, float thresholde);
-
-    float Ix_(int x, int y, int z);
-    float Iy_(int x, int y, int z);
-    float Iz_(int x, int y, int z);
-
-    float summation_within_window_gaussianed_(int x, int y, int z, int size);
+    void make_measure_(float threshold);
+    bool frangi_automatic_(){return this->measure_kind_ == TOMO_MEASURE_FRANGI && this->measure_constant_ < 0.0;}
+    void make_frangi_constant_();
+    // measure_[index_z] of the rows from the eigen values, with the measure of measure_kind_ (tomo_measure.h)
+    void measure_rows_(int index_z, int row_begin, int row_end, float threshold);
+    template<class measure_policy, bool thresholded>
+    void measure_rows_(int index_z, int row_begin, int row_end, const measure_policy& measure, float threshold);
+    void replan_(int window_size);
+    // slab & --combine max : every scale of one slice after the other, the best one kept in place of it
+    void neuron_detection_multiscale_slab_(vector<int>& window_sizes, float threshold, const float standard_deviation);
+
+    // differential_matrix_[z][y] from tomo_gradient, products : scratch rows
+    void make_differential_row_(int z, int y, vector< vector<float> >& products);
+
+    float summation_within_window_gaussianed_(vector< vector< vector<float> > >& planes, int x, int y, int size);
+
+    void set_roi_(const tomo_roi& roi);
+    void crop_to_roi_();
+    void load_tiff_(int index_z);
+    // every slice through the filters, once, in memory & slab
+    void filter_slices_();
+    // out of core : load_tiff_ & the filters, the cache kept for the slices [begin_z, end_z) only
+    void load_filtered_tiff_(int index_z);
+    vector< vector<float> >& filter_input_(int filter, int index_z);
+    void free_filter_cache_(int begin_z, int end_z);
+    void emit_slice_(int index_z);
+    void emit_finish_(float normalized);
 
     public:
 
     void down_size(int magnification, const char* save_prefix, float sample_sd = 0.8);
 
-    tomo_super_tiff(const char* address_filelist);
-    tomo_super_tiff(){}
-
+    // plan : budget & window_size, the dimensions are filled in
+    // roi : only that sub-volume is read (with a halo) and computed, the results are cropped to it
+    tomo_super_tiff(const char* address_filelist, tomo_plan plan = tomo_plan(), tomo_roi roi = tomo_roi());
+    tomo_super_tiff(vector< vector< vector<float> > >& volume, tomo_plan plan = tomo_plan());
+    tomo_super_tiff(tomo_slice_source* source, tomo_plan plan = tomo_plan());
+    tomo_super_tiff():source_(NULL),filtered_(false),saving_measure_slices_(true),resuming_(false),halo_(0),margin_(0),measure_kind_(TOMO_MEASURE_EXPERIMENTAL),measure_constant_(0.0),frangi_constant_(0.0),orientation_enabled_(false),engine_(TOMO_ENGINE_TENSOR){}
+
+    void add_slice_sink(tomo_slice_sink* sink){this->sinks_.push_back(sink);}
+    // applied in the order added, before the detection, the filter is not deleted
+    void add_slice_filter(tomo_slice_filter* filter){this->filters_.push_back(filter);}
+    // super large data only : measurement/%d.tif are written while processing unless it's turned off
+    void set_saving_measure_slices(bool saving){this->saving_measure_slices_ = saving;}
+    // super large data only : keeps the slices listed in measurement/manifest.txt from an interrupted run
+    void set_resuming(bool resuming){this->resuming_ = resuming;}
+
+    // TOMO_MEASURE_EXPERIMENTAL (default), TOMO_MEASURE_NOBLE with its constant, TOMO_MEASURE_EIGEN_RATIO
+    // or TOMO_MEASURE_FRANGI with its constant, a negative one is half the largest norm of the hessian
+    void set_measure(int kind, float constant = 0.0){
+        this->measure_kind_ = kind;
+        this->measure_constant_ = constant;
+        this->frangi_constant_ = constant;
+    }
     void experimental_measurement(float threshold);
+    // keep the eigen vector of the smallest eigen value as well, the neurite direction
+    void set_orientation(bool enabled){this->orientation_enabled_ = enabled;}
+    // TOMO_ENGINE_TENSOR (default) or TOMO_ENGINE_HESSIAN, in memory & slab only
+    void set_engine(int engine){this->engine_ = engine;}
 
     void neuron_detection(const int window_size, float threshold = 0.0000015, const float standard_deviation=0.8);
+    // the gradient once, then the tensor, eigen values & measure for every window size, in memory
+    //      max streams through the slab plan as well, a running maximum of every voxel, while normalized
+    //      needs the maximum of every scale over the whole volume before combining
+    void neuron_detection_multiscale(vector<int> window_sizes, int combine = TOMO_COMBINE_MAX,
+                                     float threshold = 0.0000015, const float standard_deviation=0.8);
 
     void save_measure(const char* prefix);
     void save_measure_merge(const char* prefix);
+    // connected components of the voxels with measure >= threshold, in the units before normalization
+    //      prefix.raw & prefix.csv, see tomo_components.h
+    void save_components(const char* prefix, float threshold);
+    // local maxima of the measure in the units before normalization, see tomo_peaks.h
+    void save_peaks(const tomo_peak_options& options);
+    // centrelines of the voxels with measure >= threshold as swc, see tomo_skeleton.h
+    void save_skeleton(const char* address, float threshold);
+    // distance of the voxels with measure >= threshold to the others as prefix.raw, see tomo_distance.h
+    void save_distance(const char* prefix, float threshold);
+    // prefix.raw, 4 bytes per voxel, see tomo_orientation.h
+    void save_orientation(const char* prefix);
+    // traced along the orientation, set_orientation before the detection, see tomo_streamlines.h
+    void save_streamlines(const tomo_streamline_options& options);
+    // blobs of the gray scale of the slices still loaded, in memory & slab, see tomo_somata.h
+    void save_somata(const tomo_soma_options& options);
+    // the absolute eigen values of the tensor engine over their maximum, not the signed ones of the hessian
     void save_eigen_values_rgb(const char* prefix);
     void save_eigen_values_rgb_merge(const char* prefix);
     void save_eigen_values_separated(const char* prefix);
@@ -246,8 +441,10 @@ class tomo_super_tiff{
     void load_eigen_values_ev(const char* address);
     void load_eigen_values_separated(const char* prefix);
     int size_original_data(void){return this->tiffs_.size();}
+    tomo_plan& plan(void){return this->plan_;}
 
     //friend void merge_measurements(const char *address_filelist, const char *prefix_output);
+    friend class tomo_bench;
 
 };
 
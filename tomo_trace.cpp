@@ -0,0 +1,114 @@
+#include "tomo_trace.h"
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+class tomo_trace_ring{
+
+    public:
+
+    long thread_id;
+    uint64_t size; // events written so far, the ring keeps the last TOMO_TRACE_RING_SIZE
+    tomo_trace_event events[TOMO_TRACE_RING_SIZE];
+};
+
+bool tomo_trace::enabled_ = false;
+string tomo_trace::address_;
+
+static tomo_trace_ring* trace_rings[TOMO_TRACE_MAX_THREADS];
+static atomic<int> trace_size_rings(0);
+static thread_local tomo_trace_ring* trace_ring = NULL;
+
+int64_t tomo_trace::now(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void tomo_trace::enable(const char *address){
+
+    // keep the absolute address, the working directory keeps changing
+    if(address[0] != '/'){
+        char current_directory[1024] = {0};
+        getcwd(current_directory, 1024);
+        address_ = string(current_directory) + "/" + address;
+    }else{
+        address_ = address;
+    }
+
+    if(enabled_ == false)
+        atexit(save_at_exit_);
+    enabled_ = true;
+    return;
+}
+
+void tomo_trace::record(const char *name, int64_t start, int index_z){
+
+    //the first event of a thread registers its ring
+    if(trace_ring == NULL){
+        int index_ring = trace_size_rings++;
+        if(index_ring >= TOMO_TRACE_MAX_THREADS)
+            return;
+        trace_ring = new tomo_trace_ring;
+        trace_ring->thread_id = syscall(SYS_gettid);
+        trace_ring->size = 0;
+        trace_rings[index_ring] = trace_ring;
+    }
+
+    tomo_trace_event &event = trace_ring->events[ trace_ring->size % TOMO_TRACE_RING_SIZE ];
+    event.name = name;
+    event.start = start;
+    event.duration = now() - start;
+    event.index_z = index_z;
+    ++trace_ring->size;
+
+    return;
+}
+
+bool tomo_trace::save_json(const char *address){
+
+    fstream out_trace(address, fstream::out);
+    if(out_trace.is_open() == false){
+        cerr << "ERROR : cannot open " << address <<endl;
+        return false;
+    }
+
+    int pid = getpid();
+    int size_rings = trace_size_rings < TOMO_TRACE_MAX_THREADS ? (int)trace_size_rings : TOMO_TRACE_MAX_THREADS;
+    bool first = true;
+
+    out_trace.setf(ios::fixed);
+    out_trace.precision(3);
+    out_trace << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" <<endl;
+    for(int r=0;r<size_rings;++r){
+        tomo_trace_ring *ring = trace_rings[r];
+        if(ring == NULL)
+            continue;
+        uint64_t begin = ring->size > TOMO_TRACE_RING_SIZE ? ring->size - TOMO_TRACE_RING_SIZE : 0;
+        for(uint64_t e=begin;e<ring->size;++e){
+            tomo_trace_event &event = ring->events[ e % TOMO_TRACE_RING_SIZE ];
+            out_trace << (first ? "" : ",\n");
+            out_trace << "{\"name\": \"" << event.name << "\", \"ph\": \"X\""
+                      << ", \"ts\": " << (double)event.start / 1000.0
+                      << ", \"dur\": " << (double)event.duration / 1000.0
+                      << ", \"pid\": " << pid << ", \"tid\": " << ring->thread_id;
+            if(event.index_z >= 0)
+                out_trace << ", \"args\": {\"z\": " << event.index_z << "}";
+            out_trace << "}";
+            first = false;
+        }
+    }
+    out_trace << "\n]}" <<endl;
+    out_trace.close();
+
+    return true;
+}
+
+void tomo_trace::save_at_exit_(){
+    save_json(address_.c_str());
+    return;
+}
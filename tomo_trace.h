@@ -0,0 +1,63 @@
+#ifndef TOMO_TRACE
+#define TOMO_TRACE
+
+#include <string>
+#include <stdint.h>
+
+#define TOMO_TRACE_RING_SIZE 65536 // events kept per thread, the oldest are overwritten
+#define TOMO_TRACE_MAX_THREADS 1024
+
+using namespace std;
+
+// timeline of per-thread, per-slice activity as chrome trace event json (chrome://tracing, perfetto)
+//      every thread writes complete events into its own ring buffer, nothing is shared while tracing
+
+class tomo_trace_event{
+
+    public:
+
+    const char* name; // string literal, only the pointer is kept
+    int64_t start;    // ns
+    int64_t duration; // ns
+    int index_z;      // -1 if not about a slice
+};
+
+class tomo_trace{
+
+    static bool enabled_;
+    static string address_;
+
+    static void save_at_exit_();
+
+    public:
+
+    static int64_t now(void);
+
+    // the trace is written when the program exits
+    static void enable(const char* address);
+    static bool enabled(void){ return enabled_; }
+
+    static void record(const char* name, int64_t start, int index_z);
+    static bool save_json(const char* address);
+};
+
+class tomo_trace_scope{
+
+    const char* name_;
+    int index_z_;
+    int64_t start_;
+
+    public:
+
+    tomo_trace_scope(const char* name, int index_z = -1){
+        this->name_ = name;
+        this->index_z_ = index_z;
+        this->start_ = tomo_trace::enabled() ? tomo_trace::now() : 0;
+    }
+    ~tomo_trace_scope(){
+        if(tomo_trace::enabled())
+            tomo_trace::record(this->name_, this->start_, this->index_z_);
+    }
+};
+
+#endif // TOMO_TRACE